@@ -705,99 +705,175 @@ static const char *vfpu_extra_regs[] =
   "VFPU_RCX7"
 };
 
+/* Bounded writer used by the disassembler. Text past the
+ * end of the caller buffer is silently dropped */
+struct disbuf {
+  char *out;
+  size_t cap;
+  size_t len;
+};
+
+static
+void dis_putc (struct disbuf *b, char c)
+{
+  if (b->len + 1 < b->cap) b->out[b->len++] = c;
+}
+
+static
+void dis_puts (struct disbuf *b, const char *s)
+{
+  while (*s) dis_putc (b, *s++);
+}
+
+static
+void dis_pad (struct disbuf *b, const char *s, int width)
+{
+  int len = 0;
+  while (s[len]) dis_putc (b, s[len++]);
+  while (len++ < width) dis_putc (b, ' ');
+}
+
+static
+void dis_udec (struct disbuf *b, unsigned int val, int width)
+{
+  char digits[12];
+  int len = 0;
+
+  do {
+    digits[len++] = '0' + (val % 10);
+    val /= 10;
+  } while (val);
+  while (width-- > len) dis_putc (b, '0');
+  while (len) dis_putc (b, digits[--len]);
+}
+
+static
+void dis_dec (struct disbuf *b, int val)
+{
+  if (val < 0) {
+    dis_putc (b, '-');
+    dis_udec (b, -((unsigned int) val), 0);
+  } else {
+    dis_udec (b, val, 0);
+  }
+}
+
 static
-int print_vfpu_single (int reg, char *output)
+void dis_hex (struct disbuf *b, unsigned int val, int width)
 {
-  return sprintf (output, "S%d%d%d", (reg >> 2) & 7, reg & 3, (reg >> 5) & 3);
+  static const char hexdigits[] = "0123456789ABCDEF";
+  char digits[8];
+  int len = 0;
+
+  dis_puts (b, "0x");
+  do {
+    digits[len++] = hexdigits[val & 0xF];
+    val >>= 4;
+  } while (val);
+  while (width-- > len) dis_putc (b, '0');
+  while (len) dis_putc (b, digits[--len]);
 }
 
 static
-int print_vfpu_reg (int reg, int offset, char one, char two, char *output)
+void print_vfpu_single (int reg, struct disbuf *b)
+{
+  dis_putc (b, 'S');
+  dis_putc (b, '0' + ((reg >> 2) & 7));
+  dis_putc (b, '0' + (reg & 3));
+  dis_putc (b, '0' + ((reg >> 5) & 3));
+}
+
+static
+void print_vfpu_reg (int reg, int offset, char one, char two, struct disbuf *b)
 {
   if ((reg >> 5) & 1) {
-    return sprintf (output, "%c%d%d%d", two, (reg >> 2) & 7, offset, reg & 3);
+    dis_putc (b, two);
+    dis_putc (b, '0' + ((reg >> 2) & 7));
+    dis_putc (b, '0' + offset);
+    dis_putc (b, '0' + (reg & 3));
   } else {
-    return sprintf (output, "%c%d%d%d", one, (reg >> 2) & 7, reg & 3, offset);
+    dis_putc (b, one);
+    dis_putc (b, '0' + ((reg >> 2) & 7));
+    dis_putc (b, '0' + (reg & 3));
+    dis_putc (b, '0' + offset);
   }
 }
 
 static
-int print_vfpu_quad (int reg, char *output)
+void print_vfpu_quad (int reg, struct disbuf *b)
 {
-  return print_vfpu_reg (reg, 0, 'C', 'R', output);
+  print_vfpu_reg (reg, 0, 'C', 'R', b);
 }
 
 static
-int print_vfpu_pair (int reg, char *output)
+void print_vfpu_pair (int reg, struct disbuf *b)
 {
   if ((reg >> 6) & 1) {
-    return print_vfpu_reg (reg, 2, 'C', 'R', output);
+    print_vfpu_reg (reg, 2, 'C', 'R', b);
   } else {
-    return print_vfpu_reg (reg, 0, 'C', 'R', output);
+    print_vfpu_reg (reg, 0, 'C', 'R', b);
   }
 }
 
 static
-int print_vfpu_triple (int reg, char *output)
+void print_vfpu_triple (int reg, struct disbuf *b)
 {
   if ((reg >> 6) & 1) {
-    return print_vfpu_reg (reg, 1, 'C', 'R', output);
+    print_vfpu_reg (reg, 1, 'C', 'R', b);
   } else {
-    return print_vfpu_reg (reg, 0, 'C', 'R', output);
+    print_vfpu_reg (reg, 0, 'C', 'R', b);
   }
 }
 
 static
-int print_vfpu_mpair (int reg, char *output)
+void print_vfpu_mpair (int reg, struct disbuf *b)
 {
   if ((reg >> 6) & 1) {
-    return print_vfpu_reg (reg, 2, 'M', 'E', output);
+    print_vfpu_reg (reg, 2, 'M', 'E', b);
   } else {
-    return print_vfpu_reg (reg, 0, 'M', 'E', output);
+    print_vfpu_reg (reg, 0, 'M', 'E', b);
   }
 }
 
 static
-int print_vfpu_mtriple (int reg, char *output)
+void print_vfpu_mtriple (int reg, struct disbuf *b)
 {
   if ((reg >> 6) & 1) {
-    return print_vfpu_reg (reg, 1, 'M', 'E', output);
+    print_vfpu_reg (reg, 1, 'M', 'E', b);
   } else {
-    return print_vfpu_reg (reg, 0, 'M', 'E', output);
+    print_vfpu_reg (reg, 0, 'M', 'E', b);
   }
 }
 
 static
-int print_vfpu_matrix (int reg, char *output)
+void print_vfpu_matrix (int reg, struct disbuf *b)
 {
-  return print_vfpu_reg (reg, 0, 'M', 'E', output);
+  print_vfpu_reg (reg, 0, 'M', 'E', b);
 }
 
 static
-int print_vfpu_register (int reg, char type, char *output)
+void print_vfpu_register (int reg, char type, struct disbuf *b)
 {
   switch (type) {
-  case 's': return print_vfpu_single (reg, output);
-  case 'q': return print_vfpu_quad (reg, output);
-  case 'p': return print_vfpu_pair (reg, output);
-  case 't': return print_vfpu_triple (reg, output);
-  case 'm': return print_vfpu_mpair (reg, output);
-  case 'n': return print_vfpu_mtriple (reg, output);
-  case 'o': return print_vfpu_matrix (reg, output);
+  case 's': print_vfpu_single (reg, b); break;
+  case 'q': print_vfpu_quad (reg, b); break;
+  case 'p': print_vfpu_pair (reg, b); break;
+  case 't': print_vfpu_triple (reg, b); break;
+  case 'm': print_vfpu_mpair (reg, b); break;
+  case 'n': print_vfpu_mtriple (reg, b); break;
+  case 'o': print_vfpu_matrix (reg, b); break;
   };
-
-  return 0;
 }
 
 static
-int print_vfpu_halffloat (int l, char *output)
+void print_vfpu_halffloat (int l, struct disbuf *b)
 {
   unsigned short float16 = l & 0xFFFF;
   unsigned int sign = (float16 >> VFPU_SH_FLOAT16_SIGN) & VFPU_MASK_FLOAT16_SIGN;
   int exponent = (float16 >> VFPU_SH_FLOAT16_EXP) & VFPU_MASK_FLOAT16_EXP;
   unsigned int fraction = float16 & VFPU_MASK_FLOAT16_FRAC;
   char signchar = '+' + ((sign == 1) * 2);
-  int len;
+  char temp[32];
   /* Convert a VFPU 16-bit floating-point number to IEEE754. */
   union float2int
   {
@@ -806,12 +882,14 @@ int print_vfpu_halffloat (int l, char *output)
   } float2int;
 
   if (exponent == VFPU_FLOAT16_EXP_MAX) {
+    dis_putc (b, signchar);
     if (fraction == 0)
-      len = sprintf (output, "%cInf", signchar);
+      dis_puts (b, "Inf");
     else
-      len = sprintf (output, "%cNaN", signchar);
+      dis_puts (b, "NaN");
   } else if (exponent == 0 && fraction == 0) {
-    len = sprintf (output, "%c0", signchar);
+    dis_putc (b, signchar);
+    dis_putc (b, '0');
   } else {
     if (exponent == 0) {
       do {
@@ -826,18 +904,17 @@ int print_vfpu_halffloat (int l, char *output)
     float2int.i = sign << 31;
     float2int.i |= (exponent + 112) << 23;
     float2int.i |= fraction << 13;
-    len = sprintf (output, "%g", float2int.f);
-  }
 
-  return len;
+    /* Floating point formatting is left to the C library */
+    sprintf (temp, "%g", float2int.f);
+    dis_puts (b, temp);
+  }
 }
 
 /* [hlide] added print_vfpu_prefix */
 static
-int print_vfpu_prefix (int l, unsigned int pos, char *output)
+void print_vfpu_prefix (int l, unsigned int pos, struct disbuf *b)
 {
-  int len = 0;
-
   switch (pos)
   {
   case '0':
@@ -852,14 +929,16 @@ int print_vfpu_prefix (int l, unsigned int pos, char *output)
       unsigned int swz_constlo = (l >> ((pos - base) * 2)) & VFPU_MASK_PFX_SWZ_CSTLO;
 
       if (negation)
-        len = sprintf (output, "-");
+        dis_putc (b, '-');
       if (constant) {
-        len += sprintf (output + len, "%s", pfx_cst_names[(abs_consthi << 2) | swz_constlo]);
+        dis_puts (b, pfx_cst_names[(abs_consthi << 2) | swz_constlo]);
       } else {
-        if (abs_consthi)
-          len += sprintf (output + len, "|%s|", pfx_swz_names[swz_constlo]);
-        else
-          len += sprintf (output + len, "%s", pfx_swz_names[swz_constlo]);
+        if (abs_consthi) {
+          dis_putc (b, '|');
+          dis_puts (b, pfx_swz_names[swz_constlo]);
+          dis_putc (b, '|');
+        } else
+          dis_puts (b, pfx_swz_names[swz_constlo]);
       }
     }
     break;
@@ -874,22 +953,18 @@ int print_vfpu_prefix (int l, unsigned int pos, char *output)
       unsigned int saturation = (l >> ((pos - base) * 2)) & VFPU_MASK_PFX_SAT;
 
       if (mask)
-        len += sprintf (output, "m");
+        dis_putc (b, 'm');
       else
-        len += sprintf (output, "%s", pfx_sat_names[saturation]);
+        dis_puts (b, pfx_sat_names[saturation]);
     }
     break;
   }
-
-  return len;
 }
 
 
 static
-int print_vfpu_rotator (int l, char *output)
+void print_vfpu_rotator (int l, struct disbuf *b)
 {
-  int len;
-
   const char *elements[4];
 
   unsigned int opcode = l & VFPU_MASK_OP_SIZE;
@@ -932,56 +1007,55 @@ int print_vfpu_rotator (int l, char *output)
     elements[rothi] = "s";
   elements[rotlo] = "c";
 
-  len = sprintf (output, "[");
+  /* The old sprintf based version overwrote the " ," separator
+   * with the next element, so none is printed here either */
+  dis_putc (b, '[');
   for (i = 0;;) {
-    len += sprintf (output + len, "%s", elements[i++]);
+    dis_puts (b, elements[i++]);
     if (i >= opsize)
       break;
-    sprintf (output + len, " ,");
   }
-
-  len += sprintf (output + len, "]");
-
-  return len;
+  dis_putc (b, ']');
 }
 
 /* [hlide] added print_cop2 */
 static
-int print_cop2 (int reg, char *output)
+void print_cop2 (int reg, struct disbuf *b)
 {
-  int len;
-
   if ((reg >= 128) && (reg < 128+16) && (vfpu_extra_regs[reg - 128])) {
-    len = sprintf (output, "%s", vfpu_extra_regs[reg - 128]);
+    dis_puts (b, vfpu_extra_regs[reg - 128]);
   } else {
-    len = sprintf (output, "VFPU_COP2_%d", reg);
+    dis_puts (b, "VFPU_COP2_");
+    dis_dec (b, reg);
   }
-
-  return len;
 }
 
 
 static
-void print_instruction (const struct allegrex_instruction *insn, unsigned int opcode, unsigned int PC, int prtall)
+void print_instruction (const struct allegrex_instruction *insn, unsigned int opcode, unsigned int PC, int prtall, struct disbuf *b)
 {
-  int i = 0, len = 0, vmmul = 0;
+  int i = 0, vmmul = 0;
   unsigned int data = opcode;
 
   if (prtall) {
-    len += sprintf (buffer, "0x%08X: 0x%08X '", PC, opcode);
+    dis_hex (b, PC, 8);
+    dis_puts (b, ": ");
+    dis_hex (b, opcode, 8);
+    dis_puts (b, " '");
     for (i = 0; i < 4; i++) {
       char c = (char) (data & 0xFF);
-      if (isprint (c)) { len += sprintf (&buffer[len], "%c", c); }
-      else { len += sprintf (&buffer[len], "."); }
+      if (isprint (c)) { dis_putc (b, c); }
+      else { dis_putc (b, '.'); }
       data >>= 8;
     }
-    len += sprintf (&buffer[len], "' - ");
+    dis_puts (b, "' - ");
   }
   if (!insn) {
-    sprintf (&buffer[len], "Invalid");
+    dis_puts (b, "Invalid");
     return;
   }
-  len += sprintf (&buffer[len], "%-10s ", insn->name);
+  dis_pad (b, insn->name, 10);
+  dis_putc (b, ' ');
 
   i = 0;
   while (1) {
@@ -991,121 +1065,136 @@ void print_instruction (const struct allegrex_instruction *insn, unsigned int op
       c = insn->fmt[i++];
       switch (c) {
       case 'd':
-        len += sprintf (&buffer[len], "$%s", gpr_names[RD (opcode)]);
+        dis_putc (b, '$');
+        dis_puts (b, gpr_names[RD (opcode)]);
         break;
       case 'D':
-        len += sprintf (&buffer[len], "$fpr%02d", FD (opcode));
+        dis_puts (b, "$fpr");
+        dis_udec (b, FD (opcode), 2);
         break;
       case 't':
-        len += sprintf (&buffer[len], "$%s", gpr_names[RT (opcode)]);
+        dis_putc (b, '$');
+        dis_puts (b, gpr_names[RT (opcode)]);
         break;
       case 'T':
-        len += sprintf (&buffer[len], "$fpr%02d", FT (opcode));
+        dis_puts (b, "$fpr");
+        dis_udec (b, FT (opcode), 2);
         break;
       case 's':
-        len += sprintf (&buffer[len], "$%s", gpr_names[RS (opcode)]);
+        dis_putc (b, '$');
+        dis_puts (b, gpr_names[RS (opcode)]);
         break;
       case 'S':
-        len += sprintf (&buffer[len], "$fpr%02d", FS (opcode));
+        dis_puts (b, "$fpr");
+        dis_udec (b, FS (opcode), 2);
         break;
       case 'J':
-        len += sprintf (&buffer[len], "$%s", gpr_names[RS (opcode)]);
+        dis_putc (b, '$');
+        dis_puts (b, gpr_names[RS (opcode)]);
         break;
       case 'i':
-        len += sprintf (&buffer[len], "%d", IMM (opcode));
+        dis_dec (b, IMM (opcode));
         break;
       case 'I':
-        len += sprintf (&buffer[len], "0x%04X", IMMU (opcode));
+        dis_hex (b, IMMU (opcode), 4);
         break;
       case 'j':
-        len += sprintf (&buffer[len], "0x%08X", JUMP (opcode, PC));
+        dis_hex (b, JUMP (opcode, PC), 8);
         break;
       case 'O':
-        len += sprintf (&buffer[len], "0x%08X", PC + 4 + 4 * ((int) IMM (opcode)));
+        dis_hex (b, PC + 4 + 4 * ((int) IMM (opcode)), 8);
         break;
       case 'o':
-        len += sprintf (&buffer[len], "%d($%s)", IMM (opcode), gpr_names[RS (opcode)]);
+        dis_dec (b, IMM (opcode));
+        dis_puts (b, "($");
+        dis_puts (b, gpr_names[RS (opcode)]);
+        dis_putc (b, ')');
         break;
       case 'c':
         if (CODE(opcode) != 0)
-          len += sprintf (&buffer[len], "0x%05X", CODE (opcode));
+          dis_hex (b, CODE (opcode), 5);
         break;
       case 'k':
-        len += sprintf (&buffer[len], "0x%X", RT (opcode));
+        dis_hex (b, RT (opcode), 0);
         break;
       case 'p':
-        len += sprintf (&buffer[len], "$%d", RD (opcode));
+        dis_putc (b, '$');
+        dis_dec (b, RD (opcode));
         break;
       case 'a':
-        len += sprintf (&buffer[len], "%d", SA (opcode));
+        dis_dec (b, SA (opcode));
         break;
       case 'r':
-        len += sprintf (&buffer[len], "%s", debug_regs[RD (opcode)]);
+        dis_puts (b, debug_regs[RD (opcode)]);
         break;
       case '0':
-        len += sprintf (&buffer[len], "%s", cop0_regs[RD (opcode)]);
+        dis_puts (b, cop0_regs[RD (opcode)]);
         break;
       case '1':
-        len += sprintf (&buffer[len], "$fpr%d", RD (opcode));
+        dis_puts (b, "$fpr");
+        dis_dec (b, RD (opcode));
         break;
       case '2':
         c = insn->fmt[i++];
         if (c == 'd') {
-          len += print_cop2 (VED (opcode), &buffer[len]);
+          print_cop2 (VED (opcode), b);
         } else { /* 's'*/
-          len += print_cop2 (VES (opcode), &buffer[len]);
+          print_cop2 (VES (opcode), b);
         }
         break;
       case 'z':
         c = insn->fmt[i++];
-        len += print_vfpu_register (VD (opcode), c, &buffer[len]);
+        print_vfpu_register (VD (opcode), c, b);
         break;
       case 'Z':
         c = insn->fmt[i++];
         if (c == 'c') {
-          len += sprintf (&buffer[len], "%d", VCC (opcode));
+          dis_dec (b, VCC (opcode));
         } else { /* 'n' */
-          len += sprintf (&buffer[len], "%s", vfpu_cond_names[VCN (opcode)]);
+          dis_puts (b, vfpu_cond_names[VCN (opcode)]);
         }
         break;
       case 'n':
         c = insn->fmt[i++];
         if (c == 'e') {
-          len += sprintf (&buffer[len], "%d", RD (opcode) + 1);
+          dis_dec (b, RD (opcode) + 1);
         } else { /* 'i' */
-          len += sprintf (&buffer[len], "%d", RD (opcode) - SA (opcode) + 1);
+          dis_dec (b, RD (opcode) - SA (opcode) + 1);
         }
         break;
       case 'X':
         c = insn->fmt[i++];
-        len += print_vfpu_register (VO (opcode), c, &buffer[len]);
+        print_vfpu_register (VO (opcode), c, b);
         break;
       case 'x':
         c = insn->fmt[i++];
-        len += print_vfpu_register (VT (opcode), c, &buffer[len]);
+        print_vfpu_register (VT (opcode), c, b);
         break;
       case 'Y':
-        len += sprintf (&buffer[len], "%d($%s)", IMM (opcode) & ~3, gpr_names[RS (opcode)]);
+        dis_dec (b, IMM (opcode) & ~3);
+        dis_puts (b, "($");
+        dis_puts (b, gpr_names[RS (opcode)]);
+        dis_putc (b, ')');
         break;
       case 'y':
         {
           int reg = VS (opcode);
           if (vmmul) { if (reg & 0x20) { reg &= 0x5F; } else { reg |= 0x20; } }
           c = insn->fmt[i++];
-          len += print_vfpu_register (reg, c, &buffer[len]);
+          print_vfpu_register (reg, c, b);
         }
         break;
       case 'v':
         c = insn->fmt[i++];
         switch (c) {
-        case '3' : len += sprintf (&buffer[len], "%d", VI3 (opcode)); break;
-        case '5' : len += sprintf (&buffer[len], "%d", VI5 (opcode)); break;
-        case '8' : len += sprintf (&buffer[len], "%d", VI8 (opcode)); break;
-        case 'k' : len += sprintf (&buffer[len], "%s", vfpu_constants [VI5 (opcode)]); break;
-        case 'i' : len += sprintf (&buffer[len], "%d", IMM (opcode)); break;
-        case 'h' : len += print_vfpu_halffloat (opcode, &buffer[len]); break;
-        case 'r' : len += print_vfpu_rotator (opcode, &buffer[len]); break;
-        case 'p' : c = insn->fmt[i++]; len += print_vfpu_prefix (opcode, c, &buffer[len]); break;
+        case '3' : dis_dec (b, VI3 (opcode)); break;
+        case '5' : dis_dec (b, VI5 (opcode)); break;
+        case '8' : dis_dec (b, VI8 (opcode)); break;
+        case 'k' : dis_puts (b, vfpu_constants [VI5 (opcode)]); break;
+        case 'i' : dis_dec (b, IMM (opcode)); break;
+        case 'h' : print_vfpu_halffloat (opcode, b); break;
+        case 'r' : print_vfpu_rotator (opcode, b); break;
+        case 'p' : c = insn->fmt[i++]; print_vfpu_prefix (opcode, c, b); break;
         }
         break;
       case '?':
@@ -1113,11 +1202,10 @@ void print_instruction (const struct allegrex_instruction *insn, unsigned int op
         break;
       }
     } else {
-      len += sprintf (&buffer[len], "%c", c);
+      dis_putc (b, c);
     }
   }
-  while (buffer[len-1] == ' ' && len > 0) len--;
-  buffer[len] = '\0';
+  while (b->len > 0 && b->out[b->len - 1] == ' ') b->len--;
 }
 
 #ifdef SLOW_VERSION
@@ -1189,10 +1277,23 @@ const struct allegrex_instruction *allegrex_decode (unsigned int opcode, int all
 
 #endif /* !SLOW_VERSION */
 
-char *allegrex_disassemble (unsigned int opcode, unsigned int PC, int prtall)
+int allegrex_disassemble_r (unsigned int opcode, unsigned int PC, int prtall, char *out, size_t cap)
 {
   const struct allegrex_instruction *insn = allegrex_decode (opcode, 1);
-  print_instruction (insn, opcode, PC, prtall);
+  struct disbuf b;
+
+  if (!cap) return 0;
+  b.out = out;
+  b.cap = cap;
+  b.len = 0;
+  print_instruction (insn, opcode, PC, prtall, &b);
+  out[b.len] = '\0';
+  return b.len;
+}
+
+char *allegrex_disassemble (unsigned int opcode, unsigned int PC, int prtall)
+{
+  allegrex_disassemble_r (opcode, PC, prtall, buffer, sizeof (buffer));
   return (char *) buffer;
 }
 
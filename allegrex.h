@@ -5,6 +5,8 @@
 #ifndef __ALLEGREX_H
 #define __ALLEGREX_H
 
+#include <stddef.h>
+
 #define INSN_READ_GPR_S      0x00000001
 #define INSN_READ_GPR_T      0x00000002
 #define INSN_READ_GPR_D      0x00000004
@@ -466,7 +468,10 @@ struct allegrex_instruction
 
 extern const char *gpr_names[];
 
+/* allegrex_disassemble returns a static buffer, the reentrant version
+ * writes into out and returns the length of the text */
 char *allegrex_disassemble (unsigned int opcode, unsigned int PC, int prtall);
+int allegrex_disassemble_r (unsigned int opcode, unsigned int PC, int prtall, char *out, size_t cap);
 const struct allegrex_instruction *allegrex_decode (unsigned int opcode, int allowalias);
 
 #endif /* __ALLEGREX_H */
@@ -2,13 +2,18 @@
  * Author: Humberto Naves (hsnaves@gmail.com)
  */
 
+#include <ctype.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "code.h"
+#include "intern.h"
+#include "profile.h"
 #include "utils.h"
 
-static
+uint32 g_subbudget = 0;
+uint32 g_stagebudget = 0;
+
 struct code *code_alloc (void)
 {
   struct code *c;
@@ -28,42 +33,201 @@ struct code *code_alloc (void)
   return c;
 }
 
-struct code* code_analyse (struct prx *p)
+static
+struct code *code_decode (struct prx *p)
 {
   struct code *c = code_alloc ();
-  struct subroutine *sub;
-  element el;
 
   c->file = p;
 
+  profile_begin (PROF_DECODE);
   if (!decode_instructions (c)) {
+    profile_end (PROF_DECODE);
     code_free (c);
     return NULL;
   }
+  profile_instructions (c->numopc);
+  profile_end (PROF_DECODE);
 
+  profile_begin (PROF_SWITCHES);
   extract_switches (c);
-  extract_subroutines (c);
+  profile_end (PROF_SWITCHES);
+
+  return c;
+}
+
+/* Charges the work units to the subroutine. When it goes over one of
+ * the budgets, the analysis of the subroutine is given up, as with the
+ * other errors, and only its disassembly is printed */
+int budget_spend (struct subroutine *sub, uint32 units)
+{
+  if (sub->haserror) return FALSE;
+  sub->work += units;
+  sub->stagework += units;
+  if ((g_subbudget && sub->work > g_subbudget) ||
+      (g_stagebudget && sub->stagework > g_stagebudget)) {
+    error (__FILE__ ": subroutine at 0x%08X is over the analysis budget", sub->begin->address);
+    sub->haserror = TRUE;
+    return FALSE;
+  }
+  return TRUE;
+}
+
+static
+void stage_begin (struct subroutine *sub, enum profstage stage)
+{
+  sub->stagework = 0;
+  profile_begin (stage);
+}
+
+/* When analysing a single function, the other extracted subroutines
+ * are only used to find its arguments and results */
+static
+int is_analysed (struct code *c, struct subroutine *sub)
+{
+  if (c->function && sub != c->function) return FALSE;
+  return (sub->status & SUB_STAT_OPERATIONS_EXTRACTED) && !sub->haserror;
+}
 
+static
+int is_call (struct location *loc)
+{
+  if (loc->reachable != LOCATION_REACHABLE || !loc->insn) return FALSE;
+  if (!(loc->insn->flags & (INSN_BRANCH | INSN_JUMP))) return FALSE;
+  return (loc->target && loc->target->sub && loc->target->sub->begin == loc->target);
+}
+
+/* The arguments of the imports missing from the nids file are inferred
+ * from the SSA form of all their callers. So when analysing a single
+ * function, the callers of such imports called by the function (marked
+ * in temp) are taken up to the SSA form too */
+static
+int needs_ssa (struct code *c, struct subroutine *sub)
+{
+  struct location *loc;
+
+  if (is_analysed (c, sub)) return TRUE;
+  if (!c->function || sub->import || sub->haserror ||
+      !(sub->status & SUB_STAT_OPERATIONS_EXTRACTED)) return FALSE;
+
+  for (loc = sub->begin; ; loc++) {
+    if (is_call (loc) && loc->target->sub->temp) return TRUE;
+    if (loc == sub->end) break;
+  }
+  return FALSE;
+}
+
+/* Runs the stages that follow the call arguments, rebuilding them
+ * first when they were undone */
+static
+void analyse_dataflow (struct subroutine *sub)
+{
+  if (!(sub->status & SUB_STAT_FIXUP_CALL_ARGS)) {
+    stage_begin (sub, PROF_FIXUP_CALL_ARGS);
+    fixup_call_arguments (sub);
+    profile_endsub (PROF_FIXUP_CALL_ARGS, sub->begin->address, sub->end->address);
+    if (!sub->haserror) {
+      sub->status |= SUB_STAT_FIXUP_CALL_ARGS;
+      stage_begin (sub, PROF_SSA);
+      build_ssa (sub);
+      profile_endsub (PROF_SSA, sub->begin->address, sub->end->address);
+    }
+  }
+
+  if (!sub->haserror) {
+    sub->status |= SUB_STAT_SSA;
+    stage_begin (sub, PROF_CONSTANTS);
+    propagate_constants (sub);
+    profile_endsub (PROF_CONSTANTS, sub->begin->address, sub->end->address);
+  }
+
+  if (!sub->haserror) {
+    sub->status |= SUB_STAT_CONSTANTS_EXTRACTED;
+    stage_begin (sub, PROF_VARIABLES);
+    extract_variables (sub);
+    profile_endsub (PROF_VARIABLES, sub->begin->address, sub->end->address);
+  }
+
+  if (!sub->haserror) {
+    sub->status |= SUB_STAT_VARIABLES_EXTRACTED;
+    /* The structures only depend on the control flow graph */
+    if (!(sub->status & SUB_STAT_STRUCTURES_EXTRACTED)) {
+      stage_begin (sub, PROF_STRUCTURES);
+      extract_structures (sub);
+      /* The post dominators are not needed anymore */
+      cfg_reverse_free (sub);
+      profile_endsub (PROF_STRUCTURES, sub->begin->address, sub->end->address);
+    }
+  }
+
+  if (!sub->haserror) {
+    sub->status |= SUB_STAT_STRUCTURES_EXTRACTED;
+  }
+}
+
+/* Undoes everything done from the call arguments onwards */
+static
+void unbuild_dataflow (struct subroutine *sub)
+{
+  element blockel, opel;
+
+  if (!(sub->status & SUB_STAT_FIXUP_CALL_ARGS)) return;
+  if (sub->status & SUB_STAT_SSA) unbuild_ssa (sub);
+  remove_call_arguments (sub);
+
+  blockel = list_head (sub->blocks);
+  while (blockel) {
+    struct basicblock *block = element_getvalue (blockel);
+    opel = list_head (block->operations);
+    while (opel) {
+      struct operation *op = element_getvalue (opel);
+      op->status &= ~(OP_STAT_DEFERRED | OP_STAT_CONSTANT | OP_STAT_SPECIALREGS);
+      opel = element_next (opel);
+    }
+    blockel = element_next (blockel);
+  }
+
+  sub->status &= ~(SUB_STAT_FIXUP_CALL_ARGS | SUB_STAT_SSA |
+                   SUB_STAT_CONSTANTS_EXTRACTED | SUB_STAT_VARIABLES_EXTRACTED);
+}
+
+/* Runs the rest of the pipeline over the extracted subroutines */
+static
+void analyse_subroutines (struct code *c)
+{
+  struct subroutine *sub;
+  element el;
+
+  profile_begin (PROF_LIVE_REGISTERS);
   live_registers (c);
+  profile_end (PROF_LIVE_REGISTERS);
 
   el = list_head (c->subroutines);
   while (el) {
     sub = element_getvalue (el);
-    if (!sub->import && !sub->haserror) {
+    if (needs_ssa (c, sub)) {
+      stage_begin (sub, PROF_CFG_TRAVERSE);
       cfg_traverse (sub, FALSE);
+      profile_endsub (PROF_CFG_TRAVERSE, sub->begin->address, sub->end->address);
       if (!sub->haserror) {
         sub->status |= SUB_STAT_CFG_TRAVERSE;
+        stage_begin (sub, PROF_CFG_TRAVERSE_REV);
         cfg_traverse (sub, TRUE);
+        profile_endsub (PROF_CFG_TRAVERSE_REV, sub->begin->address, sub->end->address);
       }
 
       if (!sub->haserror) {
         sub->status |= SUB_STAT_CFG_TRAVERSE_REV;
+        stage_begin (sub, PROF_FIXUP_CALL_ARGS);
         fixup_call_arguments (sub);
+        profile_endsub (PROF_FIXUP_CALL_ARGS, sub->begin->address, sub->end->address);
       }
 
       if (!sub->haserror) {
         sub->status |= SUB_STAT_FIXUP_CALL_ARGS;
+        stage_begin (sub, PROF_SSA);
         build_ssa (sub);
+        profile_endsub (PROF_SSA, sub->begin->address, sub->end->address);
       }
 
       if (!sub->haserror) {
@@ -73,47 +237,289 @@ struct code* code_analyse (struct prx *p)
     el = element_next (el);
   }
 
+  profile_begin (PROF_LIVE_IMPORTS);
   live_registers_imports (c);
+  profile_end (PROF_LIVE_IMPORTS);
 
   el = list_head (c->subroutines);
   while (el) {
     sub = element_getvalue (el);
-    if (!sub->import && !sub->haserror) {
-      if (!(sub->status & SUB_STAT_FIXUP_CALL_ARGS)) {
-        fixup_call_arguments (sub);
-        if (!sub->haserror) {
-          sub->status |= SUB_STAT_FIXUP_CALL_ARGS;
-          build_ssa (sub);
-        }
-      }
+    if (is_analysed (c, sub))
+      analyse_dataflow (sub);
+    el = element_next (el);
+  }
+}
 
-      if (!sub->haserror) {
-        sub->status |= SUB_STAT_SSA;
-        propagate_constants (sub);
-      }
+struct code* code_analyse (struct prx *p)
+{
+  struct code *c = code_decode (p);
+  if (!c) return NULL;
 
-      if (!sub->haserror) {
-        sub->status |= SUB_STAT_CONSTANTS_EXTRACTED;
-        extract_variables (sub);
-      }
+  extract_subroutines (c);
+  analyse_subroutines (c);
+
+  profile_begin (PROF_XREFS);
+  build_xrefs (c);
+  profile_end (PROF_XREFS);
+
+  return c;
+}
+
+/* The number of arguments of the imports (from the nids file) is only
+ * used when adding the arguments to the calls, so when it changes only
+ * the subroutines calling these imports need to be analysed again */
+void code_update_imports (struct code *c, list imports)
+{
+  struct subroutine *sub;
+  element el, ref;
+
+  el = list_head (imports);
+  while (el) {
+    sub = element_getvalue (el);
+    sub->numregargs = sub->import->numargs;
+    ref = list_head (sub->whereused);
+    while (ref) {
+      struct basicblock *block = element_getvalue (ref);
+      unbuild_dataflow (block->sub);
+      ref = element_next (ref);
+    }
+    el = element_next (el);
+  }
+
+  el = list_head (c->subroutines);
+  while (el) {
+    sub = element_getvalue (el);
+    if ((sub->status & SUB_STAT_CFG_TRAVERSE_REV) && !sub->haserror &&
+        !(sub->status & SUB_STAT_FIXUP_CALL_ARGS)) {
+      stage_begin (sub, PROF_FIXUP_CALL_ARGS);
+      fixup_call_arguments (sub);
+      profile_endsub (PROF_FIXUP_CALL_ARGS, sub->begin->address, sub->end->address);
 
       if (!sub->haserror) {
-        sub->status |= SUB_STAT_VARIABLES_EXTRACTED;
-        extract_structures (sub);
+        sub->status |= SUB_STAT_FIXUP_CALL_ARGS;
+        stage_begin (sub, PROF_SSA);
+        build_ssa (sub);
+        profile_endsub (PROF_SSA, sub->begin->address, sub->end->address);
       }
 
       if (!sub->haserror) {
-        sub->status |= SUB_STAT_STRUCTURES_EXTRACTED;
+        sub->status |= SUB_STAT_SSA;
       }
     }
     el = element_next (el);
   }
 
+  /* Imports which lost their number of arguments get it inferred again */
+  profile_begin (PROF_LIVE_IMPORTS);
+  live_registers_imports (c);
+  profile_end (PROF_LIVE_IMPORTS);
+
+  el = list_head (c->subroutines);
+  while (el) {
+    sub = element_getvalue (el);
+    if (is_analysed (c, sub) && !(sub->status & SUB_STAT_VARIABLES_EXTRACTED))
+      analyse_dataflow (sub);
+    el = element_next (el);
+  }
+}
+
+/* Compares a function with a name as print_subroutine_name prints it: the
+ * name itself or, if it is unknown, the library and the nid in hex */
+static
+int function_matches (struct prx_function *func, const char *name, const char *interned)
+{
+  size_t len;
+  int i;
+
+  if (func->name) return func->name == interned;
+  if (!func->libname) return FALSE;
+
+  len = strlen (func->libname);
+  if (strncmp (name, func->libname, len) != 0 || name[len] != '_') return FALSE;
+  name += len + 1;
+
+  for (i = 0; i < 8; i++)
+    if (!isxdigit ((unsigned char) name[i])) return FALSE;
+  return name[8] == '\0' && strtoul (name, NULL, 16) == func->nid;
+}
+
+struct subroutine *code_find_function (struct code *c, const char *function)
+{
+  struct subroutine *sub;
+  const char *interned;
+  uint32 address, tgt;
+  element el;
+  char *end;
+
+  if (function[0] == '0' && (function[1] == 'x' || function[1] == 'X')) {
+    address = strtoul (function, &end, 16);
+    if (*end || address < c->baddr || (address & 0x03)) return NULL;
+    tgt = (address - c->baddr) >> 2;
+    if (tgt >= c->numopc) return NULL;
+    return c->base[tgt].sub;
+  }
+
+  /* The names are interned, so they can be compared by pointer */
+  interned = intern_find (function);
+
+  el = list_head (c->subroutines);
+  while (el) {
+    sub = element_getvalue (el);
+    if (sub->export && function_matches (sub->export, function, interned))
+      return sub;
+    el = element_next (el);
+  }
+  return NULL;
+}
+
+struct subroutine *code_find_import (struct code *c, const char *name)
+{
+  const char *interned = intern_find (name);
+  element el;
+
+  el = list_head (c->subroutines);
+  while (el) {
+    struct subroutine *sub = element_getvalue (el);
+    if (sub->import && function_matches (sub->import, name, interned))
+      return sub;
+    el = element_next (el);
+  }
+  return NULL;
+}
+
+static
+void select_subroutine (list worklist, struct subroutine *sub)
+{
+  if (!sub || sub->temp) return;
+  sub->temp = 1;
+  list_inserttail (worklist, sub);
+}
+
+/* Selects the subroutines needed by the liveness analysis of the target.
+ * The arguments of a subroutine depend on its callees and its results on
+ * the uses in its callers, which depend in turn on everything else these
+ * callers call. So the selection grows along the calls both ways until
+ * it reaches a fixed point, except for the callers of the imports that
+ * the target doesn't call */
+static
+list select_closure (struct code *c, struct subroutine *target)
+{
+  list worklist = list_alloc (c->lstpool);
+  list selected = list_alloc (c->lstpool);
+  struct subroutine *sub;
+  struct location *loc;
+  uint32 *first, *callers;
+  uint32 i, k, numcalls = 0;
+  int expand;
+
+  /* The call sites of each subroutine, indexed by its start */
+  first = (uint32 *) xmalloc ((c->numopc + 1) * sizeof (uint32));
+  memset (first, 0, (c->numopc + 1) * sizeof (uint32));
+  for (i = 0; i < c->numopc; i++) {
+    loc = &c->base[i];
+    if (is_call (loc)) {
+      first[(loc->target - c->base) + 1]++;
+      numcalls++;
+    }
+  }
+  for (i = 0; i < c->numopc; i++)
+    first[i + 1] += first[i];
+
+  callers = (uint32 *) xmalloc ((numcalls + 1) * sizeof (uint32));
+  for (i = 0; i < c->numopc; i++) {
+    loc = &c->base[i];
+    if (is_call (loc))
+      callers[first[loc->target - c->base]++] = i;
+  }
+  for (i = c->numopc; i > 0; i--)
+    first[i] = first[i - 1];
+  first[0] = 0;
+
+  select_subroutine (worklist, target);
+  while (list_size (worklist) != 0) {
+    sub = list_removehead (worklist);
+    list_inserttail (selected, sub);
+
+    /* The arguments and results of an import only change the calls of
+     * the target, as only the target gets its SSA form */
+    i = sub->begin - c->base;
+    expand = !sub->import;
+    for (k = first[i]; !expand && k < first[i + 1]; k++)
+      expand = (c->base[callers[k]].sub == target);
+
+    if (expand)
+      for (k = first[i]; k < first[i + 1]; k++)
+        select_subroutine (worklist, c->base[callers[k]].sub);
+
+    if (sub->import) continue;
+    for (loc = sub->begin; ; loc++) {
+      if (is_call (loc))
+        select_subroutine (worklist, loc->target->sub);
+      if (loc == sub->end) break;
+    }
+  }
+
+  free (first);
+  free (callers);
+  list_free (worklist);
+  return selected;
+}
+
+/* Marks the imports called by sub whose number of arguments is unknown */
+static
+void mark_unknown_imports (struct subroutine *sub, int mark)
+{
+  struct location *loc;
+
+  for (loc = sub->begin; ; loc++) {
+    if (is_call (loc) && loc->target->sub->import && loc->target->sub->numregargs == -1)
+      loc->target->sub->temp = mark;
+    if (loc == sub->end) break;
+  }
+}
+
+struct code* code_analyse_function (struct prx *p, const char *function)
+{
+  struct code *c = code_decode (p);
+  struct subroutine *sub;
+  list selected;
+  element el;
+
+  if (!c) return NULL;
+
+  find_subroutines (c);
+  c->function = code_find_function (c, function);
+  if (!c->function || c->function->import) {
+    error (__FILE__ ": can't find function `%s'", function);
+    code_free (c);
+    return NULL;
+  }
+
+  selected = select_closure (c, c->function);
+  el = list_head (selected);
+  while (el) {
+    sub = element_getvalue (el);
+    sub->temp = 0;
+    extract_subroutine (sub);
+    el = element_next (el);
+  }
+  list_free (selected);
+
+  mark_unknown_imports (c->function, 1);
+  analyse_subroutines (c);
+  mark_unknown_imports (c->function, 0);
+
+  profile_begin (PROF_XREFS);
+  build_xrefs (c);
+  profile_end (PROF_XREFS);
+
   return c;
 }
 
 void code_free (struct code *c)
 {
+  free_xrefs (c);
+
   if (c->base)
     free (c->base);
   c->base = NULL;
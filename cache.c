@@ -0,0 +1,1050 @@
+/**
+ * Author: Humberto Naves (hsnaves@gmail.com)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache.h"
+#include "outbuf.h"
+#include "utils.h"
+
+/* The cache stores every object built by code_analyse. Each kind of
+ * object is numbered and written as a table, the pointers are written as
+ * indexes into these tables (plus one, zero being NULL), and all numbers
+ * are written as variable length integers. The decoded instructions are
+ * not stored, they are decoded again from the prx when loading.
+ * The number of arguments of every import is stored too, so that a cache
+ * saved with another nids file can still be used: only the callers of
+ * the imports whose number of arguments changed are analysed again. */
+
+static const char cache_magic[4] = { 'P', 'D', 'C', 'A' };
+
+enum cachetable {
+  TABLE_SUBS = 0,
+  TABLE_BLOCKS,
+  TABLE_EDGES,
+  TABLE_OPS,
+  TABLE_VALUES,
+  TABLE_VARS,
+  TABLE_CTRLS,
+  TABLE_SWITCHES,
+  NUM_TABLES
+};
+
+#define NODE_BLOCK(n, rev) \
+  ((struct basicblock *) ((char *) (n) - ((rev) ? \
+    offsetof (struct basicblock, revnode) : offsetof (struct basicblock, node))))
+
+struct cachewriter {
+  struct code *c;
+  struct outbuf *out;
+  void **objs[NUM_TABLES];
+  uint32 count[NUM_TABLES], capacity[NUM_TABLES];
+};
+
+struct cachereader {
+  struct code *c;
+  const uint8 *data;
+  size_t size, pos;
+  void **objs[NUM_TABLES];
+  uint32 count[NUM_TABLES];
+  uint32 nidsversion;
+  int *numargs;
+  int error;
+};
+
+
+static
+uint32 function_index (struct prx *p, struct prx_function *func)
+{
+  uint32 i, index = 1;
+
+  if (!func) return 0;
+  for (i = 0; i < p->modinfo->numexports; i++) {
+    struct prx_export *exp = &p->modinfo->exports[i];
+    if (func >= exp->funcs && func < &exp->funcs[exp->nfuncs])
+      return index + (func - exp->funcs);
+    index += exp->nfuncs;
+  }
+  for (i = 0; i < p->modinfo->numimports; i++) {
+    struct prx_import *imp = &p->modinfo->imports[i];
+    if (func >= imp->funcs && func < &imp->funcs[imp->nfuncs])
+      return index + (func - imp->funcs);
+    index += imp->nfuncs;
+  }
+  return 0;
+}
+
+static
+struct prx_function *function_at (struct prx *p, uint32 index)
+{
+  uint32 i;
+
+  if (!index--) return NULL;
+  for (i = 0; i < p->modinfo->numexports; i++) {
+    struct prx_export *exp = &p->modinfo->exports[i];
+    if (index < exp->nfuncs) return &exp->funcs[index];
+    index -= exp->nfuncs;
+  }
+  for (i = 0; i < p->modinfo->numimports; i++) {
+    struct prx_import *imp = &p->modinfo->imports[i];
+    if (index < imp->nfuncs) return &imp->funcs[index];
+    index -= imp->nfuncs;
+  }
+  return NULL;
+}
+
+
+static
+void clear_functions (struct prx *p)
+{
+  uint32 i, j;
+  for (i = 0; i < p->modinfo->numexports; i++)
+    for (j = 0; j < p->modinfo->exports[i].nfuncs; j++)
+      p->modinfo->exports[i].funcs[j].pfunc = NULL;
+  for (i = 0; i < p->modinfo->numimports; i++)
+    for (j = 0; j < p->modinfo->imports[i].nfuncs; j++)
+      p->modinfo->imports[i].funcs[j].pfunc = NULL;
+}
+
+
+/* The mark used to hold the index of obj while saving */
+static
+int *object_mark (enum cachetable table, void *obj)
+{
+  switch (table) {
+  case TABLE_SUBS: return &((struct subroutine *) obj)->temp;
+  case TABLE_BLOCKS: return &((struct basicblock *) obj)->mark1;
+  case TABLE_EDGES: return &((struct basicedge *) obj)->mark;
+  case TABLE_OPS: return &((struct operation *) obj)->mark;
+  case TABLE_VALUES: return &((struct value *) obj)->mark;
+  case TABLE_VARS: return &((struct ssavar *) obj)->mark;
+  case TABLE_CTRLS: return &((struct ctrlstruct *) obj)->mark;
+  case TABLE_SWITCHES: return &((struct codeswitch *) obj)->mark;
+  case NUM_TABLES: break;
+  }
+  return NULL;
+}
+
+static
+void number (struct cachewriter *w, enum cachetable table, void *obj)
+{
+  int *mark;
+
+  if (!obj) return;
+  mark = object_mark (table, obj);
+  /* The marks are not cleared beforehand, so check them against objs */
+  if (*mark > 0 && (uint32) *mark <= w->count[table] &&
+      w->objs[table][*mark - 1] == obj) return;
+
+  if (w->count[table] == w->capacity[table]) {
+    w->capacity[table] = w->capacity[table] ? 2 * w->capacity[table] : 256;
+    w->objs[table] = (void **) xrealloc (w->objs[table], w->capacity[table] * sizeof (void *));
+  }
+  w->objs[table][w->count[table]++] = obj;
+  *mark = w->count[table];
+}
+
+static
+void number_list (struct cachewriter *w, enum cachetable table, list l)
+{
+  element el;
+  if (!l) return;
+  for (el = list_head (l); el; el = element_next (el))
+    number (w, table, element_getvalue (el));
+}
+
+static
+void number_nodelist (struct cachewriter *w, list l, int rev)
+{
+  element el;
+  if (!l) return;
+  for (el = list_head (l); el; el = element_next (el))
+    number (w, TABLE_BLOCKS, NODE_BLOCK (element_getvalue (el), rev));
+}
+
+static
+void number_node (struct cachewriter *w, struct basicblocknode *node, int rev)
+{
+  if (node->dominator) number (w, TABLE_BLOCKS, NODE_BLOCK (node->dominator, rev));
+  if (node->parent) number (w, TABLE_BLOCKS, NODE_BLOCK (node->parent, rev));
+
+  number_nodelist (w, node->children, rev);
+  number_nodelist (w, node->domchildren, rev);
+  number_nodelist (w, node->frontier, rev);
+}
+
+/* Numbers every object reachable from obj */
+static
+void number_refs (struct cachewriter *w, enum cachetable table, void *obj)
+{
+  switch (table) {
+  case TABLE_SUBS: {
+      struct subroutine *sub = obj;
+      number (w, TABLE_BLOCKS, sub->startblock);
+      number (w, TABLE_BLOCKS, sub->firstblock);
+      number (w, TABLE_BLOCKS, sub->endblock);
+      number_list (w, TABLE_BLOCKS, sub->blocks);
+      number_list (w, TABLE_BLOCKS, sub->dfsblocks);
+      number_list (w, TABLE_BLOCKS, sub->revdfsblocks);
+      number_list (w, TABLE_BLOCKS, sub->whereused);
+      number_list (w, TABLE_BLOCKS, sub->callblocks);
+      number_list (w, TABLE_VARS, sub->ssavars);
+    }
+    break;
+  case TABLE_BLOCKS: {
+      struct basicblock *block = obj;
+      if (block->type == BLOCK_CALL) {
+        number (w, TABLE_SUBS, block->info.call.calltarget);
+        number (w, TABLE_BLOCKS, block->info.call.from);
+      }
+      number_list (w, TABLE_OPS, block->operations);
+      number (w, TABLE_OPS, block->jumpop);
+      number (w, TABLE_SUBS, block->sub);
+      number_node (w, &block->node, FALSE);
+      number_node (w, &block->revnode, TRUE);
+      number_list (w, TABLE_EDGES, block->inrefs);
+      number_list (w, TABLE_EDGES, block->outrefs);
+      number (w, TABLE_CTRLS, block->st);
+      number (w, TABLE_CTRLS, block->ifst);
+      number (w, TABLE_CTRLS, block->loopst);
+    }
+    break;
+  case TABLE_EDGES: {
+      struct basicedge *edge = obj;
+      number (w, TABLE_BLOCKS, edge->from);
+      number (w, TABLE_BLOCKS, edge->to);
+    }
+    break;
+  case TABLE_OPS: {
+      struct operation *op = obj;
+      number (w, TABLE_BLOCKS, op->block);
+      if (op->type == OP_CALL) {
+        number_list (w, TABLE_VALUES, op->info.callop.arguments);
+        number_list (w, TABLE_VALUES, op->info.callop.retvalues);
+      } else if (op->type == OP_END) {
+        number_list (w, TABLE_VALUES, op->info.endop.arguments);
+      }
+      number_list (w, TABLE_VALUES, op->results);
+      number_list (w, TABLE_VALUES, op->operands);
+    }
+    break;
+  case TABLE_VALUES: {
+      struct value *val = obj;
+      if (val->type == VAL_SSAVAR)
+        number (w, TABLE_VARS, val->val.variable);
+    }
+    break;
+  case TABLE_VARS: {
+      struct ssavar *var = obj;
+      if (var->name.type == VAL_SSAVAR)
+        number (w, TABLE_VARS, var->name.val.variable);
+      number (w, TABLE_OPS, var->def);
+      number_list (w, TABLE_OPS, var->uses);
+    }
+    break;
+  case TABLE_CTRLS: {
+      struct ctrlstruct *st = obj;
+      number (w, TABLE_BLOCKS, st->start);
+      number (w, TABLE_BLOCKS, st->end);
+      number (w, TABLE_CTRLS, st->parent);
+      if (st->type == CONTROL_LOOP)
+        number_list (w, TABLE_EDGES, st->info.loopctrl.edges);
+    }
+    break;
+  case TABLE_SWITCHES:
+  case NUM_TABLES:
+    break;
+  }
+}
+
+static
+void number_all (struct cachewriter *w)
+{
+  struct code *c = w->c;
+  uint32 i, done[NUM_TABLES];
+  int table, changed;
+
+  number_list (w, TABLE_SUBS, c->subroutines);
+  for (i = 0; i < c->numopc; i++) {
+    number (w, TABLE_SUBS, c->base[i].sub);
+    number (w, TABLE_BLOCKS, c->base[i].block);
+    number (w, TABLE_SWITCHES, c->base[i].cswitch);
+  }
+
+  for (table = 0; table < NUM_TABLES; table++)
+    done[table] = 0;
+
+  do {
+    changed = FALSE;
+    for (table = 0; table < NUM_TABLES; table++) {
+      while (done[table] < w->count[table]) {
+        number_refs (w, table, w->objs[table][done[table]++]);
+        changed = TRUE;
+      }
+    }
+  } while (changed);
+}
+
+
+static
+void w_uint (struct cachewriter *w, uint32 val)
+{
+  outbuf_varint (w->out, val);
+}
+
+static
+void w_int (struct cachewriter *w, int32 val)
+{
+  if (val < 0) w_uint (w, ~(((uint32) val) << 1));
+  else w_uint (w, ((uint32) val) << 1);
+}
+
+static
+void w_ref (struct cachewriter *w, enum cachetable table, void *obj)
+{
+  w_uint (w, obj ? *object_mark (table, obj) : 0);
+}
+
+static
+void w_loc (struct cachewriter *w, struct location *loc)
+{
+  w_uint (w, loc ? (loc - w->c->base) + 1 : 0);
+}
+
+static
+void w_list (struct cachewriter *w, enum cachetable table, list l)
+{
+  element el;
+
+  if (!l) {
+    w_uint (w, 0);
+    return;
+  }
+  w_uint (w, list_size (l) + 1);
+  for (el = list_head (l); el; el = element_next (el))
+    w_ref (w, table, element_getvalue (el));
+}
+
+static
+void w_loclist (struct cachewriter *w, list l)
+{
+  element el;
+
+  if (!l) {
+    w_uint (w, 0);
+    return;
+  }
+  w_uint (w, list_size (l) + 1);
+  for (el = list_head (l); el; el = element_next (el))
+    w_loc (w, element_getvalue (el));
+}
+
+static
+void w_nodelist (struct cachewriter *w, list l, int rev)
+{
+  element el;
+
+  if (!l) {
+    w_uint (w, 0);
+    return;
+  }
+  w_uint (w, list_size (l) + 1);
+  for (el = list_head (l); el; el = element_next (el))
+    w_ref (w, TABLE_BLOCKS, NODE_BLOCK (element_getvalue (el), rev));
+}
+
+static
+void w_node (struct cachewriter *w, struct basicblocknode *node, int rev)
+{
+  w_int (w, node->dfsnum);
+  w_int (w, node->domdfsnum.first);
+  w_int (w, node->domdfsnum.last);
+  w_ref (w, TABLE_BLOCKS, node->dominator ? NODE_BLOCK (node->dominator, rev) : NULL);
+  w_ref (w, TABLE_BLOCKS, node->parent ? NODE_BLOCK (node->parent, rev) : NULL);
+  w_nodelist (w, node->children, rev);
+  w_nodelist (w, node->domchildren, rev);
+  w_nodelist (w, node->frontier, rev);
+}
+
+static
+void w_value (struct cachewriter *w, struct value *val)
+{
+  w_uint (w, val->type);
+  if (val->type == VAL_SSAVAR)
+    w_ref (w, TABLE_VARS, val->val.variable);
+  else
+    w_uint (w, val->val.intval);
+}
+
+static
+void w_object (struct cachewriter *w, enum cachetable table, void *obj)
+{
+  struct prx *p = w->c->file;
+  int i;
+
+  switch (table) {
+  case TABLE_SUBS: {
+      struct subroutine *sub = obj;
+      w_uint (w, function_index (p, sub->export));
+      w_uint (w, function_index (p, sub->import));
+      w_loc (w, sub->begin);
+      w_loc (w, sub->end);
+      w_ref (w, TABLE_BLOCKS, sub->startblock);
+      w_ref (w, TABLE_BLOCKS, sub->firstblock);
+      w_ref (w, TABLE_BLOCKS, sub->endblock);
+      w_list (w, TABLE_BLOCKS, sub->blocks);
+      w_list (w, TABLE_BLOCKS, sub->dfsblocks);
+      w_list (w, TABLE_BLOCKS, sub->revdfsblocks);
+      w_list (w, TABLE_BLOCKS, sub->whereused);
+      w_list (w, TABLE_BLOCKS, sub->callblocks);
+      w_list (w, TABLE_VARS, sub->ssavars);
+      w_uint (w, sub->stacksize);
+      w_int (w, sub->numregargs);
+      w_int (w, sub->numregout);
+      w_int (w, sub->haserror);
+      w_int (w, sub->status);
+    }
+    break;
+  case TABLE_BLOCKS: {
+      struct basicblock *block = obj;
+      w_uint (w, block->type);
+      if (block->type == BLOCK_SIMPLE) {
+        w_loc (w, block->info.simple.begin);
+        w_loc (w, block->info.simple.end);
+        w_loc (w, block->info.simple.jumploc);
+      } else if (block->type == BLOCK_CALL) {
+        w_ref (w, TABLE_SUBS, block->info.call.calltarget);
+        w_ref (w, TABLE_BLOCKS, block->info.call.from);
+      }
+      for (i = 0; i < NUM_REGMASK; i++) {
+        w_uint (w, block->reg_gen[i]);
+        w_uint (w, block->reg_kill[i]);
+        w_uint (w, block->reg_live_in[i]);
+        w_uint (w, block->reg_live_out[i]);
+      }
+      w_list (w, TABLE_OPS, block->operations);
+      w_ref (w, TABLE_OPS, block->jumpop);
+      w_ref (w, TABLE_SUBS, block->sub);
+      w_node (w, &block->node, FALSE);
+      w_node (w, &block->revnode, TRUE);
+      w_list (w, TABLE_EDGES, block->inrefs);
+      w_list (w, TABLE_EDGES, block->outrefs);
+      w_ref (w, TABLE_CTRLS, block->st);
+      w_ref (w, TABLE_CTRLS, block->ifst);
+      w_ref (w, TABLE_CTRLS, block->loopst);
+      w_int (w, block->blockcond);
+      w_int (w, block->status);
+    }
+    break;
+  case TABLE_EDGES: {
+      struct basicedge *edge = obj;
+      w_uint (w, edge->type);
+      w_ref (w, TABLE_BLOCKS, edge->from);
+      w_ref (w, TABLE_BLOCKS, edge->to);
+      w_int (w, edge->fromnum);
+      w_int (w, edge->tonum);
+    }
+    break;
+  case TABLE_OPS: {
+      struct operation *op = obj;
+      w_uint (w, op->type);
+      w_ref (w, TABLE_BLOCKS, op->block);
+      if (op->type == OP_ASM) {
+        w_loc (w, op->info.asmop.begin);
+        w_loc (w, op->info.asmop.end);
+      } else if (op->type == OP_CALL) {
+        w_list (w, TABLE_VALUES, op->info.callop.arguments);
+        w_list (w, TABLE_VALUES, op->info.callop.retvalues);
+      } else if (op->type == OP_END) {
+        w_list (w, TABLE_VALUES, op->info.endop.arguments);
+      } else {
+        w_uint (w, op->info.iop.insn);
+        w_loc (w, op->info.iop.loc);
+      }
+      w_int (w, op->status);
+      w_list (w, TABLE_VALUES, op->results);
+      w_list (w, TABLE_VALUES, op->operands);
+    }
+    break;
+  case TABLE_VALUES:
+    w_value (w, obj);
+    break;
+  case TABLE_VARS: {
+      struct ssavar *var = obj;
+      w_uint (w, var->type);
+      w_int (w, var->status);
+      w_value (w, &var->name);
+      w_uint (w, var->info);
+      w_uint (w, var->value);
+      w_ref (w, TABLE_OPS, var->def);
+      w_list (w, TABLE_OPS, var->uses);
+    }
+    break;
+  case TABLE_CTRLS: {
+      struct ctrlstruct *st = obj;
+      w_uint (w, st->type);
+      w_ref (w, TABLE_BLOCKS, st->start);
+      w_ref (w, TABLE_BLOCKS, st->end);
+      w_ref (w, TABLE_CTRLS, st->parent);
+      w_int (w, st->hasendgoto);
+      w_int (w, st->endfollow);
+      w_int (w, st->identsize);
+      if (st->type == CONTROL_LOOP)
+        w_list (w, TABLE_EDGES, st->info.loopctrl.edges);
+    }
+    break;
+  case TABLE_SWITCHES: {
+      struct codeswitch *cs = obj;
+      w_uint (w, cs->jumpreloc ? (cs->jumpreloc - p->relocsbyaddr) + 1 : 0);
+      w_uint (w, cs->switchreloc ? (cs->switchreloc - p->relocsbyaddr) + 1 : 0);
+      w_loc (w, cs->location);
+      w_loc (w, cs->jumplocation);
+      w_loclist (w, cs->references);
+      w_int (w, cs->count);
+      w_int (w, cs->checked);
+    }
+    break;
+  case NUM_TABLES:
+    break;
+  }
+}
+
+int cache_save (struct code *c, const char *path, uint32 nidsversion)
+{
+  struct cachewriter w;
+  uint32 i;
+  int table, ret;
+
+  memset (&w, 0, sizeof (w));
+  w.c = c;
+  w.out = outbuf_open (path);
+  if (!w.out) {
+    xerror (__FILE__ ": can't open file for writing `%s'", path);
+    return 0;
+  }
+
+  number_all (&w);
+
+  outbuf_write (w.out, cache_magic, sizeof (cache_magic));
+  w_uint (&w, CACHE_VERSION);
+  w_uint (&w, c->file->size);
+  w_uint (&w, c->file->hash[0]);
+  w_uint (&w, c->file->hash[1]);
+  w_uint (&w, nidsversion);
+  w_uint (&w, g_subbudget);
+  w_uint (&w, g_stagebudget);
+  for (i = 0; i < c->file->modinfo->numimports; i++) {
+    struct prx_import *imp = &c->file->modinfo->imports[i];
+    uint32 j;
+    for (j = 0; j < imp->nfuncs; j++)
+      w_int (&w, imp->funcs[j].numargs);
+  }
+  w_uint (&w, c->baddr);
+  w_uint (&w, c->numopc);
+  for (table = 0; table < NUM_TABLES; table++)
+    w_uint (&w, w.count[table]);
+
+  for (table = 0; table < NUM_TABLES; table++) {
+    for (i = 0; i < w.count[table]; i++)
+      w_object (&w, table, w.objs[table][i]);
+  }
+
+  for (i = 0; i < c->numopc; i++) {
+    struct location *loc = &c->base[i];
+    w_uint (&w, loc->reachable);
+    w_ref (&w, TABLE_SUBS, loc->sub);
+    w_ref (&w, TABLE_BLOCKS, loc->block);
+    w_ref (&w, TABLE_SWITCHES, loc->cswitch);
+    w_loclist (&w, loc->references);
+  }
+  w_list (&w, TABLE_SUBS, c->subroutines);
+
+  ret = outbuf_close (w.out);
+
+  for (table = 0; table < NUM_TABLES; table++) {
+    for (i = 0; i < w.count[table]; i++)
+      *object_mark (table, w.objs[table][i]) = 0;
+    if (w.objs[table]) free (w.objs[table]);
+  }
+
+  if (!ret) remove (path);
+  return ret;
+}
+
+
+static
+uint32 r_uint (struct cachereader *r)
+{
+  uint32 val = 0;
+  int shift = 0;
+
+  while (r->pos < r->size) {
+    uint8 b = r->data[r->pos++];
+    val |= ((uint32) (b & 0x7F)) << shift;
+    if (!(b & 0x80)) return val;
+    shift += 7;
+    if (shift > 28) break;
+  }
+  r->error = TRUE;
+  return 0;
+}
+
+static
+int32 r_int (struct cachereader *r)
+{
+  uint32 val = r_uint (r);
+  if (val & 1) return (int32) ~(val >> 1);
+  return (int32) (val >> 1);
+}
+
+static
+void *r_ref (struct cachereader *r, enum cachetable table)
+{
+  uint32 index = r_uint (r);
+  if (!index) return NULL;
+  if (index > r->count[table]) {
+    r->error = TRUE;
+    return NULL;
+  }
+  return r->objs[table][index - 1];
+}
+
+static
+struct location *r_loc (struct cachereader *r)
+{
+  uint32 index = r_uint (r);
+  if (!index) return NULL;
+  if (index > r->c->numopc) {
+    r->error = TRUE;
+    return NULL;
+  }
+  return &r->c->base[index - 1];
+}
+
+static
+list r_list (struct cachereader *r, enum cachetable table)
+{
+  uint32 size = r_uint (r);
+  list l;
+
+  if (!size) return NULL;
+  l = list_alloc (r->c->lstpool);
+  while (--size && !r->error) {
+    void *obj = r_ref (r, table);
+    if (!obj) r->error = TRUE;
+    list_inserttail (l, obj);
+  }
+  return l;
+}
+
+static
+list r_loclist (struct cachereader *r)
+{
+  uint32 size = r_uint (r);
+  list l;
+
+  if (!size) return NULL;
+  l = list_alloc (r->c->lstpool);
+  while (--size && !r->error) {
+    struct location *loc = r_loc (r);
+    if (!loc) r->error = TRUE;
+    list_inserttail (l, loc);
+  }
+  return l;
+}
+
+static
+struct basicblocknode *r_nodeptr (struct cachereader *r, int rev)
+{
+  struct basicblock *block = r_ref (r, TABLE_BLOCKS);
+  if (!block) return NULL;
+  return rev ? &block->revnode : &block->node;
+}
+
+static
+list r_nodelist (struct cachereader *r, int rev)
+{
+  uint32 size = r_uint (r);
+  list l;
+
+  if (!size) return NULL;
+  l = list_alloc (r->c->lstpool);
+  while (--size && !r->error) {
+    struct basicblocknode *node = r_nodeptr (r, rev);
+    if (!node) r->error = TRUE;
+    list_inserttail (l, node);
+  }
+  return l;
+}
+
+static
+void r_node (struct cachereader *r, struct basicblocknode *node, int rev)
+{
+  node->dfsnum = r_int (r);
+  node->domdfsnum.first = r_int (r);
+  node->domdfsnum.last = r_int (r);
+  node->dominator = r_nodeptr (r, rev);
+  node->parent = r_nodeptr (r, rev);
+  node->children = r_nodelist (r, rev);
+  node->domchildren = r_nodelist (r, rev);
+  node->frontier = r_nodelist (r, rev);
+}
+
+static
+void r_value (struct cachereader *r, struct value *val)
+{
+  val->type = r_uint (r);
+  if (val->type == VAL_SSAVAR)
+    val->val.variable = r_ref (r, TABLE_VARS);
+  else
+    val->val.intval = r_uint (r);
+}
+
+static
+void r_object (struct cachereader *r, enum cachetable table, void *obj)
+{
+  struct prx *p = r->c->file;
+  element el;
+  uint32 index;
+  int i;
+
+  switch (table) {
+  case TABLE_SUBS: {
+      struct subroutine *sub = obj;
+      sub->code = r->c;
+      sub->export = function_at (p, r_uint (r));
+      sub->import = function_at (p, r_uint (r));
+      sub->begin = r_loc (r);
+      sub->end = r_loc (r);
+      sub->startblock = r_ref (r, TABLE_BLOCKS);
+      sub->firstblock = r_ref (r, TABLE_BLOCKS);
+      sub->endblock = r_ref (r, TABLE_BLOCKS);
+      sub->blocks = r_list (r, TABLE_BLOCKS);
+      sub->dfsblocks = r_list (r, TABLE_BLOCKS);
+      sub->revdfsblocks = r_list (r, TABLE_BLOCKS);
+      sub->whereused = r_list (r, TABLE_BLOCKS);
+      sub->callblocks = r_list (r, TABLE_BLOCKS);
+      sub->ssavars = r_list (r, TABLE_VARS);
+      sub->stacksize = r_uint (r);
+      sub->numregargs = r_int (r);
+      sub->numregout = r_int (r);
+      sub->haserror = r_int (r);
+      sub->status = r_int (r);
+      if (r->error || !sub->begin || !sub->end) {
+        r->error = TRUE;
+        break;
+      }
+
+      if (sub->export) sub->export->pfunc = sub;
+      if (sub->import) sub->import->pfunc = sub;
+
+      for (el = sub->blocks ? list_head (sub->blocks) : NULL; el; el = element_next (el)) {
+        struct basicblock *block = element_getvalue (el);
+        block->blockel = el;
+      }
+      for (el = sub->dfsblocks ? list_head (sub->dfsblocks) : NULL; el; el = element_next (el)) {
+        struct basicblock *block = element_getvalue (el);
+        block->node.blockel = el;
+      }
+      for (el = sub->revdfsblocks ? list_head (sub->revdfsblocks) : NULL; el; el = element_next (el)) {
+        struct basicblock *block = element_getvalue (el);
+        block->revnode.blockel = el;
+      }
+    }
+    break;
+  case TABLE_BLOCKS: {
+      struct basicblock *block = obj;
+      block->type = r_uint (r);
+      if (block->type == BLOCK_SIMPLE) {
+        block->info.simple.begin = r_loc (r);
+        block->info.simple.end = r_loc (r);
+        block->info.simple.jumploc = r_loc (r);
+      } else if (block->type == BLOCK_CALL) {
+        block->info.call.calltarget = r_ref (r, TABLE_SUBS);
+        block->info.call.from = r_ref (r, TABLE_BLOCKS);
+      }
+      for (i = 0; i < NUM_REGMASK; i++) {
+        block->reg_gen[i] = r_uint (r);
+        block->reg_kill[i] = r_uint (r);
+        block->reg_live_in[i] = r_uint (r);
+        block->reg_live_out[i] = r_uint (r);
+      }
+      block->operations = r_list (r, TABLE_OPS);
+      block->jumpop = r_ref (r, TABLE_OPS);
+      block->sub = r_ref (r, TABLE_SUBS);
+      r_node (r, &block->node, FALSE);
+      r_node (r, &block->revnode, TRUE);
+      block->inrefs = r_list (r, TABLE_EDGES);
+      block->outrefs = r_list (r, TABLE_EDGES);
+      block->st = r_ref (r, TABLE_CTRLS);
+      block->ifst = r_ref (r, TABLE_CTRLS);
+      block->loopst = r_ref (r, TABLE_CTRLS);
+      block->blockcond = r_int (r);
+      block->status = r_int (r);
+      if (r->error) break;
+
+      for (el = block->inrefs ? list_head (block->inrefs) : NULL; el; el = element_next (el)) {
+        struct basicedge *edge = element_getvalue (el);
+        edge->toel = el;
+      }
+      for (el = block->outrefs ? list_head (block->outrefs) : NULL; el; el = element_next (el)) {
+        struct basicedge *edge = element_getvalue (el);
+        edge->fromel = el;
+      }
+    }
+    break;
+  case TABLE_EDGES: {
+      struct basicedge *edge = obj;
+      edge->type = r_uint (r);
+      edge->from = r_ref (r, TABLE_BLOCKS);
+      edge->to = r_ref (r, TABLE_BLOCKS);
+      edge->fromnum = r_int (r);
+      edge->tonum = r_int (r);
+    }
+    break;
+  case TABLE_OPS: {
+      struct operation *op = obj;
+      op->type = r_uint (r);
+      op->block = r_ref (r, TABLE_BLOCKS);
+      if (op->type == OP_ASM) {
+        op->info.asmop.begin = r_loc (r);
+        op->info.asmop.end = r_loc (r);
+      } else if (op->type == OP_CALL) {
+        op->info.callop.arguments = r_list (r, TABLE_VALUES);
+        op->info.callop.retvalues = r_list (r, TABLE_VALUES);
+      } else if (op->type == OP_END) {
+        op->info.endop.arguments = r_list (r, TABLE_VALUES);
+      } else {
+        op->info.iop.insn = r_uint (r);
+        op->info.iop.loc = r_loc (r);
+      }
+      op->status = r_int (r);
+      op->results = r_list (r, TABLE_VALUES);
+      op->operands = r_list (r, TABLE_VALUES);
+    }
+    break;
+  case TABLE_VALUES:
+    r_value (r, obj);
+    break;
+  case TABLE_VARS: {
+      struct ssavar *var = obj;
+      var->type = r_uint (r);
+      var->status = r_int (r);
+      r_value (r, &var->name);
+      var->info = r_uint (r);
+      var->value = r_uint (r);
+      var->def = r_ref (r, TABLE_OPS);
+      var->uses = r_list (r, TABLE_OPS);
+    }
+    break;
+  case TABLE_CTRLS: {
+      struct ctrlstruct *st = obj;
+      st->type = r_uint (r);
+      st->start = r_ref (r, TABLE_BLOCKS);
+      st->end = r_ref (r, TABLE_BLOCKS);
+      st->parent = r_ref (r, TABLE_CTRLS);
+      st->hasendgoto = r_int (r);
+      st->endfollow = r_int (r);
+      st->identsize = r_int (r);
+      if (st->type == CONTROL_LOOP)
+        st->info.loopctrl.edges = r_list (r, TABLE_EDGES);
+    }
+    break;
+  case TABLE_SWITCHES: {
+      struct codeswitch *cs = obj;
+      index = r_uint (r);
+      if (index > p->relocnum) r->error = TRUE;
+      else if (index) cs->jumpreloc = &p->relocsbyaddr[index - 1];
+      index = r_uint (r);
+      if (index > p->relocnum) r->error = TRUE;
+      else if (index) cs->switchreloc = &p->relocsbyaddr[index - 1];
+      cs->location = r_loc (r);
+      cs->jumplocation = r_loc (r);
+      cs->references = r_loclist (r);
+      cs->count = r_int (r);
+      cs->checked = r_int (r);
+    }
+    break;
+  case NUM_TABLES:
+    break;
+  }
+}
+
+static
+void *read_cache (const char *path, size_t *size)
+{
+  FILE *fp;
+  void *buffer;
+  long len;
+
+  /* A missing cache is not an error */
+  fp = fopen (path, "rb");
+  if (!fp) return NULL;
+
+  if (fseek (fp, 0, SEEK_END) != 0 || (len = ftell (fp)) < 0) {
+    fclose (fp);
+    return NULL;
+  }
+  rewind (fp);
+
+  buffer = xmalloc (len + 1);
+  if (fread (buffer, 1, len, fp) != (size_t) len) {
+    error (__FILE__ ": can't fully read file `%s'", path);
+    free (buffer);
+    fclose (fp);
+    return NULL;
+  }
+  fclose (fp);
+
+  *size = len;
+  return buffer;
+}
+
+static
+uint32 count_imports (struct prx *p)
+{
+  uint32 i, count = 0;
+  for (i = 0; i < p->modinfo->numimports; i++)
+    count += p->modinfo->imports[i].nfuncs;
+  return count;
+}
+
+static
+int check_header (struct cachereader *r, struct prx *p)
+{
+  uint32 i, count;
+
+  if (r->size < sizeof (cache_magic)) return FALSE;
+  if (memcmp (r->data, cache_magic, sizeof (cache_magic)) != 0) return FALSE;
+  r->pos = sizeof (cache_magic);
+
+  if (r_uint (r) != CACHE_VERSION) return FALSE;
+  if (r_uint (r) != p->size) return FALSE;
+  if (r_uint (r) != p->hash[0]) return FALSE;
+  if (r_uint (r) != p->hash[1]) return FALSE;
+  r->nidsversion = r_uint (r);
+  /* The subroutines over budget depend on the budgets */
+  if (r_uint (r) != g_subbudget) return FALSE;
+  if (r_uint (r) != g_stagebudget) return FALSE;
+
+  count = count_imports (p);
+  r->numargs = (int *) xmalloc ((count + 1) * sizeof (int));
+  for (i = 0; i < count; i++)
+    r->numargs[i] = r_int (r);
+  return !r->error;
+}
+
+static
+void update_imports (struct cachereader *r, struct prx *p)
+{
+  uint32 i, j, index = 0;
+  list imports = list_alloc (r->c->lstpool);
+
+  for (i = 0; i < p->modinfo->numimports; i++) {
+    struct prx_import *imp = &p->modinfo->imports[i];
+    for (j = 0; j < imp->nfuncs; j++, index++) {
+      struct prx_function *func = &imp->funcs[j];
+      if (func->numargs != r->numargs[index] && func->pfunc)
+        list_inserttail (imports, func->pfunc);
+    }
+  }
+
+  if (list_size (imports) != 0)
+    code_update_imports (r->c, imports);
+  list_free (imports);
+}
+
+struct code *cache_load (struct prx *p, const char *path, uint32 nidsversion, int *outdated)
+{
+  struct cachereader r;
+  struct code *c;
+  fixedpool pools[NUM_TABLES];
+  uint32 i;
+  int table;
+
+  memset (&r, 0, sizeof (r));
+  r.data = read_cache (path, &r.size);
+  if (!r.data) return NULL;
+
+  if (!check_header (&r, p)) {
+    if (r.numargs) free (r.numargs);
+    free ((void *) r.data);
+    return NULL;
+  }
+
+  c = code_alloc ();
+  c->file = p;
+  r.c = c;
+  if (!decode_instructions (c)) {
+    free (r.numargs);
+    free ((void *) r.data);
+    code_free (c);
+    return NULL;
+  }
+  prx_resolve_all_relocs (p);
+
+  if (r_uint (&r) != c->baddr || r_uint (&r) != c->numopc)
+    r.error = TRUE;
+
+  pools[TABLE_SUBS] = c->subspool;
+  pools[TABLE_BLOCKS] = c->blockspool;
+  pools[TABLE_EDGES] = c->edgespool;
+  pools[TABLE_OPS] = c->opspool;
+  pools[TABLE_VALUES] = c->valspool;
+  pools[TABLE_VARS] = c->ssavarspool;
+  pools[TABLE_CTRLS] = c->ctrlspool;
+  pools[TABLE_SWITCHES] = c->switchpool;
+
+  for (table = 0; table < NUM_TABLES; table++) {
+    r.count[table] = r_uint (&r);
+    /* Every object takes at least one byte */
+    if (r.count[table] > r.size) r.error = TRUE;
+  }
+
+  for (table = 0; table < NUM_TABLES && !r.error; table++) {
+    r.objs[table] = (void **) xmalloc ((r.count[table] + 1) * sizeof (void *));
+    for (i = 0; i < r.count[table]; i++)
+      r.objs[table][i] = fixedpool_alloc (pools[table]);
+  }
+
+  for (table = 0; table < NUM_TABLES && !r.error; table++) {
+    for (i = 0; i < r.count[table] && !r.error; i++)
+      r_object (&r, table, r.objs[table][i]);
+  }
+
+  for (i = 0; i < c->numopc && !r.error; i++) {
+    struct location *loc = &c->base[i];
+    loc->reachable = r_uint (&r);
+    loc->sub = r_ref (&r, TABLE_SUBS);
+    loc->block = r_ref (&r, TABLE_BLOCKS);
+    loc->cswitch = r_ref (&r, TABLE_SWITCHES);
+    loc->references = r_loclist (&r);
+  }
+  if (!r.error)
+    c->subroutines = r_list (&r, TABLE_SUBS);
+
+  if (r.pos != r.size || !c->subroutines) r.error = TRUE;
+
+  for (table = 0; table < NUM_TABLES; table++)
+    if (r.objs[table]) free (r.objs[table]);
+  free ((void *) r.data);
+
+  if (r.error) {
+    error (__FILE__ ": invalid cache file `%s'", path);
+    free (r.numargs);
+    clear_functions (p);
+    code_free (c);
+    return NULL;
+  }
+
+  *outdated = (r.nidsversion != nidsversion);
+  if (*outdated) update_imports (&r, p);
+  free (r.numargs);
+
+  /* Cheaper to find again than to store */
+  build_xrefs (c);
+  return c;
+}
@@ -0,0 +1,15 @@
+/**
+ * Author: Humberto Naves (hsnaves@gmail.com)
+ */
+
+#ifndef __CACHE_H
+#define __CACHE_H
+
+#include "code.h"
+
+#define CACHE_VERSION 4
+
+int cache_save (struct code *c, const char *path, uint32 nidsversion);
+struct code *cache_load (struct prx *p, const char *path, uint32 nidsversion, int *outdated);
+
+#endif /* __CACHE_H */
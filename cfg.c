@@ -14,11 +14,8 @@ struct basicblock *alloc_block (struct subroutine *sub, int insert)
   block->inrefs = list_alloc (sub->code->lstpool);
   block->outrefs = list_alloc (sub->code->lstpool);
   block->node.children = list_alloc (sub->code->lstpool);
-  block->revnode.children = list_alloc (sub->code->lstpool);
   block->node.domchildren = list_alloc (sub->code->lstpool);
-  block->revnode.domchildren = list_alloc (sub->code->lstpool);
   block->node.frontier = list_alloc (sub->code->lstpool);
-  block->revnode.frontier = list_alloc (sub->code->lstpool);
   block->sub = sub;
   if (insert) {
     block->blockel = list_inserttail (sub->blocks, block);
@@ -37,7 +34,6 @@ void extract_blocks (struct subroutine *sub)
   int prevlikely = FALSE;
 
   sub->blocks = list_alloc (sub->code->lstpool);
-  sub->revdfsblocks = list_alloc (sub->code->lstpool);
   sub->dfsblocks = list_alloc (sub->code->lstpool);
 
   block = alloc_block (sub, TRUE);
@@ -31,6 +31,8 @@
 #define SUB_STAT_CONSTANTS_EXTRACTED     256
 #define SUB_STAT_VARIABLES_EXTRACTED     512
 #define SUB_STAT_STRUCTURES_EXTRACTED   1024
+#define SUB_STAT_CFG_REVERSE            2048
+#define SUB_STAT_CFG_REVFRONTIER        4096
 
 /* Operation status */
 #define OP_STAT_DEFERRED            1
@@ -150,6 +152,7 @@ struct codeswitch {
   list   references;                /* A list of possible target locations (without repeating) */
   int    count;                     /* How many possible targets this switch have */
   int    checked;                   /* Is this switch valid? */
+  int    mark;
 };
 
 /* A subroutine */
@@ -176,6 +179,8 @@ struct subroutine {
 
   int    haserror, status;          /* Subroutine decompilation status */
   int    temp;
+
+  uint32 work, stagework;           /* Work units spent in the analysis */
 };
 
 /* Represents a pair of integers */
@@ -254,6 +259,7 @@ enum edgetype {
 
 struct basicedge {
   enum edgetype type;
+  int mark;
   struct basicblock *from, *to;
   element fromel, toel;
   int fromnum, tonum;
@@ -267,6 +273,7 @@ enum valuetype {
 
 struct value {
   enum valuetype type;
+  int mark;
   union {
     uint32 intval;
     struct ssavar *variable;
@@ -307,6 +314,7 @@ enum operationtype {
 
 struct operation {
   enum operationtype type;
+  int mark;
   struct basicblock *block;
 
   union {
@@ -347,6 +355,7 @@ enum looptype {
 
 struct ctrlstruct {
   enum ctrltype type;
+  int    mark;
   struct basicblock *start;
   struct basicblock *end;
   struct ctrlstruct *parent;
@@ -362,6 +371,23 @@ struct ctrlstruct {
 };
 
 
+/* A reference from the code of a subroutine */
+struct xref {
+  uint32 from;                      /* The start of the subroutine */
+  uint32 to;                        /* The callee or the referenced address */
+  uint32 site;                      /* The address of the instruction */
+};
+
+/* The cross references of the code, each sorted by the referencing
+ * subroutine and by the referenced address */
+struct xrefs {
+  struct xref *calls;               /* Caller to callee */
+  struct xref *callers;             /* Callee to caller */
+  struct xref *datarefs;            /* Code to data */
+  struct xref *datausers;           /* Data to code */
+  uint32 numcalls, numdatarefs;
+};
+
 /* Represents the entire PRX code */
 struct code {
   struct prx *file;        /* The PRX file */
@@ -371,6 +397,8 @@ struct code {
   struct location *end;    /* The code segment end */
 
   list subroutines;        /* The list of subroutines */
+  struct subroutine *function;  /* The only subroutine analysed in full (or NULL) */
+  struct xrefs xrefs;      /* The calls and data references */
 
   listpool  lstpool;
   fixedpool switchpool;
@@ -384,8 +412,18 @@ struct code {
 };
 
 
+/* Analysis budgets, in work units (0 means unlimited) */
+extern uint32 g_subbudget;
+extern uint32 g_stagebudget;
+
+struct code *code_alloc (void);
 struct code* code_analyse (struct prx *p);
+struct code* code_analyse_function (struct prx *p, const char *function);
+void code_update_imports (struct code *c, list imports);
+struct subroutine *code_find_function (struct code *c, const char *function);
+struct subroutine *code_find_import (struct code *c, const char *name);
 void code_free (struct code *c);
+int budget_spend (struct subroutine *sub, uint32 units);
 
 int decode_instructions (struct code *c);
 uint32 location_gpr_used (struct location *loc);
@@ -393,10 +431,14 @@ uint32 location_gpr_defined (struct location *loc);
 int location_branch_may_swap (struct location *branch);
 
 void extract_switches (struct code *c);
+void find_subroutines (struct code *c);
+void extract_subroutine (struct subroutine *sub);
 void extract_subroutines (struct code *c);
 
 void extract_cfg (struct subroutine *sub);
 void cfg_traverse (struct subroutine *sub, int reverse);
+void cfg_reverse (struct subroutine *sub, int frontier);
+void cfg_reverse_free (struct subroutine *sub);
 int dom_isancestor (struct basicblocknode *ancestor, struct basicblocknode *node);
 struct basicblocknode *dom_common (struct basicblocknode *n1, struct basicblocknode *n2);
 
@@ -422,4 +464,8 @@ void extract_variables (struct subroutine *sub);
 void reset_marks (struct subroutine *sub);
 void extract_structures (struct subroutine *sub);
 
+void build_xrefs (struct code *c);
+void free_xrefs (struct code *c);
+struct xref *xrefs_find (struct xref *refs, uint32 num, uint32 key, int bytarget, uint32 *count);
+
 #endif /* __CODE_H */
@@ -73,6 +73,10 @@ void propagate_constants (struct subroutine *sub)
     struct operation *op;
     element opel;
 
+    if (!budget_spend (sub, 1 + list_size (var->uses))) {
+      list_free (worklist);
+      return;
+    }
     var->mark = 0;
     op = var->def;
     op->status &= ~OP_STAT_CONSTANT;
@@ -99,6 +99,7 @@ void extract_variables (struct subroutine *sub)
   element varel;
   int count = 0;
 
+  if (!budget_spend (sub, list_size (sub->ssavars))) return;
   check_special_regs (sub);
 
   varel = list_head (sub->ssavars);
@@ -5,35 +5,23 @@
 #include <string.h>
 
 #include "code.h"
+#include "threads.h"
 #include "utils.h"
 
-int decode_instructions (struct code *c)
+#define DECODE_CHUNK_SIZE 16384
+
+/* Decodes the opcodes from first to last (exclusive). The delay slot
+ * state is not carried into the range, the errors that depend on the
+ * opcode before first are fixed by decode_instructions */
+static
+void decode_range (struct code *c, uint32 first, uint32 last)
 {
-  struct location *base;
-  uint32 i, numopc, size, address;
-  const uint8 *code;
+  struct location *base = c->base;
+  const uint8 *code = c->file->programs->data;
+  uint32 i, numopc = c->numopc, address = c->baddr;
   int slot = FALSE;
 
-  address = c->file->programs->vaddr;
-  size = c->file->modinfo->expvaddr - 4;
-  code = c->file->programs->data;
-
-  numopc = size >> 2;
-
-  if ((size & 0x03) || (address & 0x03)) {
-    error (__FILE__ ": size/address is not multiple of 4");
-    return 0;
-  }
-
-  base = (struct location *) xmalloc ((numopc) * sizeof (struct location));
-  memset (base, 0, (numopc) * sizeof (struct location));
-
-  c->base = base;
-  c->end = &base[numopc - 1];
-  c->baddr = address;
-  c->numopc = numopc;
-
-  for (i = 0; i < numopc; i++) {
+  for (i = first; i < last; i++) {
     struct location *loc = &base[i];
     uint32 tgt;
 
@@ -113,9 +101,61 @@ int decode_instructions (struct code *c)
       }
     }
   }
+}
+
+static
+void decode_chunk (void *arg, uint32 index)
+{
+  struct code *c = arg;
+  uint32 first = index * DECODE_CHUNK_SIZE;
+  decode_range (c, first, MIN (first + DECODE_CHUNK_SIZE, c->numopc));
+}
+
+static
+int is_branch_or_jump (struct location *loc)
+{
+  return loc->insn && (loc->insn->flags & (INSN_BRANCH | INSN_JUMP));
+}
+
+/* The chunks are decoded in parallel, then the delay slot errors at the
+ * seams between them are fixed in the order a sequential decoding would
+ * have set them */
+int decode_instructions (struct code *c)
+{
+  struct location *base;
+  uint32 i, numopc, size, address, numchunks;
+
+  address = c->file->programs->vaddr;
+  size = c->file->modinfo->expvaddr - 4;
+
+  numopc = size >> 2;
+
+  if ((size & 0x03) || (address & 0x03)) {
+    error (__FILE__ ": size/address is not multiple of 4");
+    return 0;
+  }
+
+  base = (struct location *) xmalloc ((numopc) * sizeof (struct location));
+  memset (base, 0, (numopc) * sizeof (struct location));
+
+  c->base = base;
+  c->end = &base[numopc - 1];
+  c->baddr = address;
+  c->numopc = numopc;
+
+  prx_resolve_relocs (c->file, address, size);
+
+  numchunks = (numopc + DECODE_CHUNK_SIZE - 1) / DECODE_CHUNK_SIZE;
+  parallel_for (numchunks, &decode_chunk, c);
+
+  for (i = 1; i < numchunks; i++) {
+    uint32 first = i * DECODE_CHUNK_SIZE;
+    if (is_branch_or_jump (&base[first]) && is_branch_or_jump (&base[first - 1]))
+      base[first - 1].error = ERROR_DELAY_SLOT;
+  }
 
-  if (slot) {
-    c->base[i - 1].error = ERROR_TARGET_OUTSIDE_FILE;
+  if (numopc > 0 && is_branch_or_jump (&base[numopc - 1])) {
+    base[numopc - 1].error = ERROR_TARGET_OUTSIDE_FILE;
   }
 
   return 1;
@@ -2,6 +2,9 @@
  * Author: Humberto Naves (hsnaves@gmail.com)
  */
 
+#include <stdlib.h>
+#include <string.h>
+
 #include "code.h"
 #include "utils.h"
 
@@ -116,6 +119,7 @@ void cfg_dominance (struct subroutine *sub, int reverse)
   }
 
   while (changed) {
+    if (!budget_spend (sub, list_size (blocks))) return;
     changed = FALSE;
     el = list_head (blocks);
     el = element_next (el);
@@ -206,6 +210,7 @@ void cfg_frontier (struct subroutine *sub, int reverse)
         while (runner != blocknode->dominator) {
           list_inserttail (runner->frontier, blocknode);
           runner = runner->dominator;
+          if (!budget_spend (sub, 1)) return;
         }
         ref = element_next (ref);
       }
@@ -214,6 +219,47 @@ void cfg_frontier (struct subroutine *sub, int reverse)
   }
 }
 
+/* Checks that the end block is reachable from every block, walking the
+ * edges backwards, without building the reverse trees */
+static
+int cfg_reaches_end (struct subroutine *sub)
+{
+  struct basicblock **stack;
+  int top = 0, count = 0;
+  element el;
+
+  el = list_head (sub->blocks);
+  while (el) {
+    struct basicblock *block = element_getvalue (el);
+    block->mark1 = 0;
+    el = element_next (el);
+  }
+
+  stack = (struct basicblock **) xmalloc (list_size (sub->blocks) * sizeof (struct basicblock *));
+  stack[top++] = sub->endblock;
+  sub->endblock->mark1 = 1;
+
+  while (top) {
+    struct basicblock *block = stack[--top];
+    count++;
+    el = list_head (block->inrefs);
+    while (el) {
+      struct basicedge *edge = element_getvalue (el);
+      if (!edge->from->mark1) {
+        edge->from->mark1 = 1;
+        stack[top++] = edge->from;
+      }
+      el = element_next (el);
+    }
+  }
+
+  free (stack);
+  return (count == list_size (sub->blocks));
+}
+
+/* The forward traversal builds the DFS and dominator trees and the
+ * frontier. The reverse traversal only checks that the subroutine can
+ * finish, as the reverse trees are built by cfg_reverse when needed */
 void cfg_traverse (struct subroutine *sub, int reverse)
 {
   if (!reverse) {
@@ -222,14 +268,71 @@ void cfg_traverse (struct subroutine *sub, int reverse)
       sub->haserror = TRUE;
       return;
     }
+    cfg_dominance (sub, FALSE);
+    if (!sub->haserror)
+      cfg_frontier (sub, FALSE);
   } else {
+    if (!cfg_reaches_end (sub)) {
+      error (__FILE__ ": infinite loop at subroutine 0x%08X", sub->begin->address);
+      sub->haserror = TRUE;
+    }
+  }
+}
+
+/* Builds the reverse DFS and dominator (post dominator) trees, and the
+ * reverse frontier when asked, allocating their lists on first use */
+void cfg_reverse (struct subroutine *sub, int frontier)
+{
+  element el;
+
+  if (!(sub->status & SUB_STAT_CFG_REVERSE)) {
+    sub->revdfsblocks = list_alloc (sub->code->lstpool);
+    el = list_head (sub->blocks);
+    while (el) {
+      struct basicblock *block = element_getvalue (el);
+      block->revnode.children = list_alloc (sub->code->lstpool);
+      block->revnode.domchildren = list_alloc (sub->code->lstpool);
+      el = element_next (el);
+    }
+
     if (!cfg_dfs (sub, TRUE)) {
       error (__FILE__ ": infinite loop at subroutine 0x%08X", sub->begin->address);
       sub->haserror = TRUE;
-      return;
     }
+    if (!sub->haserror)
+      cfg_dominance (sub, TRUE);
+    sub->status |= SUB_STAT_CFG_REVERSE;
+  }
+
+  if (frontier && !sub->haserror && !(sub->status & SUB_STAT_CFG_REVFRONTIER)) {
+    el = list_head (sub->blocks);
+    while (el) {
+      struct basicblock *block = element_getvalue (el);
+      block->revnode.frontier = list_alloc (sub->code->lstpool);
+      el = element_next (el);
+    }
+    cfg_frontier (sub, TRUE);
+    sub->status |= SUB_STAT_CFG_REVFRONTIER;
   }
+}
 
-  cfg_dominance (sub, reverse);
-  cfg_frontier (sub, reverse);
+/* Releases the reverse trees, that can be built again later */
+void cfg_reverse_free (struct subroutine *sub)
+{
+  element el;
+
+  if (!(sub->status & SUB_STAT_CFG_REVERSE)) return;
+
+  el = list_head (sub->blocks);
+  while (el) {
+    struct basicblock *block = element_getvalue (el);
+    if (block->revnode.children) list_free (block->revnode.children);
+    if (block->revnode.domchildren) list_free (block->revnode.domchildren);
+    if (block->revnode.frontier) list_free (block->revnode.frontier);
+    memset (&block->revnode, 0, sizeof (struct basicblocknode));
+    el = element_next (el);
+  }
+  list_free (sub->revdfsblocks);
+  sub->revdfsblocks = NULL;
+  sub->status &= ~(SUB_STAT_CFG_REVERSE | SUB_STAT_CFG_REVFRONTIER);
 }
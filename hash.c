@@ -292,6 +292,19 @@ unsigned int hashtable_hash_bytes (unsigned char *key, size_t len)
   return hash;
 }
 
+unsigned int hashtable_hash_fnv (unsigned char *key, size_t len)
+{
+  unsigned int hash = 2166136261U;
+  size_t i;
+
+  for (i = 0; i < len; i++) {
+    hash ^= key[i];
+    hash *= 16777619U;
+  }
+
+  return hash;
+}
+
 unsigned int hashtable_hash_string (void *key)
 {
   unsigned int hash = 0;
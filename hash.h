@@ -40,6 +40,7 @@ int hashtable_string_compare (void *key1, void *key2, unsigned int hash);
 int hashtable_pointer_compare (void *key1, void *key2, unsigned int hash);
 
 unsigned int hashtable_hash_bytes (unsigned char *key, size_t len);
+unsigned int hashtable_hash_fnv (unsigned char *key, size_t len);
 unsigned int hashtable_hash_string (void *key);
 
 #endif /* __HASH_H */
@@ -0,0 +1,200 @@
+/**
+ * Author: Humberto Naves (hsnaves@gmail.com)
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "intern.h"
+#include "hash.h"
+#include "utils.h"
+#include "types.h"
+
+/* The interned strings live for the whole process, so that the names of
+ * the libraries and nids are stored once and can be compared by pointer.
+ * The table is open addressed and only grows. Readers don't take the
+ * lock: a slot is only filled after its string is complete, and the old
+ * tables are kept until intern_free, so a reader racing with a writer
+ * either finds the string or falls back to the locked path. */
+
+#if defined (__GNUC__)
+#define WRITE_BARRIER() __sync_synchronize ()
+#else
+#define WRITE_BARRIER()
+#endif
+
+#define INITIAL_SIZE 1024
+#define CHUNK_SIZE   65536
+
+struct internstr {
+  unsigned int hash;
+  size_t len;
+  char str[1];
+};
+
+struct interntable {
+  unsigned int size, count;
+  struct internstr *volatile *slots;
+  struct interntable *prev;
+};
+
+struct internchunk {
+  struct internchunk *next;
+  size_t used, size;
+};
+
+static struct interntable *volatile g_table = NULL;
+static struct internchunk *g_chunks = NULL;
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#define STR_OFFSET (offsetof (struct internstr, str))
+#define CHUNK_HEADER \
+  ((sizeof (struct internchunk) + sizeof (double) - 1) & ~(sizeof (double) - 1))
+
+static
+struct internstr *lookup (struct interntable *table, const char *str, size_t len, unsigned int hash)
+{
+  unsigned int index;
+  struct internstr *s;
+
+  if (!table) return NULL;
+  index = hash & (table->size - 1);
+  while ((s = table->slots[index]) != NULL) {
+    if (s->hash == hash && s->len == len && memcmp (s->str, str, len) == 0)
+      return s;
+    index = (index + 1) & (table->size - 1);
+  }
+  return NULL;
+}
+
+static
+struct interntable *alloc_table (unsigned int size)
+{
+  struct interntable *table = (struct interntable *) xmalloc (sizeof (struct interntable));
+  table->size = size;
+  table->count = 0;
+  table->slots = (struct internstr *volatile *) xmalloc (size * sizeof (struct internstr *));
+  memset ((void *) table->slots, 0, size * sizeof (struct internstr *));
+  table->prev = NULL;
+  return table;
+}
+
+static
+void insert (struct interntable *table, struct internstr *s)
+{
+  unsigned int index = s->hash & (table->size - 1);
+  while (table->slots[index])
+    index = (index + 1) & (table->size - 1);
+  table->slots[index] = s;
+  table->count++;
+}
+
+static
+struct internstr *alloc_string (const char *str, size_t len, unsigned int hash)
+{
+  struct internstr *s;
+  size_t size = (STR_OFFSET + len + 1 + sizeof (double) - 1) & ~(sizeof (double) - 1);
+
+  if (!g_chunks || g_chunks->used + size > g_chunks->size) {
+    size_t chunksize = MAX (CHUNK_SIZE, CHUNK_HEADER + size);
+    struct internchunk *chunk = (struct internchunk *) xmalloc (chunksize);
+    chunk->next = g_chunks;
+    chunk->used = CHUNK_HEADER;
+    chunk->size = chunksize;
+    g_chunks = chunk;
+  }
+
+  s = (struct internstr *) ((char *) g_chunks + g_chunks->used);
+  g_chunks->used += size;
+  s->hash = hash;
+  s->len = len;
+  memcpy (s->str, str, len);
+  s->str[len] = '\0';
+  return s;
+}
+
+/* Must be called with the lock held */
+static
+void grow_table (void)
+{
+  struct interntable *old = g_table, *table;
+  unsigned int i;
+
+  table = alloc_table (old ? 2 * old->size : INITIAL_SIZE);
+  if (old) {
+    for (i = 0; i < old->size; i++)
+      if (old->slots[i]) insert (table, old->slots[i]);
+  }
+  table->prev = old;
+
+  WRITE_BARRIER ();
+  g_table = table;
+}
+
+const char *intern_stringn (const char *str, size_t len)
+{
+  unsigned int hash = hashtable_hash_bytes ((unsigned char *) str, len);
+  struct internstr *s;
+
+  s = lookup (g_table, str, len, hash);
+  if (s) return s->str;
+
+  pthread_mutex_lock (&g_lock);
+  s = lookup (g_table, str, len, hash);
+  if (!s) {
+    if (!g_table || 2 * (g_table->count + 1) > g_table->size)
+      grow_table ();
+
+    s = alloc_string (str, len, hash);
+    WRITE_BARRIER ();
+    insert (g_table, s);
+  }
+  pthread_mutex_unlock (&g_lock);
+
+  return s->str;
+}
+
+const char *intern_string (const char *str)
+{
+  return intern_stringn (str, strlen (str));
+}
+
+/* Returns the interned copy of str, or NULL if str was never interned */
+const char *intern_find (const char *str)
+{
+  size_t len = strlen (str);
+  struct internstr *s;
+
+  s = lookup (g_table, str, len, hashtable_hash_bytes ((unsigned char *) str, len));
+  return s ? s->str : NULL;
+}
+
+/* The hash of an interned string, equal to hashtable_hash_string */
+unsigned int intern_hash (void *str)
+{
+  return ((struct internstr *) ((char *) str - STR_OFFSET))->hash;
+}
+
+void intern_free (void)
+{
+  struct interntable *table, *prev;
+  struct internchunk *chunk, *next;
+
+  pthread_mutex_lock (&g_lock);
+  for (table = g_table; table; table = prev) {
+    prev = table->prev;
+    free ((void *) table->slots);
+    free (table);
+  }
+  g_table = NULL;
+
+  for (chunk = g_chunks; chunk; chunk = next) {
+    next = chunk->next;
+    free (chunk);
+  }
+  g_chunks = NULL;
+  pthread_mutex_unlock (&g_lock);
+}
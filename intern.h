@@ -0,0 +1,16 @@
+/**
+ * Author: Humberto Naves (hsnaves@gmail.com)
+ */
+
+#ifndef __INTERN_H
+#define __INTERN_H
+
+#include <stddef.h>
+
+const char *intern_string (const char *str);
+const char *intern_stringn (const char *str, size_t len);
+const char *intern_find (const char *str);
+unsigned int intern_hash (void *str);
+void intern_free (void);
+
+#endif /* __INTERN_H */
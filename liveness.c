@@ -101,7 +101,7 @@ void live_registers (struct code *c)
 
   while (el) {
     struct subroutine *sub = element_getvalue (el);
-    if (!sub->import && !sub->haserror) {
+    if ((sub->status & SUB_STAT_OPERATIONS_EXTRACTED) && !sub->haserror) {
       reset_marks (sub);
       sub->status |= SUB_STAT_LIVE_REGISTERS;
       sub->endblock->mark1 = 1;
@@ -130,6 +130,12 @@ void live_registers_imports (struct code *c)
         int count = 0, maxcount = 0;
         element opel;
 
+        /* A subroutine given up may have its SSA half built */
+        if (!(block->sub->status & SUB_STAT_CFG_TRAVERSE_REV) || block->sub->haserror) {
+          ref = element_next (ref);
+          continue;
+        }
+
         opel = list_head (op->info.callop.arguments);
         while (opel) {
           struct value *val = element_getvalue (opel);
@@ -165,7 +171,7 @@ void live_registers_imports (struct code *c)
 
   while (el) {
     struct subroutine *sub = element_getvalue (el);
-    if (!sub->import && !sub->haserror &&
+    if ((sub->status & SUB_STAT_CFG_TRAVERSE_REV) && !sub->haserror &&
         !(sub->status & SUB_STAT_SSA)) {
       unbuild_ssa (sub);
       remove_call_arguments (sub);
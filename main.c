@@ -3,6 +3,7 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "code.h"
@@ -10,25 +11,34 @@
 #include "output.h"
 #include "nids.h"
 #include "hash.h"
+#include "profile.h"
+#include "cache.h"
+#include "intern.h"
+#include "server.h"
+#include "threads.h"
 #include "utils.h"
 
 
-int g_verbosity;
-int g_printoptions;
-
 static
 void print_help (char *prgname)
 {
   report (
     "Usage:\n"
-    "  %s [-g] [-n nidsfile] [-v] prxfile\n"
+    "  %s [-g] [-n nidsfile] [-j threads] [-v] [--cache file] [--function name]\n"
+    "     [--profile] [--xref name] prxfile\n"
+    "  %s [-n nidsfile] [-j threads] --server socket\n"
     "Where:\n"
     "  -c    output code\n"
     "  -d    print the dominator\n"
     "  -e    print edge types\n"
     "  -f    print the frontier\n"
     "  -g    output graphviz dot\n"
-    "  -i    print prx info\n"
+    "  -i    print prx info\n",
+    prgname, prgname
+  );
+  report (
+    "  -j    number of threads (0 uses all processors)\n"
+    "  -l    output a listing of the code segment, without analysis\n"
     "  -n    specify nids xml file\n"
     "  -q    print code into nodes\n"
     "  -r    print the reverse depth first search number\n"
@@ -36,31 +46,134 @@ void print_help (char *prgname)
     "  -t    print depth first search number\n"
     "  -v    increase verbosity\n"
     "  -x    print the reverse dominator\n"
-    "  -z    print the reverse frontier\n",
-    prgname
+    "  -z    print the reverse frontier\n"
+  );
+  report (
+    "  --budget units       give up the analysis of a subroutine after this\n"
+    "                       many work units, printing its disassembly\n"
+    "  --stage-budget units the same, for each stage of the analysis\n"
+  );
+  report (
+    "  --cache file         load the analysis from file, or save it there\n"
+    "  --export file        write the analysis to file in JSON Lines\n"
+    "  --export-binary file write the analysis to file in binary\n"
+    "  --function name      analyse and output only one function, given by\n"
+    "                       its export name or its address (0x...)\n"
+  );
+  report (
+    "  --profile            print the time spent in each stage\n"
+    "  --profile-json file  write the profile in JSON format\n"
+    "  --profile-top n      number of slowest subroutines to list\n"
+    "  --server socket      keep the analysed modules in memory and answer\n"
+    "                       requests on a unix domain socket\n"
+  );
+  report (
+    "  --xref name          print the calls and data references from and to\n"
+    "                       a function (name or 0x...), or to a data address\n"
   );
 }
 
+static
+struct code *analyse (struct prx *p, struct nidstable *nids, char *functionname, char *cachefilename)
+{
+  struct code *c = NULL;
+
+  if (functionname) {
+    c = code_analyse_function (p, functionname);
+  } else {
+    uint32 nidsversion = nids ? nids_version (nids) : 0;
+    int outdated = TRUE;
+    if (cachefilename) {
+      profile_begin (PROF_CACHE_LOAD);
+      c = cache_load (p, cachefilename, nidsversion, &outdated);
+      profile_end (PROF_CACHE_LOAD);
+    }
+    if (!c) {
+      c = code_analyse (p);
+      outdated = TRUE;
+    }
+    if (c && cachefilename && outdated) {
+      profile_begin (PROF_CACHE_SAVE);
+      cache_save (c, cachefilename, nidsversion);
+      profile_end (PROF_CACHE_SAVE);
+    }
+  }
+  return c;
+}
+
 int main (int argc, char **argv)
 {
   char *prxfilename = NULL;
   char *nidsfilename = NULL;
+  char *profilefilename = NULL;
+  char *functionname = NULL;
+  char *cachefilename = NULL;
+  char *socketfilename = NULL;
+  char *exportfilename = NULL;
+  char *binaryfilename = NULL;
+  char *xrefquery = NULL;
 
   int i, j;
   int printgraph = FALSE;
   int printcode = FALSE;
   int printinfo = FALSE;
+  int printlisting = FALSE;
+  int printprofile = FALSE;
+  int profiletop = PROFILE_DEFAULT_TOP;
 
   struct nidstable *nids = NULL;
   struct prx *p = NULL;
-  struct code *c;
+  struct code *c = NULL;
 
   g_verbosity = 0;
+  g_numthreads = 1;
 
   for (i = 1; i < argc; i++) {
     if (strcmp ("--help", argv[i]) == 0) {
       print_help (argv[0]);
       return 0;
+    } else if (strcmp ("--budget", argv[i]) == 0) {
+      if (i == (argc - 1))
+        fatal (__FILE__ ": missing number of work units");
+      g_subbudget = strtoul (argv[++i], NULL, 0);
+    } else if (strcmp ("--stage-budget", argv[i]) == 0) {
+      if (i == (argc - 1))
+        fatal (__FILE__ ": missing number of work units");
+      g_stagebudget = strtoul (argv[++i], NULL, 0);
+    } else if (strcmp ("--cache", argv[i]) == 0) {
+      if (i == (argc - 1))
+        fatal (__FILE__ ": missing cache file");
+      cachefilename = argv[++i];
+    } else if (strcmp ("--export", argv[i]) == 0) {
+      if (i == (argc - 1))
+        fatal (__FILE__ ": missing export file");
+      exportfilename = argv[++i];
+    } else if (strcmp ("--export-binary", argv[i]) == 0) {
+      if (i == (argc - 1))
+        fatal (__FILE__ ": missing export file");
+      binaryfilename = argv[++i];
+    } else if (strcmp ("--function", argv[i]) == 0) {
+      if (i == (argc - 1))
+        fatal (__FILE__ ": missing function name");
+      functionname = argv[++i];
+    } else if (strcmp ("--profile", argv[i]) == 0) {
+      printprofile = TRUE;
+    } else if (strcmp ("--profile-json", argv[i]) == 0) {
+      if (i == (argc - 1))
+        fatal (__FILE__ ": missing profile file");
+      profilefilename = argv[++i];
+    } else if (strcmp ("--profile-top", argv[i]) == 0) {
+      if (i == (argc - 1))
+        fatal (__FILE__ ": missing number of subroutines");
+      profiletop = atoi (argv[++i]);
+    } else if (strcmp ("--server", argv[i]) == 0) {
+      if (i == (argc - 1))
+        fatal (__FILE__ ": missing socket file");
+      socketfilename = argv[++i];
+    } else if (strcmp ("--xref", argv[i]) == 0) {
+      if (i == (argc - 1))
+        fatal (__FILE__ ": missing function name or address");
+      xrefquery = argv[++i];
     } else if (argv[i][0] == '-') {
       char *s = argv[i];
       for (j = 0; s[j]; j++) {
@@ -69,6 +182,7 @@ int main (int argc, char **argv)
         case 'g': printgraph = TRUE; break;
         case 'c': printcode = TRUE; break;
         case 'i': printinfo = TRUE; break;
+        case 'l': printlisting = TRUE; break;
         case 't': g_printoptions |= OUT_PRINT_DFS; break;
         case 'r': g_printoptions |= OUT_PRINT_RDFS; break;
         case 'd': g_printoptions |= OUT_PRINT_DOMINATOR; break;
@@ -84,6 +198,12 @@ int main (int argc, char **argv)
 
           nidsfilename = argv[++i];
           break;
+        case 'j':
+          if (i == (argc - 1))
+            fatal (__FILE__ ": missing number of threads");
+
+          g_numthreads = atoi (argv[++i]);
+          break;
         }
       }
     } else {
@@ -91,20 +211,38 @@ int main (int argc, char **argv)
     }
   }
 
+  if (socketfilename) {
+    if (!server_run (socketfilename, nidsfilename))
+      return 1;
+    intern_free ();
+    return 0;
+  }
+
   if (!prxfilename) {
     print_help (argv[0]);
     return 0;
   }
 
-  if (nidsfilename)
+  if (printprofile || profilefilename)
+    profile_enable (profiletop);
+
+  if (nidsfilename) {
+    profile_begin (PROF_LOAD_NIDS);
     nids = nids_load (nidsfilename);
+    profile_end (PROF_LOAD_NIDS);
+  }
 
-  p = prx_load (prxfilename);
+  profile_begin (PROF_LOAD_PRX);
+  p = prx_load (prxfilename, PRX_LAZY_RELOCS);
   if (!p)
     fatal (__FILE__ ": can't load prx `%s'", prxfilename);
+  profile_end (PROF_LOAD_PRX);
 
-  if (nids)
+  if (nids) {
+    profile_begin (PROF_RESOLVE_NIDS);
     prx_resolve_nids (p, nids);
+    profile_end (PROF_RESOLVE_NIDS);
+  }
 
   if (g_verbosity > 2 && nids && printinfo)
     nids_print (nids);
@@ -112,23 +250,72 @@ int main (int argc, char **argv)
   if (g_verbosity > 0 && printinfo)
     prx_print (p, (g_verbosity > 1));
 
-  c = code_analyse (p);
-  if (!c)
-    fatal (__FILE__ ": can't analyse code `%s'", prxfilename);
+  if (printlisting) {
+    profile_begin (PROF_PRINT_LISTING);
+    print_listing (p, prxfilename);
+    profile_end (PROF_PRINT_LISTING);
+  }
+
+  /* The information and the listing need no analysis, and leave the
+   * relocations they don't print unresolved */
+  if (printgraph || printcode || functionname || cachefilename ||
+      exportfilename || binaryfilename || xrefquery ||
+      printprofile || profilefilename) {
+    c = analyse (p, nids, functionname, cachefilename);
+    if (!c)
+      fatal (__FILE__ ": can't analyse code `%s'", prxfilename);
+  }
 
 
-  if (printgraph)
+  if (printgraph) {
+    profile_begin (PROF_PRINT_GRAPH);
     print_graph (c, prxfilename);
+    profile_end (PROF_PRINT_GRAPH);
+  }
 
-  if (printcode)
+  if (printcode) {
+    profile_begin (PROF_PRINT_CODE);
     print_code (c, prxfilename);
+    profile_end (PROF_PRINT_CODE);
+  }
+
+  if (exportfilename || binaryfilename) {
+    profile_begin (PROF_PRINT_EXPORT);
+    if (exportfilename)
+      print_export (c, exportfilename, FALSE);
+    if (binaryfilename)
+      print_export (c, binaryfilename, TRUE);
+    profile_end (PROF_PRINT_EXPORT);
+  }
+
+  if (xrefquery) {
+    struct outbuf *out = outbuf_alloc ();
+    struct outchunk *chunk;
 
-  code_free (c);
+    if (!print_xrefs (out, c, xrefquery))
+      error (__FILE__ ": can't find `%s'", xrefquery);
+    for (chunk = out->head; chunk; chunk = chunk->next)
+      fwrite (chunk->data, 1, chunk->size, stdout);
+    outbuf_free (out);
+  }
+
+  if (printprofile)
+    profile_print ();
+
+  if (profilefilename)
+    profile_print_json (profilefilename);
+
+  profile_free ();
+
+  if (c)
+    code_free (c);
 
   prx_free (p);
 
   if (nids)
     nids_free (nids);
 
+  intern_free ();
+
   return 0;
 }
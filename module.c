@@ -6,6 +6,7 @@
 #include <string.h>
 
 #include "prx.h"
+#include "intern.h"
 #include "utils.h"
 
 static
@@ -162,6 +163,7 @@ int load_module_import (struct prx *p, struct prx_import *imp)
 
   if (imp->nvars) {
     imp->vars = (struct prx_variable *) xmalloc (imp->nvars * sizeof (struct prx_variable));
+    prx_resolve_relocs (p, imp->varsvaddr, 8 * imp->nvars);
     offset = prx_translate (p, imp->varsvaddr);
     for (i = 0; i < imp->nvars; i++) {
       struct prx_variable *v = &imp->vars[i];
@@ -184,6 +186,7 @@ int load_module_imports (struct prx *p)
   info->imports = (struct prx_import *) xmalloc (info->numimports * sizeof (struct prx_import));
   memset (info->imports, 0, info->numimports * sizeof (struct prx_import));
 
+  prx_resolve_relocs (p, info->impvaddr, info->impvaddrbtm - info->impvaddr);
   offset = prx_translate (p, info->impvaddr);
   for (i = 0; i < info->numimports; i++) {
     struct prx_import *imp = &info->imports[i];
@@ -199,7 +202,7 @@ int load_module_imports (struct prx *p)
     if (!check_module_import (p, i)) return 0;
 
     if (imp->namevaddr)
-      imp->name = (const char *) &p->data[prx_translate (p, imp->namevaddr)];
+      imp->name = intern_string ((const char *) &p->data[prx_translate (p, imp->namevaddr)]);
     else
       imp->name = NULL;
 
@@ -212,25 +215,27 @@ int load_module_imports (struct prx *p)
 static
 const char *resolve_syslib_nid (uint32 nid)
 {
+  const char *name = NULL;
   switch (nid) {
-  case 0xd3744be0: return "module_bootstart";
-  case 0x2f064fa6: return "module_reboot_before";
-  case 0xadf12745: return "module_reboot_phase";
-  case 0xd632acdb: return "module_start";
-  case 0xcee8593c: return "module_stop";
-  case 0xf01d73a7: return "module_info";
-  case 0x0f7c276c: return "module_start_thread_parameter";
-  case 0xcf0cc697: return "module_stop_thread_parameter";
+  case 0xd3744be0: name = "module_bootstart"; break;
+  case 0x2f064fa6: name = "module_reboot_before"; break;
+  case 0xadf12745: name = "module_reboot_phase"; break;
+  case 0xd632acdb: name = "module_start"; break;
+  case 0xcee8593c: name = "module_stop"; break;
+  case 0xf01d73a7: name = "module_info"; break;
+  case 0x0f7c276c: name = "module_start_thread_parameter"; break;
+  case 0xcf0cc697: name = "module_stop_thread_parameter"; break;
   }
-  return NULL;
+  return name ? intern_string (name) : NULL;
 }
 
 static
 int load_module_export (struct prx *p, struct prx_export *exp)
 {
   uint32 i, offset, disp;
-  offset = prx_translate (p, exp->expvaddr);
   disp = 4 * (exp->nfuncs + exp->nvars);
+  prx_resolve_relocs (p, exp->expvaddr, 2 * disp);
+  offset = prx_translate (p, exp->expvaddr);
   if (exp->nfuncs) {
     exp->funcs = (struct prx_function *) xmalloc (exp->nfuncs * sizeof (struct prx_function));
     for (i = 0; i < exp->nfuncs; i++) {
@@ -275,6 +280,7 @@ int load_module_exports (struct prx *p)
   info->exports = (struct prx_export *) xmalloc (info->numexports * sizeof (struct prx_export));
   memset (info->exports, 0, info->numexports * sizeof (struct prx_export));
 
+  prx_resolve_relocs (p, info->expvaddr, info->expvaddrbtm - info->expvaddr);
   offset = prx_translate (p, info->expvaddr);
   for (i = 0; i < info->numexports; i++) {
     struct prx_export *exp = &info->exports[i];
@@ -288,9 +294,9 @@ int load_module_exports (struct prx *p)
     if (!check_module_export (p, i)) return 0;
 
     if (exp->namevaddr)
-      exp->name = (const char *) &p->data[prx_translate (p, exp->namevaddr)];
+      exp->name = intern_string ((const char *) &p->data[prx_translate (p, exp->namevaddr)]);
     else
-      exp->name = "syslib";
+      exp->name = intern_string ("syslib");
 
     if (!load_module_export (p, exp)) return 0;
     offset += exp->size << 2;
@@ -313,6 +319,8 @@ int load_module_info (struct prx *p)
   info = (struct prx_modinfo *) xmalloc (sizeof (struct prx_modinfo));
   p->modinfo = info;
 
+  prx_resolve_relocs (p, offset - p->programs[0].offset + p->programs[0].vaddr, PRX_MODULE_INFO_SIZE);
+
   info->attributes = read_uint16_le (&p->data[offset]);
   info->version = read_uint16_le (&p->data[offset+2]);
   info->name = (const char *) &p->data[offset+4];
@@ -486,48 +494,56 @@ void print_module_info (struct prx *p)
 }
 
 
+/* The functions and the variables of a library are resolved together */
+static
+void resolve_library (struct nidslib *lib, struct prx_function *funcs, uint32 nfuncs,
+                      struct prx_variable *vars, uint32 nvars)
+{
+  unsigned int *nids;
+  struct nidinfo **result;
+  uint32 i, count = nfuncs + nvars;
+
+  if (!lib || !count) return;
+  nids = (unsigned int *) xmalloc (count * sizeof (unsigned int));
+  result = (struct nidinfo **) xmalloc (count * sizeof (struct nidinfo *));
+  for (i = 0; i < nfuncs; i++)
+    nids[i] = funcs[i].nid;
+  for (i = 0; i < nvars; i++)
+    nids[nfuncs + i] = vars[i].nid;
+
+  nids_library_resolve (lib, nids, result, count);
+  for (i = 0; i < nfuncs; i++) {
+    if (result[i]) {
+      funcs[i].name = result[i]->name;
+      funcs[i].numargs = result[i]->numargs;
+    }
+  }
+  for (i = 0; i < nvars; i++) {
+    if (result[nfuncs + i])
+      vars[i].name = result[nfuncs + i]->name;
+  }
+
+  free (nids);
+  free (result);
+}
+
+/* Each library name is looked up once, and its nids resolved in batch */
 void prx_resolve_nids (struct prx *p, struct nidstable *nids)
 {
-  uint32 i, j;
-  struct nidinfo *ninfo;
+  uint32 i;
+  struct nidslib *lib;
   struct prx_modinfo *info = p->modinfo;
 
   for (i = 0; i < info->numimports; i++) {
     struct prx_import *imp = &info->imports[i];
-    for (j = 0; j < imp->nfuncs; j++) {
-      struct prx_function *f = &imp->funcs[j];
-      ninfo = nids_find (nids, imp->name, f->nid);
-      if (ninfo) {
-        f->name = ninfo->name;
-        f->numargs = ninfo->numargs;
-      }
-    }
-    for (j = 0; j < imp->nvars; j++) {
-      struct prx_variable *v = &imp->vars[j];
-      ninfo = nids_find (nids, imp->name, v->nid);
-      if (ninfo) {
-        v->name = ninfo->name;
-      }
-    }
+    lib = imp->name ? nids_library (nids, imp->name) : NULL;
+    resolve_library (lib, imp->funcs, imp->nfuncs, imp->vars, imp->nvars);
   }
 
   for (i = 0; i < info->numexports; i++) {
     struct prx_export *exp = &info->exports[i];
-    for (j = 0; j < exp->nfuncs; j++) {
-      struct prx_function *f = &exp->funcs[j];
-      ninfo = nids_find (nids, exp->name, f->nid);
-      if (ninfo) {
-        f->name = ninfo->name;
-        f->numargs = ninfo->numargs;
-      }
-    }
-    for (j = 0; j < exp->nvars; j++) {
-      struct prx_variable *v = &exp->vars[j];
-      ninfo = nids_find (nids, exp->name, v->nid);
-      if (ninfo) {
-        v->name = ninfo->name;
-      }
-    }
+    lib = exp->name ? nids_library (nids, exp->name) : NULL;
+    resolve_library (lib, exp->funcs, exp->nfuncs, exp->vars, exp->nvars);
   }
 }
 
@@ -9,14 +9,31 @@
 
 #include "nids.h"
 #include "hash.h"
+#include "intern.h"
 #include "alloc.h"
 #include "utils.h"
 
+struct nidslib {
+  const char *name;
+  hashtable nids;
+  struct nidinfo **sorted;   /* The nids of the library in increasing order */
+  unsigned int count;
+};
+
 struct nidstable {
   hashpool pool;
   hashtable libs;
   fixedpool infopool;
-  char *buffer;
+  fixedpool libpool;
+  struct nidinfo **sorted;
+  unsigned int count;
+  unsigned int version;
+};
+
+/* A nid being resolved in a batch */
+struct nidquery {
+  unsigned int nid;
+  size_t pos;
 };
 
 enum XMLSCOPE {
@@ -36,9 +53,8 @@ struct xml_data {
   enum XMLSCOPE scope;
   enum XMLELEMENT last;
 
-  size_t buffer_pos;
   struct nidstable *result;
-  hashtable curlib;
+  struct nidslib *curlib;
   const char *libname;
 
   struct nidinfo currnid;
@@ -48,15 +64,18 @@ struct xml_data {
 void nids_free (struct nidstable *nids)
 {
   nids->libs = NULL;
-  if (nids->buffer)
-    free (nids->buffer);
-  nids->buffer = NULL;
   if (nids->pool)
     hashpool_destroy (nids->pool);
   nids->pool = NULL;
   if (nids->infopool)
     fixedpool_destroy (nids->infopool, NULL, NULL);
   nids->infopool = NULL;
+  if (nids->libpool)
+    fixedpool_destroy (nids->libpool, NULL, NULL);
+  nids->libpool = NULL;
+  if (nids->sorted)
+    free (nids->sorted);
+  nids->sorted = NULL;
   free (nids);
 }
 
@@ -98,16 +117,18 @@ void end_hndl (void *data, const char *el)
   } else if (strcmp (el, "FUNCTION") == 0 || strcmp (el, "VARIABLE") == 0) {
     d->scope = XMLS_LIBRARY;
     if (d->currnid.name && d->currnid.nid && d->curlib) {
-      struct nidinfo *info = hashtable_searchhash (d->curlib, NULL, NULL, d->currnid.nid);
+      struct nidinfo *info = hashtable_searchhash (d->curlib->nids, NULL, NULL, d->currnid.nid);
       if (info) {
-        if (strcmp (info->name, d->currnid.name)) {
+        if (info->name != d->currnid.name) {
           error (__FILE__ ": NID `0x%08X' repeated in library `%s'", d->currnid.nid, d->libname);
           d->error = 1;
         }
       } else {
         info = fixedpool_alloc (d->result->infopool);
         memcpy (info, &d->currnid, sizeof (struct nidinfo));
-        hashtable_inserthash (d->curlib, NULL, info, d->currnid.nid);
+        hashtable_inserthash (d->curlib->nids, NULL, info, d->currnid.nid);
+        d->curlib->count++;
+        d->result->count++;
       }
     } else {
       error (__FILE__ ": missing function or variable definition");
@@ -119,19 +140,6 @@ void end_hndl (void *data, const char *el)
   }
 }
 
-static
-const char *dup_string (struct xml_data *d, const char *txt, size_t len)
-{
-  char *result;
-
-  result = &d->result->buffer[d->buffer_pos];
-  memcpy (result, txt, len);
-  result[len] = '\0';
-  d->buffer_pos += len + 1;
-
-  return (const char *) result;
-}
-
 static
 void char_hndl (void *data, const char *txt, int txtlen)
 {
@@ -145,7 +153,7 @@ void char_hndl (void *data, const char *txt, int txtlen)
         error (__FILE__ ": repeated name in function/variable");
         d->error = 1;
       } else {
-        d->currnid.name = dup_string (d, txt, txtlen);
+        d->currnid.name = intern_stringn (txt, txtlen);
       }
     } else if (d->last == XMLE_NID || d->last == XMLE_NUMARGS) {
       char buffer[256];
@@ -171,14 +179,16 @@ void char_hndl (void *data, const char *txt, int txtlen)
     break;
   case XMLS_LIBRARY:
     if (d->last == XMLE_NAME) {
-      d->libname = dup_string (d, txt, txtlen);
+      d->libname = intern_stringn (txt, txtlen);
       if (d->curlib) {
         error (__FILE__ ": current lib is not null");
         d->error = 1;
       } else {
         d->curlib = hashtable_search (d->result->libs, (void *) d->libname, NULL);
         if (!d->curlib) {
-          d->curlib = hashtable_alloc (d->result->pool, 128, NULL, &hashtable_pointer_compare);
+          d->curlib = fixedpool_alloc (d->result->libpool);
+          d->curlib->name = d->libname;
+          d->curlib->nids = hashtable_alloc (d->result->pool, 128, NULL, &hashtable_pointer_compare);
           hashtable_insert (d->result->libs, (void *) d->libname, d->curlib);
         }
       }
@@ -187,10 +197,40 @@ void char_hndl (void *data, const char *txt, int txtlen)
   }
 }
 
+static
+int compare_info (const void *p1, const void *p2)
+{
+  const struct nidinfo *info1 = *(const struct nidinfo **) p1;
+  const struct nidinfo *info2 = *(const struct nidinfo **) p2;
+  if (info1->nid < info2->nid) return -1;
+  return (info1->nid > info2->nid);
+}
+
+static
+void collect_nid (void *key, void *value, unsigned int hash, void *arg)
+{
+  struct nidslib *lib = arg;
+  lib->sorted[lib->count++] = value;
+}
+
+static
+void sort_library (void *key, void *value, unsigned int hash, void *arg)
+{
+  struct nidslib *lib = value;
+  struct nidinfo ***next = arg;
+
+  lib->sorted = *next;
+  lib->count = 0;
+  hashtable_traverse (lib->nids, &collect_nid, lib);
+  qsort (lib->sorted, lib->count, sizeof (struct nidinfo *), &compare_info);
+  *next += lib->count;
+}
+
 struct nidstable *nids_load (const char *xmlpath)
 {
   XML_Parser p;
   struct xml_data data;
+  struct nidinfo **next;
   size_t size;
   void *buf;
 
@@ -220,15 +260,14 @@ struct nidstable *nids_load (const char *xmlpath)
   data.result->pool =
     hashpool_create (256, 8192);
   data.result->libs =
-    hashtable_alloc (data.result->pool, 32, &hashtable_hash_string,
-                     &hashtable_string_compare);
+    hashtable_alloc (data.result->pool, 32, &intern_hash,
+                     &hashtable_pointer_compare);
   data.result->infopool = fixedpool_create (sizeof (struct nidinfo), 8192, 0);
+  data.result->libpool = fixedpool_create (sizeof (struct nidslib), 256, 0);
+  data.result->sorted = NULL;
+  data.result->count = 0;
 
-  data.buffer_pos = 0;
-  data.result->buffer = buf;
-  buf = xmalloc (size);
-
-  memcpy (buf, data.result->buffer, size);
+  data.result->version = hashtable_hash_bytes (buf, size);
 
   XML_SetUserData (p, (void *) &data);
   XML_SetElementHandler (p, &start_hndl, &end_hndl);
@@ -248,6 +287,11 @@ struct nidstable *nids_load (const char *xmlpath)
     return NULL;
   }
 
+  data.result->sorted = (struct nidinfo **)
+    xmalloc ((data.result->count + 1) * sizeof (struct nidinfo *));
+  next = data.result->sorted;
+  hashtable_traverse (data.result->libs, &sort_library, &next);
+
   return data.result;
 }
 
@@ -264,9 +308,9 @@ void print_level2 (void *key, void *value, unsigned int hash, void *arg)
 static
 void print_level1 (void *key, void *value, unsigned int hash, void *arg)
 {
-  hashtable lib = (hashtable) value;
+  struct nidslib *lib = value;
   report ("  %s:\n", (char *) key);
-  hashtable_traverse (lib, &print_level2, NULL);
+  hashtable_traverse (lib->nids, &print_level2, NULL);
   report ("\n");
 }
 
@@ -279,13 +323,74 @@ void nids_print (struct nidstable *nids)
 
 struct nidinfo *nids_find (struct nidstable *nids, const char *library, unsigned int nid)
 {
-  hashtable lib;
+  struct nidslib *lib;
 
-  lib = hashtable_search (nids->libs, (void *) library, NULL);
-  if (lib) return hashtable_searchhash (lib, NULL, NULL, nid);
+  library = intern_find (library);
+  if (!library) return NULL;
+  lib = nids_library (nids, library);
+  if (lib) return nids_library_find (lib, nid);
   return NULL;
 }
 
+/* The library name must be interned */
+struct nidslib *nids_library (struct nidstable *nids, const char *library)
+{
+  return hashtable_search (nids->libs, (void *) library, NULL);
+}
+
+struct nidinfo *nids_library_find (struct nidslib *lib, unsigned int nid)
+{
+  return hashtable_searchhash (lib->nids, NULL, NULL, nid);
+}
+
+static
+int compare_query (const void *p1, const void *p2)
+{
+  const struct nidquery *q1 = p1;
+  const struct nidquery *q2 = p2;
+  if (q1->nid < q2->nid) return -1;
+  return (q1->nid > q2->nid);
+}
+
+/* Sorts the batch and merges it with the sorted nids of the library.
+ * Each step bisects the rest of the library, so that small batches
+ * don't walk through the whole library */
+void nids_library_resolve (struct nidslib *lib, const unsigned int *nids,
+                           struct nidinfo **result, size_t count)
+{
+  struct nidquery *queries;
+  size_t i, lo, hi, mid;
+
+  queries = (struct nidquery *) xmalloc ((count + 1) * sizeof (struct nidquery));
+  for (i = 0; i < count; i++) {
+    queries[i].nid = nids[i];
+    queries[i].pos = i;
+  }
+  qsort (queries, count, sizeof (struct nidquery), &compare_query);
+
+  lo = 0;
+  for (i = 0; i < count; i++) {
+    hi = lib->count;
+    while (lo < hi) {
+      mid = lo + (hi - lo) / 2;
+      if (lib->sorted[mid]->nid < queries[i].nid) lo = mid + 1;
+      else hi = mid;
+    }
+    if (lo < lib->count && lib->sorted[lo]->nid == queries[i].nid)
+      result[queries[i].pos] = lib->sorted[lo];
+    else
+      result[queries[i].pos] = NULL;
+  }
+
+  free (queries);
+}
+
+/* Identifies the contents of the table (a hash of the xml file) */
+unsigned int nids_version (struct nidstable *nids)
+{
+  return nids->version;
+}
+
 
 #ifdef TEST_NIDS
 int main (int argc, char **argv)
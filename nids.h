@@ -5,7 +5,10 @@
 #ifndef __NIDS_H
 #define __NIDS_H
 
+#include <stddef.h>
+
 struct nidstable;
+struct nidslib;
 
 struct nidinfo {
   const char *name;
@@ -17,7 +20,12 @@ struct nidinfo {
 
 struct nidstable *nids_load (const char *xmlpath);
 struct nidinfo *nids_find (struct nidstable *nids, const char *library, unsigned int nid);
+struct nidslib *nids_library (struct nidstable *nids, const char *library);
+struct nidinfo *nids_library_find (struct nidslib *lib, unsigned int nid);
+void nids_library_resolve (struct nidslib *lib, const unsigned int *nids,
+                           struct nidinfo **result, size_t count);
 void nids_print (struct nidstable *nids);
+unsigned int nids_version (struct nidstable *nids);
 void nids_free (struct nidstable *nids);
 
 #endif /* __NIDS_H */
@@ -209,7 +209,7 @@ void extract_operations (struct subroutine *sub)
   struct location *loc;
   struct prx *file;
   uint32 asm_gen[NUM_REGMASK], asm_kill[NUM_REGMASK];
-  int i, regno, lastasm, relocnum;
+  int i, regno, lastasm;
   element el;
 
   file = sub->code->file;
@@ -224,20 +224,11 @@ void extract_operations (struct subroutine *sub)
     switch (block->type) {
     case BLOCK_SIMPLE:
       lastasm = FALSE;
-      relocnum = prx_findrelocbyaddr (file, block->info.simple.begin->address);
-
       for (i = 0; i < NUM_REGMASK; i++)
         asm_gen[i] = asm_kill[i] = 0;
 
       for (loc = block->info.simple.begin; ; loc++) {
-        int hasreloc = FALSE;
-
-        if (relocnum < file->relocnum) {
-          if (file->relocsbyaddr[relocnum].vaddr == loc->address) {
-            hasreloc = TRUE;
-            relocnum++;
-          }
-        }
+        int hasreloc = prx_hasreloc (file, loc->address);
 
         if (INSN_TYPE (loc->insn->flags) == INSN_ALLEGREX) {
           enum allegrex_insn insn;
@@ -0,0 +1,274 @@
+/**
+ * Author: Humberto Naves (hsnaves@gmail.com)
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "outbuf.h"
+#include "utils.h"
+
+static const char hexdigits[] = "0123456789ABCDEF";
+
+static
+struct outchunk *alloc_chunk (void)
+{
+  struct outchunk *chunk = (struct outchunk *) xmalloc (sizeof (struct outchunk));
+  chunk->next = NULL;
+  chunk->size = 0;
+  return chunk;
+}
+
+static
+struct outbuf *alloc_outbuf (int fd, const char *path)
+{
+  struct outbuf *out = (struct outbuf *) xmalloc (sizeof (struct outbuf));
+  out->fd = fd;
+  out->path = NULL;
+  if (path) {
+    out->path = (char *) xmalloc (strlen (path) + 1);
+    strcpy (out->path, path);
+  }
+  out->head = out->tail = alloc_chunk ();
+  out->numchunks = 1;
+  out->size = 0;
+  out->error = FALSE;
+  return out;
+}
+
+struct outbuf *outbuf_open (const char *path)
+{
+  int fd = open (path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd < 0) return NULL;
+  return alloc_outbuf (fd, path);
+}
+
+struct outbuf *outbuf_alloc (void)
+{
+  return alloc_outbuf (-1, NULL);
+}
+
+static
+int write_all (struct outbuf *out, struct iovec *iov, int iovcnt)
+{
+  while (iovcnt > 0) {
+    ssize_t written = writev (out->fd, iov, iovcnt);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      xerror (__FILE__ ": can't write to file `%s'", out->path);
+      return 0;
+    }
+    while (iovcnt > 0 && (size_t) written >= iov->iov_len) {
+      written -= iov->iov_len;
+      iov++; iovcnt--;
+    }
+    if (iovcnt > 0) {
+      iov->iov_base = ((char *) iov->iov_base) + written;
+      iov->iov_len -= written;
+    }
+  }
+  return 1;
+}
+
+int outbuf_flush (struct outbuf *out)
+{
+  struct iovec iov[OUTBUF_FLUSH_CHUNKS];
+  struct outchunk *chunk, *next;
+  int iovcnt = 0;
+
+  if (out->fd < 0) return !out->error;
+
+  for (chunk = out->head; chunk; chunk = chunk->next) {
+    if (!chunk->size) continue;
+    if (iovcnt == OUTBUF_FLUSH_CHUNKS) {
+      if (!out->error && !write_all (out, iov, iovcnt))
+        out->error = TRUE;
+      iovcnt = 0;
+    }
+    iov[iovcnt].iov_base = chunk->data;
+    iov[iovcnt].iov_len = chunk->size;
+    iovcnt++;
+  }
+  if (iovcnt && !out->error && !write_all (out, iov, iovcnt))
+    out->error = TRUE;
+
+  /* Keep the first chunk around for reuse */
+  for (chunk = out->head->next; chunk; chunk = next) {
+    next = chunk->next;
+    free (chunk);
+  }
+  out->head->next = NULL;
+  out->head->size = 0;
+  out->tail = out->head;
+  out->numchunks = 1;
+
+  return !out->error;
+}
+
+int outbuf_close (struct outbuf *out)
+{
+  int result = outbuf_flush (out);
+  if (out->fd >= 0 && close (out->fd) != 0) {
+    xerror (__FILE__ ": can't close file `%s'", out->path);
+    result = 0;
+  }
+  out->fd = -1;
+  outbuf_free (out);
+  return result;
+}
+
+void outbuf_free (struct outbuf *out)
+{
+  struct outchunk *chunk, *next;
+  for (chunk = out->head; chunk; chunk = next) {
+    next = chunk->next;
+    free (chunk);
+  }
+  if (out->path) free (out->path);
+  free (out);
+}
+
+/* Moves the contents of the memory buffer src to the end of out,
+ * src is left empty */
+void outbuf_append (struct outbuf *out, struct outbuf *src)
+{
+  if (!src->size) return;
+
+  out->tail->next = src->head;
+  out->tail = src->tail;
+  out->numchunks += src->numchunks;
+  out->size += src->size;
+
+  src->head = src->tail = alloc_chunk ();
+  src->numchunks = 1;
+  src->size = 0;
+
+  if (out->fd >= 0 && out->numchunks >= OUTBUF_FLUSH_CHUNKS)
+    outbuf_flush (out);
+}
+
+static
+void next_chunk (struct outbuf *out)
+{
+  if (out->fd >= 0 && out->numchunks >= OUTBUF_FLUSH_CHUNKS) {
+    outbuf_flush (out);
+    return;
+  }
+  out->tail->next = alloc_chunk ();
+  out->tail = out->tail->next;
+  out->numchunks++;
+}
+
+void outbuf_write (struct outbuf *out, const char *data, size_t len)
+{
+  struct outchunk *chunk = out->tail;
+  size_t avail;
+
+  out->size += len;
+  while (len > 0) {
+    avail = OUTBUF_CHUNK_SIZE - chunk->size;
+    if (!avail) {
+      next_chunk (out);
+      chunk = out->tail;
+      continue;
+    }
+    if (avail > len) avail = len;
+    memcpy (&chunk->data[chunk->size], data, avail);
+    chunk->size += avail;
+    data += avail;
+    len -= avail;
+  }
+}
+
+void outbuf_puts (struct outbuf *out, const char *str)
+{
+  outbuf_write (out, str, strlen (str));
+}
+
+void outbuf_putc (struct outbuf *out, char c)
+{
+  struct outchunk *chunk = out->tail;
+  if (chunk->size == OUTBUF_CHUNK_SIZE) {
+    next_chunk (out);
+    chunk = out->tail;
+  }
+  chunk->data[chunk->size++] = c;
+  out->size++;
+}
+
+void outbuf_repeat (struct outbuf *out, char c, size_t count)
+{
+  while (count--) outbuf_putc (out, c);
+}
+
+void outbuf_decw (struct outbuf *out, int32 val, int width)
+{
+  char buffer[16];
+  char *pos = &buffer[sizeof (buffer)];
+  uint32 uval = (val < 0) ? -((uint32) val) : (uint32) val;
+  int len;
+
+  do {
+    *(--pos) = '0' + (uval % 10);
+    uval /= 10;
+  } while (uval);
+  if (val < 0) *(--pos) = '-';
+
+  len = &buffer[sizeof (buffer)] - pos;
+  if (width > len) outbuf_repeat (out, ' ', width - len);
+  outbuf_write (out, pos, len);
+}
+
+void outbuf_dec (struct outbuf *out, int32 val)
+{
+  outbuf_decw (out, val, 0);
+}
+
+void outbuf_udec (struct outbuf *out, uint32 val)
+{
+  char buffer[16];
+  char *pos = &buffer[sizeof (buffer)];
+
+  do {
+    *(--pos) = '0' + (val % 10);
+    val /= 10;
+  } while (val);
+  outbuf_write (out, pos, &buffer[sizeof (buffer)] - pos);
+}
+
+/* Writes val in 7 bit groups, the least significant first */
+void outbuf_varint (struct outbuf *out, uint32 val)
+{
+  char buffer[5];
+  int len = 0;
+
+  do {
+    buffer[len] = val & 0x7F;
+    val >>= 7;
+    if (val) buffer[len] |= 0x80;
+    len++;
+  } while (val);
+  outbuf_write (out, buffer, len);
+}
+
+void outbuf_hex (struct outbuf *out, uint32 val, int width)
+{
+  char buffer[8];
+  char *pos = &buffer[sizeof (buffer)];
+  int len;
+
+  do {
+    *(--pos) = hexdigits[val & 0xF];
+    val >>= 4;
+  } while (val);
+
+  len = &buffer[sizeof (buffer)] - pos;
+  if (width > len) outbuf_repeat (out, '0', width - len);
+  outbuf_write (out, pos, len);
+}
@@ -0,0 +1,49 @@
+/**
+ * Author: Humberto Naves (hsnaves@gmail.com)
+ */
+
+#ifndef __OUTBUF_H
+#define __OUTBUF_H
+
+#include <stddef.h>
+#include "types.h"
+
+#define OUTBUF_CHUNK_SIZE    65536
+#define OUTBUF_FLUSH_CHUNKS  16
+
+struct outchunk {
+  struct outchunk *next;
+  size_t size;
+  char data[OUTBUF_CHUNK_SIZE];
+};
+
+/* Append-only output buffer. Buffers opened on a file are written
+ * with a single system call whenever OUTBUF_FLUSH_CHUNKS chunks
+ * are full, memory buffers only grow */
+struct outbuf {
+  int fd;
+  char *path;
+  struct outchunk *head, *tail;
+  size_t numchunks;
+  size_t size;
+  int error;
+};
+
+struct outbuf *outbuf_open (const char *path);
+struct outbuf *outbuf_alloc (void);
+int outbuf_flush (struct outbuf *out);
+int outbuf_close (struct outbuf *out);
+void outbuf_free (struct outbuf *out);
+void outbuf_append (struct outbuf *out, struct outbuf *src);
+
+void outbuf_write (struct outbuf *out, const char *data, size_t len);
+void outbuf_puts (struct outbuf *out, const char *str);
+void outbuf_putc (struct outbuf *out, char c);
+void outbuf_repeat (struct outbuf *out, char c, size_t count);
+void outbuf_dec (struct outbuf *out, int32 val);
+void outbuf_decw (struct outbuf *out, int32 val, int width);
+void outbuf_udec (struct outbuf *out, uint32 val);
+void outbuf_varint (struct outbuf *out, uint32 val);
+void outbuf_hex (struct outbuf *out, uint32 val, int width);
+
+#endif /* __OUTBUF_H */
@@ -3,14 +3,18 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <ctype.h>
 
 #include "output.h"
+#include "threads.h"
 #include "utils.h"
 
+#define PRINT_BATCH_SIZE 256
+
 
 static
-void print_block (FILE *out, struct basicblock *block, int identsize, int reversecond)
+void print_block (struct outbuf *out, struct basicblock *block, int identsize, int reversecond)
 {
   element opel;
   int options = 0;
@@ -30,7 +34,7 @@ void print_block (FILE *out, struct basicblock *block, int identsize, int revers
 }
 
 static
-void print_block_recursive (FILE *out, struct basicblock *block)
+void print_block_recursive (struct outbuf *out, struct basicblock *block)
 {
   element ref;
   struct basicedge *edge;
@@ -40,18 +44,22 @@ void print_block_recursive (FILE *out, struct basicblock *block)
 
   if (g_verbosity > 1) {
     ident_line (out, identsize + 1);
-    fprintf (out, "/** Block %d\n", block->node.dfsnum);
+    outbuf_puts (out, "/** Block ");
+    outbuf_dec (out, block->node.dfsnum);
+    outbuf_putc (out, '\n');
     if (block->type == BLOCK_SIMPLE){
       struct location *loc;
       loc = block->info.simple.begin;
       while (1) {
         ident_line (out, identsize + 1);
-        fprintf (out, " * %s\n", allegrex_disassemble (loc->opc, loc->address, TRUE));
+        outbuf_puts (out, " * ");
+        print_disassembly (out, loc, TRUE);
+        outbuf_putc (out, '\n');
         if (loc++ == block->info.simple.end) break;
       }
     }
     ident_line (out, identsize + 1);
-    fprintf (out, " */\n");
+    outbuf_puts (out, " */\n");
   }
 
   if (block->status & BLOCK_STAT_ISSWITCHTARGET) {
@@ -60,22 +68,26 @@ void print_block_recursive (FILE *out, struct basicblock *block)
       edge = element_getvalue (ref);
       if (edge->from->status & BLOCK_STAT_ISSWITCH) {
         ident_line (out, identsize);
-        fprintf (out, "case %d:\n", edge->fromnum);
+        outbuf_puts (out, "case ");
+        outbuf_dec (out, edge->fromnum);
+        outbuf_puts (out, ":\n");
       }
       ref = element_next (ref);
     }
   }
 
   if (block->status & BLOCK_STAT_HASLABEL) {
-    fprintf (out, "\n");
+    outbuf_putc (out, '\n');
     ident_line (out, identsize);
-    fprintf (out, "label%d:\n", block->node.dfsnum);
+    outbuf_puts (out, "label");
+    outbuf_dec (out, block->node.dfsnum);
+    outbuf_puts (out, ":\n");
   }
 
   if (block->st->start == block && block->st->type == CONTROL_LOOP) {
     isloop = TRUE;
     ident_line (out, identsize);
-    fprintf (out, "while (1) {\n");
+    outbuf_puts (out, "while (1) {\n");
   }
 
   block->mark1 = 1;
@@ -84,7 +96,7 @@ void print_block_recursive (FILE *out, struct basicblock *block)
   if (block->status & BLOCK_STAT_ISSWITCH) {
     revcond = TRUE;
     ident_line (out, identsize + 1);
-    fprintf (out, "switch () {\n");
+    outbuf_puts (out, "switch () {\n");
   }
 
   if (revcond) ref = list_head (block->outrefs);
@@ -115,14 +127,16 @@ void print_block_recursive (FILE *out, struct basicblock *block)
 
     switch (edge->type) {
     case EDGE_BREAK:
-      fprintf (out, "break;\n");
+      outbuf_puts (out, "break;\n");
       break;
     case EDGE_CONTINUE:
-      fprintf (out, "continue;\n");
+      outbuf_puts (out, "continue;\n");
       break;
     case EDGE_INVALID:
     case EDGE_GOTO:
-      fprintf (out, "goto label%d;\n", edge->to->node.dfsnum);
+      outbuf_puts (out, "goto label");
+      outbuf_dec (out, edge->to->node.dfsnum);
+      outbuf_puts (out, ";\n");
       break;
     case EDGE_UNKNOWN:
     case EDGE_IFEXIT:
@@ -136,10 +150,10 @@ void print_block_recursive (FILE *out, struct basicblock *block)
       print_block_recursive (out, edge->to);
       break;
     case EDGE_IFENTER:
-      fprintf (out, "{\n");
+      outbuf_puts (out, "{\n");
       print_block_recursive (out, edge->to);
       ident_line (out, identsize + 1);
-      fprintf (out, "}\n");
+      outbuf_puts (out, "}\n");
       break;
     }
 
@@ -148,7 +162,7 @@ void print_block_recursive (FILE *out, struct basicblock *block)
 
     if ((block->status & BLOCK_STAT_HASELSE) && ref) {
       ident_line (out, identsize + 1);
-      fprintf (out, "else\n");
+      outbuf_puts (out, "else\n");
     }
     first = FALSE;
   }
@@ -156,7 +170,9 @@ void print_block_recursive (FILE *out, struct basicblock *block)
   if (block->ifst) {
     if (block->ifst->hasendgoto) {
       ident_line (out, identsize + 1);
-      fprintf (out, "goto label%d;\n", block->ifst->end->node.dfsnum);
+      outbuf_puts (out, "goto label");
+      outbuf_dec (out, block->ifst->end->node.dfsnum);
+      outbuf_puts (out, ";\n");
     } else if (block->ifst->endfollow) {
       print_block_recursive (out, block->ifst->end);
     }
@@ -164,15 +180,17 @@ void print_block_recursive (FILE *out, struct basicblock *block)
 
   if (block->status & BLOCK_STAT_ISSWITCH) {
     ident_line (out, identsize + 1);
-    fprintf (out, "}\n");
+    outbuf_puts (out, "}\n");
   }
 
   if (block->st->start == block && block->st->type == CONTROL_LOOP) {
     ident_line (out, identsize);
-    fprintf (out, "}\n");
+    outbuf_puts (out, "}\n");
     if (block->st->hasendgoto) {
       ident_line (out, identsize);
-      fprintf (out, "goto label%d;\n", block->st->end->node.dfsnum);
+      outbuf_puts (out, "goto label");
+      outbuf_dec (out, block->st->end->node.dfsnum);
+      outbuf_puts (out, ";\n");
     } else if (block->st->endfollow) {
       print_block_recursive (out, block->st->end);
     }
@@ -180,20 +198,22 @@ void print_block_recursive (FILE *out, struct basicblock *block)
 
 }
 
-static
-void print_subroutine (FILE *out, struct subroutine *sub)
+void print_subroutine (struct outbuf *out, struct subroutine *sub)
 {
   if (sub->import) { return; }
 
-  fprintf (out, "/**\n * Subroutine at address 0x%08X\n", sub->begin->address);
-  fprintf (out, " */\n");
+  outbuf_puts (out, "/**\n * Subroutine at address 0x");
+  outbuf_hex (out, sub->begin->address, 8);
+  outbuf_putc (out, '\n');
+  outbuf_puts (out, " */\n");
   print_subroutine_declaration (out, sub);
-  fprintf (out, "\n{\n");
+  outbuf_puts (out, "\n{\n");
 
   if (sub->haserror) {
     struct location *loc;
     for (loc = sub->begin; ; loc++) {
-      fprintf (out, "%s\n", allegrex_disassemble (loc->opc, loc->address, TRUE));
+      print_disassembly (out, loc, TRUE);
+      outbuf_putc (out, '\n');
       if (loc == sub->end) break;
     }
   } else {
@@ -208,46 +228,123 @@ void print_subroutine (FILE *out, struct subroutine *sub)
       el = element_next (el);
     }
   }
-  fprintf (out, "}\n\n");
+  outbuf_puts (out, "}\n\n");
 }
 
+struct printjob {
+  struct subroutine **subs;
+  struct outbuf **bufs;
+};
+
 static
-void print_source (FILE *out, struct code *c, char *headerfilename)
+void print_subroutine_job (void *arg, uint32 index)
+{
+  struct printjob *job = arg;
+  print_subroutine (job->bufs[index], job->subs[index]);
+}
+
+/* Renders batches of subroutines into memory buffers on the worker
+ * threads and appends them to out in the original order */
+static
+void print_subroutines_parallel (struct outbuf *out, struct code *c)
+{
+  struct printjob job;
+  struct subroutine **subs;
+  uint32 i, count, pos, batch;
+  element el;
+
+  count = list_size (c->subroutines);
+  if (!count) return;
+
+  subs = (struct subroutine **) xmalloc (count * sizeof (struct subroutine *));
+  i = 0;
+  el = list_head (c->subroutines);
+  while (el) {
+    subs[i++] = element_getvalue (el);
+    el = element_next (el);
+  }
+
+  batch = MIN (count, PRINT_BATCH_SIZE);
+  job.bufs = (struct outbuf **) xmalloc (batch * sizeof (struct outbuf *));
+  for (i = 0; i < batch; i++)
+    job.bufs[i] = outbuf_alloc ();
+
+  for (pos = 0; pos < count; pos += batch) {
+    uint32 num = MIN (batch, count - pos);
+    job.subs = &subs[pos];
+    parallel_for (num, &print_subroutine_job, &job);
+    for (i = 0; i < num; i++)
+      outbuf_append (out, job.bufs[i]);
+  }
+
+  for (i = 0; i < batch; i++)
+    outbuf_free (job.bufs[i]);
+  free (job.bufs);
+  free (subs);
+}
+
+static
+int is_called_by (struct subroutine *sub, struct subroutine *target)
+{
+  element el = list_head (sub->callblocks);
+  while (el) {
+    struct basicblock *block = element_getvalue (el);
+    if (block->info.call.calltarget == target) return TRUE;
+    el = element_next (el);
+  }
+  return FALSE;
+}
+
+void print_source (struct outbuf *out, struct code *c, char *headerfilename)
 {
   uint32 i, j;
   element el;
 
-  fprintf (out, "#include <pspsdk.h>\n");
-  fprintf (out, "#include \"%s\"\n\n", headerfilename);
+  outbuf_puts (out, "#include <pspsdk.h>\n");
+  outbuf_puts (out, "#include \"");
+  outbuf_puts (out, headerfilename);
+  outbuf_puts (out, "\"\n\n");
 
   for (i = 0; i < c->file->modinfo->numimports; i++) {
     struct prx_import *imp = &c->file->modinfo->imports[i];
 
-    fprintf (out, "/*\n * Imports from library: %s\n */\n", imp->name);
+    outbuf_puts (out, "/*\n * Imports from library: ");
+    outbuf_puts (out, imp->name);
+    outbuf_puts (out, "\n */\n");
     for (j = 0; j < imp->nfuncs; j++) {
       struct prx_function *func = &imp->funcs[j];
       if (func->pfunc) {
-        fprintf (out, "extern ");
+        if (c->function && !is_called_by (c->function, func->pfunc)) continue;
+        outbuf_puts (out, "extern ");
         print_subroutine_declaration (out, func->pfunc);
-        fprintf (out, ";\n");
+        outbuf_puts (out, ";\n");
       }
     }
-    fprintf (out, "\n");
+    outbuf_putc (out, '\n');
   }
 
-  el = list_head (c->subroutines);
-  while (el) {
-    struct subroutine *sub;
-    sub = element_getvalue (el);
+  /* Built here, as the subroutines may be printed in parallel */
+  prx_strings (c->file);
 
-    print_subroutine (out, sub);
-    el = element_next (el);
+  if (c->function) {
+    print_subroutine (out, c->function);
+  } else if (threads_count () <= 1) {
+    el = list_head (c->subroutines);
+    while (el) {
+      struct subroutine *sub;
+      sub = element_getvalue (el);
+
+      print_subroutine (out, sub);
+      el = element_next (el);
+    }
+  } else {
+    print_subroutines_parallel (out, c);
   }
 
 }
 
 static
-void print_header (FILE *out, struct code *c, char *headerfilename)
+void print_header (struct outbuf *out, struct code *c, char *headerfilename)
 {
   uint32 i, j;
   char buffer[256];
@@ -262,25 +359,39 @@ void print_header (FILE *out, struct code *c, char *headerfilename)
   }
   buffer[pos] = '\0';
 
-  fprintf (out, "#ifndef __%s\n", buffer);
-  fprintf (out, "#define __%s\n\n", buffer);
+  outbuf_puts (out, "#ifndef __");
+  outbuf_puts (out, buffer);
+  outbuf_putc (out, '\n');
+  outbuf_puts (out, "#define __");
+  outbuf_puts (out, buffer);
+  outbuf_puts (out, "\n\n");
 
   for (i = 0; i < c->file->modinfo->numexports; i++) {
     struct prx_export *exp = &c->file->modinfo->exports[i];
 
-    fprintf (out, "/*\n * Exports from library: %s\n */\n", exp->name);
+    outbuf_puts (out, "/*\n * Exports from library: ");
+    outbuf_puts (out, exp->name);
+    outbuf_puts (out, "\n */\n");
     for (j = 0; j < exp->nfuncs; j++) {
       struct prx_function *func = &exp->funcs[j];
       if (func->name) {
-        fprintf (out, "void %s (void);\n",func->name);
+        outbuf_puts (out, "void ");
+        outbuf_puts (out, func->name);
+        outbuf_puts (out, " (void);\n");
       } else {
-        fprintf (out, "void %s_%08X (void);\n", exp->name, func->nid);
+        outbuf_puts (out, "void ");
+        outbuf_puts (out, exp->name);
+        outbuf_putc (out, '_');
+        outbuf_hex (out, func->nid, 8);
+        outbuf_puts (out, " (void);\n");
       }
     }
-    fprintf (out, "\n");
+    outbuf_putc (out, '\n');
   }
 
-  fprintf (out, "#endif /* __%s */\n", buffer);
+  outbuf_puts (out, "#endif /* __");
+  outbuf_puts (out, buffer);
+  outbuf_puts (out, " */\n");
 }
 
 
@@ -288,22 +399,24 @@ int print_code (struct code *c, char *prxname)
 {
   char buffer[64];
   char basename[32];
-  FILE *cout, *hout;
+  struct outbuf *cout, *hout;
+  int ret;
 
 
   get_base_name (prxname, basename, sizeof (basename));
   sprintf (buffer, "%s.c", basename);
 
-  cout = fopen (buffer, "w");
+  cout = outbuf_open (buffer);
   if (!cout) {
     xerror (__FILE__ ": can't open file for writing `%s'", buffer);
     return 0;
   }
 
   sprintf (buffer, "%s.h", basename);
-  hout = fopen (buffer, "w");
+  hout = outbuf_open (buffer);
   if (!hout) {
     xerror (__FILE__ ": can't open file for writing `%s'", buffer);
+    outbuf_close (cout);
     return 0;
   }
 
@@ -311,7 +424,7 @@ int print_code (struct code *c, char *prxname)
   print_header (hout, c, buffer);
   print_source (cout, c, buffer);
 
-  fclose (cout);
-  fclose (hout);
-  return 1;
+  ret = outbuf_close (cout);
+  ret = outbuf_close (hout) && ret;
+  return ret;
 }
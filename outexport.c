@@ -0,0 +1,489 @@
+/**
+ * Author: Humberto Naves (hsnaves@gmail.com)
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "output.h"
+#include "utils.h"
+
+/* The export is a stream of records, written in a single pass over the
+ * analysed code. In JSON Lines every record is an object in its own line
+ * with a "type" member. In the binary encoding the file starts with the
+ * magic "PDXB" and the version, and every record is its type (one byte)
+ * followed by its fields, always all of them and in the same order as in
+ * JSON. Numbers are variable length integers (7 bits per byte, the least
+ * significant first), signed ones are zigzag encoded, and the members
+ * that can be null are written as zero or as their value plus one.
+ * Strings are their length plus one (zero for null) and their bytes; in
+ * JSON the control characters and the bytes that are not well formed
+ * UTF-8 are escaped, each as the code point of the same value.
+ *
+ * The blocks are numbered by their position in the subroutine, the
+ * variables and the control structures in the order they are written;
+ * the subroutines are referenced by their address. The cross references
+ * come last, sorted by the referencing subroutine. */
+
+static const char export_magic[4] = { 'P', 'D', 'X', 'B' };
+#define EXPORT_VERSION 2
+
+enum exportrecord {
+  RECORD_MODULE = 1,
+  RECORD_IMPORT,
+  RECORD_IMPORTVAR,
+  RECORD_EXPORT,
+  RECORD_EXPORTVAR,
+  RECORD_SUBROUTINE,
+  RECORD_BLOCK,
+  RECORD_EDGE,
+  RECORD_SSAVAR,
+  RECORD_STRUCTURE,
+  RECORD_CALL,
+  RECORD_DATAREF
+};
+
+static const char *record_names[] = {
+  NULL, "module", "import", "importvar", "export", "exportvar",
+  "subroutine", "block", "edge", "ssavar", "structure", "call", "dataref"
+};
+
+static const char *block_types[] = {
+  "start", "simple", "call", "end"
+};
+
+static const char *edge_types[] = {
+  "unknown", "goto", "invalid", "continue", "break",
+  "case", "next", "ifenter", "ifexit", "return"
+};
+
+static const char *ssavar_types[] = {
+  "unknown", "local", "argument", "temp", "invalid"
+};
+
+static const char *ctrl_types[] = {
+  "loop", "switch", "if", "main"
+};
+
+struct exporter {
+  struct outbuf *out;
+  int binary;
+};
+
+
+static
+void begin_record (struct exporter *e, enum exportrecord type)
+{
+  if (e->binary) {
+    outbuf_putc (e->out, (char) type);
+  } else {
+    outbuf_puts (e->out, "{\"type\":\"");
+    outbuf_puts (e->out, record_names[type]);
+    outbuf_putc (e->out, '"');
+  }
+}
+
+static
+void end_record (struct exporter *e)
+{
+  if (!e->binary) outbuf_puts (e->out, "}\n");
+}
+
+static
+void field_name (struct exporter *e, const char *name)
+{
+  outbuf_puts (e->out, ",\"");
+  outbuf_puts (e->out, name);
+  outbuf_puts (e->out, "\":");
+}
+
+static
+void field_uint (struct exporter *e, const char *name, uint32 val)
+{
+  if (e->binary) {
+    outbuf_varint (e->out, val);
+  } else {
+    field_name (e, name);
+    outbuf_udec (e->out, val);
+  }
+}
+
+static
+void field_int (struct exporter *e, const char *name, int32 val)
+{
+  if (e->binary) {
+    if (val < 0) outbuf_varint (e->out, ~(((uint32) val) << 1));
+    else outbuf_varint (e->out, ((uint32) val) << 1);
+  } else {
+    field_name (e, name);
+    outbuf_dec (e->out, val);
+  }
+}
+
+static
+void field_bool (struct exporter *e, const char *name, int val)
+{
+  if (e->binary) {
+    outbuf_putc (e->out, val ? 1 : 0);
+  } else {
+    field_name (e, name);
+    outbuf_puts (e->out, val ? "true" : "false");
+  }
+}
+
+/* A number that can be null */
+static
+void field_opt (struct exporter *e, const char *name, int present, uint32 val)
+{
+  if (e->binary) {
+    outbuf_varint (e->out, present ? val + 1 : 0);
+  } else {
+    field_name (e, name);
+    if (present) outbuf_udec (e->out, val);
+    else outbuf_puts (e->out, "null");
+  }
+}
+
+static
+void field_enum (struct exporter *e, const char *name, const char **names, int val)
+{
+  if (e->binary) {
+    outbuf_varint (e->out, val);
+  } else {
+    field_name (e, name);
+    outbuf_putc (e->out, '"');
+    outbuf_puts (e->out, names[val]);
+    outbuf_putc (e->out, '"');
+  }
+}
+
+/* The length of the well formed UTF-8 sequence at str, or 0 */
+static
+int utf8_length (const unsigned char *str)
+{
+  unsigned char lo = 0x80, hi = 0xBF;
+  int i, len;
+
+  if (str[0] >= 0xC2 && str[0] <= 0xDF) len = 2;
+  else if (str[0] >= 0xE0 && str[0] <= 0xEF) len = 3;
+  else if (str[0] >= 0xF0 && str[0] <= 0xF4) len = 4;
+  else return 0;
+
+  /* No overlong forms, surrogates or code points past 0x10FFFF */
+  if (str[0] == 0xE0) lo = 0xA0;
+  else if (str[0] == 0xED) hi = 0x9F;
+  else if (str[0] == 0xF0) lo = 0x90;
+  else if (str[0] == 0xF4) hi = 0x8F;
+
+  for (i = 1; i < len; i++) {
+    if (str[i] < lo || str[i] > hi) return 0;
+    lo = 0x80;
+    hi = 0xBF;
+  }
+  return len;
+}
+
+static
+void field_str (struct exporter *e, const char *name, const char *str)
+{
+  const char *ptr;
+
+  if (e->binary) {
+    if (!str) {
+      outbuf_varint (e->out, 0);
+    } else {
+      outbuf_varint (e->out, strlen (str) + 1);
+      outbuf_puts (e->out, str);
+    }
+    return;
+  }
+
+  field_name (e, name);
+  if (!str) {
+    outbuf_puts (e->out, "null");
+    return;
+  }
+
+  outbuf_putc (e->out, '"');
+  for (ptr = str; *ptr; ptr++) {
+    unsigned char ch = *ptr;
+    int len;
+    if (ch == '"' || ch == '\\') {
+      outbuf_putc (e->out, '\\');
+      outbuf_putc (e->out, ch);
+    } else if (ch >= 0x80 && (len = utf8_length ((const unsigned char *) ptr)) != 0) {
+      outbuf_write (e->out, ptr, len);
+      ptr += len - 1;
+    } else if (ch < 32 || ch >= 0x80) {
+      outbuf_puts (e->out, "\\u00");
+      outbuf_hex (e->out, ch, 2);
+    } else {
+      outbuf_putc (e->out, ch);
+    }
+  }
+  outbuf_putc (e->out, '"');
+}
+
+
+static
+void export_module (struct exporter *e, struct code *c)
+{
+  struct prx_modinfo *info = c->file->modinfo;
+  uint32 i, j;
+
+  begin_record (e, RECORD_MODULE);
+  field_str (e, "name", info->name);
+  field_uint (e, "version", info->version);
+  field_uint (e, "attributes", info->attributes);
+  field_uint (e, "gp", info->gp);
+  field_uint (e, "baddr", c->baddr);
+  field_uint (e, "numopc", c->numopc);
+  end_record (e);
+
+  for (i = 0; i < info->numimports; i++) {
+    struct prx_import *imp = &info->imports[i];
+    for (j = 0; j < imp->nfuncs; j++) {
+      struct prx_function *func = &imp->funcs[j];
+      begin_record (e, RECORD_IMPORT);
+      field_str (e, "library", imp->name);
+      field_uint (e, "nid", func->nid);
+      field_str (e, "name", func->name);
+      field_uint (e, "address", func->vaddr);
+      field_int (e, "numargs", func->numargs);
+      end_record (e);
+    }
+    for (j = 0; j < imp->nvars; j++) {
+      struct prx_variable *var = &imp->vars[j];
+      begin_record (e, RECORD_IMPORTVAR);
+      field_str (e, "library", imp->name);
+      field_uint (e, "nid", var->nid);
+      field_str (e, "name", var->name);
+      field_uint (e, "address", var->vaddr);
+      end_record (e);
+    }
+  }
+
+  for (i = 0; i < info->numexports; i++) {
+    struct prx_export *exp = &info->exports[i];
+    for (j = 0; j < exp->nfuncs; j++) {
+      struct prx_function *func = &exp->funcs[j];
+      begin_record (e, RECORD_EXPORT);
+      field_str (e, "library", exp->name);
+      field_uint (e, "nid", func->nid);
+      field_str (e, "name", func->name);
+      field_uint (e, "address", func->vaddr);
+      field_int (e, "numargs", func->numargs);
+      end_record (e);
+    }
+    for (j = 0; j < exp->nvars; j++) {
+      struct prx_variable *var = &exp->vars[j];
+      begin_record (e, RECORD_EXPORTVAR);
+      field_str (e, "library", exp->name);
+      field_uint (e, "nid", var->nid);
+      field_str (e, "name", var->name);
+      field_uint (e, "address", var->vaddr);
+      end_record (e);
+    }
+  }
+}
+
+/* Writes st and the parents not written yet, numbering them in the
+ * mark field, which is zero for all the structures outside the export */
+static
+void export_structure (struct exporter *e, struct subroutine *sub, struct ctrlstruct *st, int *count)
+{
+  if (!st || st->mark) return;
+  st->mark = ++(*count);
+
+  while (st) {
+    struct ctrlstruct *parent = st->parent;
+    int written = (parent && parent->mark);
+
+    if (parent && !written) parent->mark = ++(*count);
+
+    begin_record (e, RECORD_STRUCTURE);
+    field_uint (e, "sub", sub->begin->address);
+    field_uint (e, "id", st->mark - 1);
+    field_enum (e, "kind", ctrl_types, st->type);
+    field_uint (e, "start", st->start->mark1);
+    field_opt (e, "end", st->end != NULL, st->end ? st->end->mark1 : 0);
+    field_opt (e, "parent", parent != NULL, parent ? parent->mark - 1 : 0);
+    field_bool (e, "endgoto", st->hasendgoto);
+    field_bool (e, "endfollow", st->endfollow);
+    end_record (e);
+
+    st = written ? NULL : parent;
+  }
+}
+
+static
+void clear_structures (struct ctrlstruct *st)
+{
+  for (; st && st->mark; st = st->parent)
+    st->mark = 0;
+}
+
+static
+void export_blocks (struct exporter *e, struct subroutine *sub)
+{
+  element el, ref;
+  int count = 0;
+
+  el = list_head (sub->blocks);
+  while (el) {
+    struct basicblock *block = element_getvalue (el);
+    block->mark1 = count++;
+    el = element_next (el);
+  }
+
+  el = list_head (sub->blocks);
+  while (el) {
+    struct basicblock *block = element_getvalue (el);
+    int simple = (block->type == BLOCK_SIMPLE);
+    int call = (block->type == BLOCK_CALL && block->info.call.calltarget);
+
+    begin_record (e, RECORD_BLOCK);
+    field_uint (e, "sub", sub->begin->address);
+    field_uint (e, "id", block->mark1);
+    field_enum (e, "kind", block_types, block->type);
+    field_opt (e, "begin", simple, simple ? block->info.simple.begin->address : 0);
+    field_opt (e, "end", simple, simple ? block->info.simple.end->address : 0);
+    field_opt (e, "call", call, call ? block->info.call.calltarget->begin->address : 0);
+    field_int (e, "dfsnum", block->node.dfsnum);
+    end_record (e);
+    el = element_next (el);
+  }
+
+  el = list_head (sub->blocks);
+  while (el) {
+    struct basicblock *block = element_getvalue (el);
+    ref = list_head (block->outrefs);
+    while (ref) {
+      struct basicedge *edge = element_getvalue (ref);
+      begin_record (e, RECORD_EDGE);
+      field_uint (e, "sub", sub->begin->address);
+      field_uint (e, "from", edge->from->mark1);
+      field_uint (e, "to", edge->to->mark1);
+      field_enum (e, "edgetype", edge_types, edge->type);
+      end_record (e);
+      ref = element_next (ref);
+    }
+    el = element_next (el);
+  }
+
+  count = 0;
+  el = list_head (sub->blocks);
+  while (el) {
+    struct basicblock *block = element_getvalue (el);
+    export_structure (e, sub, block->st, &count);
+    export_structure (e, sub, block->ifst, &count);
+    export_structure (e, sub, block->loopst, &count);
+    el = element_next (el);
+  }
+
+  el = list_head (sub->blocks);
+  while (el) {
+    struct basicblock *block = element_getvalue (el);
+    clear_structures (block->st);
+    clear_structures (block->ifst);
+    clear_structures (block->loopst);
+    el = element_next (el);
+  }
+}
+
+static
+void export_ssavars (struct exporter *e, struct subroutine *sub)
+{
+  element el;
+  uint32 count = 0;
+
+  el = list_head (sub->ssavars);
+  while (el) {
+    struct ssavar *var = element_getvalue (el);
+    int isreg = (var->name.type == VAL_REGISTER);
+    int isconst = (CONST_TYPE (var->status) == VAR_STAT_CONSTANT);
+
+    begin_record (e, RECORD_SSAVAR);
+    field_uint (e, "sub", sub->begin->address);
+    field_uint (e, "id", count++);
+    field_enum (e, "kind", ssavar_types, var->type);
+    field_opt (e, "register", isreg, isreg ? var->name.val.intval : 0);
+    field_opt (e, "local", var->type == SSAVAR_LOCAL, var->info);
+    field_opt (e, "def", var->def != NULL, var->def ? var->def->block->mark1 : 0);
+    field_uint (e, "uses", list_size (var->uses));
+    field_opt (e, "constant", isconst, var->value);
+    end_record (e);
+    el = element_next (el);
+  }
+}
+
+static
+void export_subroutine (struct exporter *e, struct subroutine *sub)
+{
+  const char *name = NULL;
+
+  if (sub->export) name = sub->export->name;
+  else if (sub->import) name = sub->import->name;
+
+  begin_record (e, RECORD_SUBROUTINE);
+  field_uint (e, "address", sub->begin->address);
+  field_uint (e, "end", sub->end->address);
+  field_str (e, "name", name);
+  field_bool (e, "import", sub->import != NULL);
+  field_bool (e, "export", sub->export != NULL);
+  field_int (e, "numargs", sub->numregargs);
+  field_int (e, "numret", sub->numregout);
+  field_uint (e, "stacksize", sub->stacksize);
+  field_bool (e, "error", sub->haserror);
+  end_record (e);
+
+  if (sub->import || sub->haserror) return;
+  if (sub->blocks) export_blocks (e, sub);
+  if (sub->ssavars) export_ssavars (e, sub);
+}
+
+static
+void export_xrefs (struct exporter *e, enum exportrecord type, struct xref *refs, uint32 num)
+{
+  uint32 i;
+
+  for (i = 0; i < num; i++) {
+    begin_record (e, type);
+    field_uint (e, "from", refs[i].from);
+    field_uint (e, "to", refs[i].to);
+    field_uint (e, "site", refs[i].site);
+    end_record (e);
+  }
+}
+
+int print_export (struct code *c, char *filename, int binary)
+{
+  struct exporter e;
+  element el;
+
+  e.out = outbuf_open (filename);
+  if (!e.out) {
+    xerror (__FILE__ ": can't open file for writing `%s'", filename);
+    return 0;
+  }
+  e.binary = binary;
+
+  if (binary) {
+    outbuf_write (e.out, export_magic, sizeof (export_magic));
+    outbuf_varint (e.out, EXPORT_VERSION);
+  }
+
+  export_module (&e, c);
+
+  el = list_head (c->subroutines);
+  while (el) {
+    struct subroutine *sub = element_getvalue (el);
+    export_subroutine (&e, sub);
+    el = element_next (el);
+  }
+
+  export_xrefs (&e, RECORD_CALL, c->xrefs.calls, c->xrefs.numcalls);
+  export_xrefs (&e, RECORD_DATAREF, c->xrefs.datarefs, c->xrefs.numdatarefs);
+
+  return outbuf_close (e.out);
+}
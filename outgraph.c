@@ -3,12 +3,14 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "output.h"
+#include "threads.h"
 #include "utils.h"
 
 static
-void print_structures (FILE *out, struct basicblock *block)
+void print_structures (struct outbuf *out, struct basicblock *block)
 {
   struct ctrlstruct *st = block->st;
   int count = 0;
@@ -16,38 +18,43 @@ void print_structures (FILE *out, struct basicblock *block)
   while (st) {
     switch (st->type) {
     case CONTROL_IF:
-      fprintf (out, "IF");
+      outbuf_puts (out, "IF");
       break;
     case CONTROL_MAIN:
-      fprintf (out, "MAIN");
+      outbuf_puts (out, "MAIN");
       break;
     case CONTROL_LOOP:
-      fprintf (out, "LOOP");
+      outbuf_puts (out, "LOOP");
       break;
     case CONTROL_SWITCH:
-      fprintf (out, "SWITCH");
+      outbuf_puts (out, "SWITCH");
       break;
     }
-    fprintf (out, " start %d", st->start->node.dfsnum);
-    if (st->end)
-      fprintf (out, " end %d", st->end->node.dfsnum);
+    outbuf_puts (out, " start ");
+    outbuf_dec (out, st->start->node.dfsnum);
+    if (st->end) {
+      outbuf_puts (out, " end ");
+      outbuf_dec (out, st->end->node.dfsnum);
+    }
     if (st->hasendgoto)
-      fprintf (out, " goto");
+      outbuf_puts (out, " goto");
     if (st->endfollow)
-      fprintf (out, " endfollow");
+      outbuf_puts (out, " endfollow");
 
     switch (st->type) {
     case CONTROL_IF:
-      fprintf (out, " %s", block->blockcond ? "TRUE" : "FALSE");
+      outbuf_putc (out, ' ');
+      outbuf_puts (out, block->blockcond ? "TRUE" : "FALSE");
       break;
     case CONTROL_MAIN:
       break;
     case CONTROL_LOOP:
       break;
     case CONTROL_SWITCH:
-      fprintf (out, " %d", block->blockcond);
+      outbuf_putc (out, ' ');
+      outbuf_dec (out, block->blockcond);
     }
-    fprintf (out, "\\l");
+    outbuf_puts (out, "\\l");
 
     st = st->parent;
     if (++count > 100) break;
@@ -55,19 +62,20 @@ void print_structures (FILE *out, struct basicblock *block)
 }
 
 static
-void print_block_code (FILE *out, struct basicblock *block)
+void print_block_code (struct outbuf *out, struct basicblock *block)
 {
   if (block->type == BLOCK_SIMPLE) {
     struct location *loc;
     for (loc = block->info.simple.begin; ; loc++) {
-      fprintf (out, "%s\\l", allegrex_disassemble (loc->opc, loc->address, FALSE));
+      print_disassembly (out, loc, FALSE);
+      outbuf_puts (out, "\\l");
       if (loc == block->info.simple.end) break;
     }
   }
 }
 
 static
-void print_dominator (FILE *out, struct basicblock *block, int reverse, const char *color)
+void print_dominator (struct outbuf *out, struct basicblock *block, int reverse, const char *color)
 {
   struct basicblock *dominator;
 
@@ -78,17 +86,24 @@ void print_dominator (FILE *out, struct basicblock *block, int reverse, const ch
     if (list_size (block->inrefs) <= 1) return;
     dominator = element_getvalue (block->node.dominator->blockel);
   }
-  fprintf (out, "    %3d -> %3d [color=%s];\n",
-      block->node.dfsnum, dominator->node.dfsnum, color);
+  outbuf_puts (out, "    ");
+  outbuf_decw (out, block->node.dfsnum, 3);
+  outbuf_puts (out, " -> ");
+  outbuf_decw (out, dominator->node.dfsnum, 3);
+  outbuf_puts (out, " [color=");
+  outbuf_puts (out, color);
+  outbuf_puts (out, "];\n");
 }
 
 static
-void print_frontier (FILE *out, struct basicblock *block, list frontier, const char *color)
+void print_frontier (struct outbuf *out, struct basicblock *block, list frontier, const char *color)
 {
   element ref;
   if (list_size (frontier) == 0) return;
 
-  fprintf (out, "    %3d -> { ", block->node.dfsnum);
+  outbuf_puts (out, "    ");
+  outbuf_decw (out, block->node.dfsnum, 3);
+  outbuf_puts (out, " -> { ");
   ref = list_head (frontier);
   while (ref) {
     struct basicblocknode *refnode;
@@ -97,53 +112,77 @@ void print_frontier (FILE *out, struct basicblock *block, list frontier, const c
     refnode = element_getvalue (ref);
     refblock = element_getvalue (refnode->blockel);
 
-    fprintf (out, "%3d ", refblock->node.dfsnum);
+    outbuf_decw (out, refblock->node.dfsnum, 3);
+    outbuf_putc (out, ' ');
     ref = element_next (ref);
   }
-  fprintf (out, " } [color=%s];\n", color);
+  outbuf_puts (out, " } [color=");
+  outbuf_puts (out, color);
+  outbuf_puts (out, "];\n");
 }
 
+/* The reverse trees are only kept while structuring, so they are built
+ * again when printed */
 static
-void print_subroutine_graph (FILE *out, struct code *c, struct subroutine *sub)
+void build_reverse (struct subroutine *sub)
+{
+  if (g_printoptions & (OUT_PRINT_RDFS | OUT_PRINT_RDOMINATOR | OUT_PRINT_RFRONTIER))
+    cfg_reverse (sub, g_printoptions & OUT_PRINT_RFRONTIER);
+}
+
+void print_subroutine_graph (struct outbuf *out, struct code *c, struct subroutine *sub)
 {
   struct basicblock *block;
   element el, ref;
 
-  fprintf (out, "digraph ");
+  build_reverse (sub);
+
+  outbuf_puts (out, "digraph ");
   print_subroutine_name (out, sub);
-  fprintf (out, " {\n    rankdir=LR;\n");
+  outbuf_puts (out, " {\n    rankdir=LR;\n");
 
   el = list_head (sub->blocks);
 
   while (el) {
     block = element_getvalue (el);
 
-    fprintf (out, "    %3d ", block->node.dfsnum);
-    fprintf (out, "[label=\"");
+    outbuf_puts (out, "    ");
+    outbuf_decw (out, block->node.dfsnum, 3);
+    outbuf_putc (out, ' ');
+    outbuf_puts (out, "[label=\"");
 
     if (g_printoptions & OUT_PRINT_STRUCTURES)
       print_structures (out, block);
 
-    if (g_printoptions & OUT_PRINT_DFS)
-      fprintf (out, "(%d) ", block->node.dfsnum);
+    if (g_printoptions & OUT_PRINT_DFS) {
+      outbuf_putc (out, '(');
+      outbuf_dec (out, block->node.dfsnum);
+      outbuf_puts (out, ") ");
+    }
 
-    if (g_printoptions & OUT_PRINT_RDFS)
-      fprintf (out, "(%d) ", block->revnode.dfsnum);
+    if (g_printoptions & OUT_PRINT_RDFS) {
+      outbuf_putc (out, '(');
+      outbuf_dec (out, block->revnode.dfsnum);
+      outbuf_puts (out, ") ");
+    }
 
     switch (block->type) {
-    case BLOCK_START:  fprintf (out, "Start");   break;
-    case BLOCK_END:    fprintf (out, "End");       break;
-    case BLOCK_CALL:   fprintf (out, "Call");     break;
-    case BLOCK_SIMPLE: fprintf (out, "0x%08X-0x%08X",
-        block->info.simple.begin->address, block->info.simple.end->address);
+    case BLOCK_START:  outbuf_puts (out, "Start"); break;
+    case BLOCK_END:    outbuf_puts (out, "End");   break;
+    case BLOCK_CALL:   outbuf_puts (out, "Call");  break;
+    case BLOCK_SIMPLE:
+      outbuf_puts (out, "0x");
+      outbuf_hex (out, block->info.simple.begin->address, 8);
+      outbuf_puts (out, "-0x");
+      outbuf_hex (out, block->info.simple.end->address, 8);
     }
-    if (block->status & BLOCK_STAT_HASLABEL) fprintf (out, "(*)");
-    fprintf (out, "\\l");
+    if (block->status & BLOCK_STAT_HASLABEL) outbuf_puts (out, "(*)");
+    outbuf_puts (out, "\\l");
 
     if (g_printoptions & OUT_PRINT_CODE)
       print_block_code (out, block);
 
-    fprintf (out, "\"];\n");
+    outbuf_puts (out, "\"];\n");
 
 
     if (g_printoptions & OUT_PRINT_DOMINATOR)
@@ -166,75 +205,112 @@ void print_subroutine_graph (FILE *out, struct code *c, struct subroutine *sub)
         struct basicblock *refblock;
         edge = element_getvalue (ref);
         refblock = edge->to;
-        fprintf (out, "    %3d -> %3d ", block->node.dfsnum, refblock->node.dfsnum);
+        outbuf_puts (out, "    ");
+        outbuf_decw (out, block->node.dfsnum, 3);
+        outbuf_puts (out, " -> ");
+        outbuf_decw (out, refblock->node.dfsnum, 3);
+        outbuf_putc (out, ' ');
         if (ref != list_head (block->outrefs))
-          fprintf (out, "[arrowtail=dot]");
+          outbuf_puts (out, "[arrowtail=dot]");
 
         if (element_getvalue (refblock->node.parent->blockel) == block) {
-          fprintf (out, "[style=bold]");
+          outbuf_puts (out, "[style=bold]");
         } else if (block->node.dfsnum >= refblock->node.dfsnum) {
-          fprintf (out, "[color=red]");
+          outbuf_puts (out, "[color=red]");
         }
         if (g_printoptions & OUT_PRINT_EDGE_TYPES) {
-          fprintf (out, "[label=\"");
+          outbuf_puts (out, "[label=\"");
           switch (edge->type) {
-          case EDGE_UNKNOWN:  fprintf (out, "UNK");      break;
-          case EDGE_CONTINUE: fprintf (out, "CONTINUE"); break;
-          case EDGE_BREAK:    fprintf (out, "BREAK");    break;
-          case EDGE_NEXT:     fprintf (out, "NEXT");     break;
-          case EDGE_INVALID:  fprintf (out, "INVALID");  break;
-          case EDGE_GOTO:     fprintf (out, "GOTO");     break;
-          case EDGE_CASE:     fprintf (out, "CASE");     break;
-          case EDGE_IFENTER:  fprintf (out, "IFENTER");  break;
-          case EDGE_IFEXIT:   fprintf (out, "IFEXIT");   break;
-          case EDGE_RETURN:   fprintf (out, "RETURN");   break;
+          case EDGE_UNKNOWN:  outbuf_puts (out, "UNK");      break;
+          case EDGE_CONTINUE: outbuf_puts (out, "CONTINUE"); break;
+          case EDGE_BREAK:    outbuf_puts (out, "BREAK");    break;
+          case EDGE_NEXT:     outbuf_puts (out, "NEXT");     break;
+          case EDGE_INVALID:  outbuf_puts (out, "INVALID");  break;
+          case EDGE_GOTO:     outbuf_puts (out, "GOTO");     break;
+          case EDGE_CASE:     outbuf_puts (out, "CASE");     break;
+          case EDGE_IFENTER:  outbuf_puts (out, "IFENTER");  break;
+          case EDGE_IFEXIT:   outbuf_puts (out, "IFEXIT");   break;
+          case EDGE_RETURN:   outbuf_puts (out, "RETURN");   break;
           }
-          fprintf (out, "\"]");
+          outbuf_puts (out, "\"]");
         }
-        fprintf (out, " ;\n");
+        outbuf_puts (out, " ;\n");
         ref = element_next (ref);
       }
     }
     el = element_next (el);
   }
-  fprintf (out, "}\n");
+  outbuf_puts (out, "}\n");
 }
 
 
-int print_graph (struct code *c, char *prxname)
+struct graphjob {
+  struct code *c;
+  struct subroutine **subs;
+  int *results;
+  char basename[32];
+};
+
+static
+void print_graph_job (void *arg, uint32 index)
 {
+  struct graphjob *job = arg;
+  struct subroutine *sub = job->subs[index];
+  struct outbuf *fp;
   char buffer[128];
-  char basename[32];
+
+  if (sub->export) {
+    if (sub->export->name) {
+      sprintf (buffer, "%s_%-.64s.dot", job->basename, sub->export->name);
+    } else
+      sprintf (buffer, "%s_nid_%08X.dot", job->basename, sub->export->nid);
+  } else
+    sprintf (buffer, "%s_%08X.dot", job->basename, sub->begin->address);
+  fp = outbuf_open (buffer);
+  if (!fp) {
+    xerror (__FILE__ ": can't open file for writing `%s'", buffer);
+    job->results[index] = 0;
+  } else {
+    print_subroutine_graph (fp, job->c, sub);
+    job->results[index] = outbuf_close (fp);
+  }
+}
+
+int print_graph (struct code *c, char *prxname)
+{
+  struct graphjob job;
   element el;
-  FILE *fp;
+  uint32 i, count = 0;
   int ret = 1;
 
-  get_base_name (prxname, basename, sizeof (basename));
+  get_base_name (prxname, job.basename, sizeof (job.basename));
+  job.c = c;
+  job.subs = (struct subroutine **)
+    xmalloc ((list_size (c->subroutines) + 1) * sizeof (struct subroutine *));
 
   el = list_head (c->subroutines);
   while (el) {
     struct subroutine *sub = element_getvalue (el);
+    if (c->function && sub != c->function) {
+      el = element_next (el);
+      continue;
+    }
     if (!sub->haserror && !sub->import) {
-      if (sub->export) {
-        if (sub->export->name) {
-          sprintf (buffer, "%s_%-.64s.dot", basename, sub->export->name);
-        } else
-          sprintf (buffer, "%s_nid_%08X.dot", basename, sub->export->nid);
-      } else
-        sprintf (buffer, "%s_%08X.dot", basename, sub->begin->address);
-      fp = fopen (buffer, "w");
-      if (!fp) {
-        xerror (__FILE__ ": can't open file for writing `%s'", buffer);
-        ret = 0;
-      } else {
-        print_subroutine_graph (fp, c, sub);
-        fclose (fp);
-      }
+      /* Before the jobs, as they would share the list pool */
+      build_reverse (sub);
+      job.subs[count++] = sub;
     } else {
       if (sub->haserror) report ("Skipping subroutine at 0x%08X\n", sub->begin->address);
     }
     el = element_next (el);
   }
 
+  job.results = (int *) xmalloc ((count + 1) * sizeof (int));
+  parallel_for (count, &print_graph_job, &job);
+  for (i = 0; i < count; i++)
+    if (!job.results[i]) ret = 0;
+
+  free (job.results);
+  free (job.subs);
   return ret;
 }
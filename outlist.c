@@ -0,0 +1,179 @@
+/**
+ * Author: Humberto Naves (hsnaves@gmail.com)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "output.h"
+#include "allegrex.h"
+#include "utils.h"
+
+/* The listing is a linear sweep over the code segment, that needs no
+ * analysis: every opcode is disassembled straight from the relocated
+ * program data. The subroutine starts are the imports, the exports and
+ * the targets of the jal instructions, found in a first sweep. */
+
+struct listing {
+  struct prx *p;
+  const uint8 *code;
+  uint32 address, numopc;
+  struct prx_function **funcs;   /* The import or export at each opcode */
+  uint32 *starts;                /* Bitmap of the subroutine starts */
+};
+
+static
+uint32 opcode_at (struct listing *l, uint32 index)
+{
+  return read_uint32_le (&l->code[index << 2]);
+}
+
+static
+void mark_function (struct listing *l, struct prx_function *func)
+{
+  uint32 index = (func->vaddr - l->address) >> 2;
+  if (func->vaddr < l->address || index >= l->numopc) return;
+  l->funcs[index] = func;
+  BIT_SET (l->starts, index);
+}
+
+static
+void mark_starts (struct listing *l)
+{
+  struct prx_modinfo *info = l->p->modinfo;
+  uint32 i, j;
+
+  for (i = 0; i < info->numexports; i++)
+    for (j = 0; j < info->exports[i].nfuncs; j++)
+      mark_function (l, &info->exports[i].funcs[j]);
+
+  for (i = 0; i < info->numimports; i++)
+    for (j = 0; j < info->imports[i].nfuncs; j++)
+      mark_function (l, &info->imports[i].funcs[j]);
+
+  for (i = 0; i < l->numopc; i++) {
+    uint32 opc = opcode_at (l, i);
+    if ((opc >> 26) == 3) {
+      uint32 target = ((opc & 0x3FFFFFF) << 2) | ((l->address + (i << 2)) & 0xF0000000);
+      uint32 index = (target - l->address) >> 2;
+      if (target >= l->address && index < l->numopc)
+        BIT_SET (l->starts, index);
+    }
+  }
+}
+
+static
+void print_function_name (struct outbuf *out, struct prx_function *func)
+{
+  if (func->name) {
+    outbuf_puts (out, func->name);
+  } else {
+    outbuf_puts (out, func->libname);
+    outbuf_putc (out, '_');
+    outbuf_hex (out, func->nid, 8);
+  }
+}
+
+/* Prints the name of the function at address, if there is one */
+static
+void print_target (struct outbuf *out, struct listing *l, uint32 address)
+{
+  uint32 index = (address - l->address) >> 2;
+
+  if (address < l->address || index >= l->numopc || (address & 3)) return;
+  if (l->funcs[index]) {
+    outbuf_putc (out, ' ');
+    print_function_name (out, l->funcs[index]);
+  } else if (IS_BIT_SET (l->starts, index)) {
+    outbuf_puts (out, " sub_");
+    outbuf_hex (out, address, 5);
+  }
+}
+
+static
+void print_lines (struct outbuf *out, struct listing *l)
+{
+  char buffer[256];
+  uint32 i, pos = 0;
+  int len;
+
+  for (i = 0; i < l->numopc; i++) {
+    uint32 address = l->address + (i << 2);
+    uint32 opc = opcode_at (l, i);
+
+    if (IS_BIT_SET (l->starts, i)) {
+      outbuf_putc (out, '\n');
+      if (l->funcs[i]) {
+        print_function_name (out, l->funcs[i]);
+      } else {
+        outbuf_puts (out, "sub_");
+        outbuf_hex (out, address, 5);
+      }
+      outbuf_puts (out, ":\n");
+    }
+
+    len = allegrex_disassemble_r (opc, address, TRUE, buffer, sizeof (buffer));
+    outbuf_write (out, buffer, len);
+
+    while (pos < l->p->relocnum && l->p->relocsbyaddr[pos].vaddr < address) pos++;
+    if (pos < l->p->relocnum && l->p->relocsbyaddr[pos].vaddr == address) {
+      outbuf_puts (out, "  ; reloc 0x");
+      outbuf_hex (out, l->p->relocsbyaddr[pos].target, 8);
+      print_target (out, l, l->p->relocsbyaddr[pos].target);
+    } else if ((opc >> 26) == 2 || (opc >> 26) == 3) {
+      uint32 target = ((opc & 0x3FFFFFF) << 2) | (address & 0xF0000000);
+      uint32 index = (target - l->address) >> 2;
+      if (target >= l->address && index < l->numopc && l->funcs[index]) {
+        outbuf_puts (out, "  ;");
+        print_target (out, l, target);
+      }
+    }
+    outbuf_putc (out, '\n');
+  }
+}
+
+int print_listing (struct prx *p, char *prxname)
+{
+  char buffer[64];
+  char basename[32];
+  struct listing l;
+  struct outbuf *out;
+  uint32 size;
+
+  l.p = p;
+  l.address = p->programs->vaddr;
+  l.code = p->programs->data;
+  size = p->modinfo->expvaddr - 4;
+  if ((size & 0x03) || (l.address & 0x03)) {
+    error (__FILE__ ": size/address is not multiple of 4");
+    return 0;
+  }
+  l.numopc = size >> 2;
+  if (!l.numopc) {
+    error (__FILE__ ": empty code segment");
+    return 0;
+  }
+
+  get_base_name (prxname, basename, sizeof (basename));
+  sprintf (buffer, "%s.lst", basename);
+  out = outbuf_open (buffer);
+  if (!out) {
+    xerror (__FILE__ ": can't open file for writing `%s'", buffer);
+    return 0;
+  }
+
+  prx_resolve_relocs (p, l.address, size);
+
+  l.funcs = (struct prx_function **) xmalloc (l.numopc * sizeof (struct prx_function *));
+  memset (l.funcs, 0, l.numopc * sizeof (struct prx_function *));
+  l.starts = (uint32 *) xmalloc (((l.numopc + 31) >> 5) * sizeof (uint32));
+  memset (l.starts, 0, ((l.numopc + 31) >> 5) * sizeof (uint32));
+
+  mark_starts (&l);
+  print_lines (out, &l);
+
+  free (l.funcs);
+  free (l.starts);
+  return outbuf_close (out);
+}
@@ -9,6 +9,9 @@
 #include "allegrex.h"
 #include "utils.h"
 
+int g_verbosity = 0;
+int g_printoptions = 0;
+
 void get_base_name (char *filename, char *basename, size_t len)
 {
   char *temp;
@@ -22,104 +25,94 @@ void get_base_name (char *filename, char *basename, size_t len)
   if (temp) *temp = '\0';
 }
 
-void ident_line (FILE *out, int size)
+void ident_line (struct outbuf *out, int size)
 {
   int i;
   for (i = 0; i < size; i++)
-    fprintf (out, "  ");
+    outbuf_puts (out, "  ");
 }
 
+void print_disassembly (struct outbuf *out, struct location *loc, int prtall)
+{
+  char buffer[256];
+  int len = allegrex_disassemble_r (loc->opc, loc->address, prtall, buffer, sizeof (buffer));
+  outbuf_write (out, buffer, len);
+}
 
-void print_subroutine_name (FILE *out, struct subroutine *sub)
+
+void print_subroutine_name (struct outbuf *out, struct subroutine *sub)
 {
   if (sub->export) {
     if (sub->export->name) {
-      fprintf (out, "%s", sub->export->name);
+      outbuf_puts (out, sub->export->name);
     } else {
-      fprintf (out, "%s_%08X", sub->export->libname, sub->export->nid);
+      outbuf_puts (out, sub->export->libname);
+      outbuf_putc (out, '_');
+      outbuf_hex (out, sub->export->nid, 8);
     }
   } else if (sub->import) {
     if (sub->import->name) {
-      fprintf (out, "%s", sub->import->name);
+      outbuf_puts (out, sub->import->name);
     } else {
-      fprintf (out, "%s_%08X", sub->import->libname, sub->import->nid);
+      outbuf_puts (out, sub->import->libname);
+      outbuf_putc (out, '_');
+      outbuf_hex (out, sub->import->nid, 8);
     }
   } else {
-    fprintf (out, "sub_%05X", sub->begin->address);
+    outbuf_puts (out, "sub_");
+    outbuf_hex (out, sub->begin->address, 5);
   }
 }
 
-void print_subroutine_declaration (FILE *out, struct subroutine *sub)
+void print_subroutine_declaration (struct outbuf *out, struct subroutine *sub)
 {
   int i;
   if (sub->numregout > 0)
-    fprintf (out, "int ");
+    outbuf_puts (out, "int ");
   else
-    fprintf (out, "void ");
+    outbuf_puts (out, "void ");
 
   print_subroutine_name (out, sub);
 
-  fprintf (out, " (");
+  outbuf_puts (out, " (");
   for (i = 0; i < sub->numregargs; i++) {
-    if (i != 0) fprintf (out, ", ");
-    fprintf (out, "int arg%d", i + 1);
+    if (i != 0) outbuf_puts (out, ", ");
+    outbuf_puts (out, "int arg");
+    outbuf_dec (out, i + 1);
   }
-  fprintf (out, ")");
+  outbuf_putc (out, ')');
 }
 
 #define ISSPACE(x) ((x) == '\t' || (x) == '\r' || (x) == '\n' || (x) == '\v' || (x) == '\f')
 
+/* Prints the string at vaddr, if there is one there */
 static
-int valid_string (struct prx *file, uint32 vaddr)
+int print_string (struct outbuf *out, struct prx *file, uint32 vaddr)
 {
   uint32 off = prx_translate (file, vaddr);
-  int len = 0;
-  if (off) {
-    for (; off < file->size; off++) {
-      uint8 ch = file->data[off];
-      if (ch == '\t' || ch == '\r' || ch == '\n' || ch == '\v' ||
-          ch == '\f' || (ch >= 32 && ch < 127))
-        len++;
-      else
-        break;
-    }
-  }
-  return len > 3;
-}
+  const char *text;
+  uint32 len;
 
-static
-void print_string (FILE *out, struct prx *file, uint32 vaddr)
-{
-  uint32 off = prx_translate (file, vaddr);
+  if (!off || !strindex_find (prx_strings (file), off, &text, &len))
+    return FALSE;
 
-  fprintf (out, "\"");
-  for (; off < file->size; off++) {
-    uint8 ch = file->data[off];
-    if (ch >= 32 && ch < 127) {
-      fprintf (out, "%c", ch);
-    } else {
-      switch (ch) {
-      case '\t': fprintf (out, "\\t"); break;
-      case '\r': fprintf (out, "\\r"); break;
-      case '\n': fprintf (out, "\\n"); break;
-      case '\v': fprintf (out, "\\v"); break;
-      case '\f': fprintf (out, "\\f"); break;
-      default:
-        fprintf (out, "\"");
-        return;
-      }
-    }
-  }
+  outbuf_putc (out, '"');
+  outbuf_write (out, text, len);
+  outbuf_putc (out, '"');
+  return TRUE;
 }
 
 
-void print_value (FILE *out, struct value *val, int options)
+void print_value (struct outbuf *out, struct value *val, int options)
 {
   struct ssavar *var;
   int isstring = FALSE;
 
   switch (val->type) {
-  case VAL_CONSTANT: fprintf (out, "0x%08X", val->val.intval); break;
+  case VAL_CONSTANT:
+    outbuf_puts (out, "0x");
+    outbuf_hex (out, val->val.intval, 8);
+    break;
   case VAL_SSAVAR:
     var = val->val.variable;
     if (CONST_TYPE (var->status) != VAR_STAT_NOTCONSTANT &&
@@ -127,90 +120,96 @@ void print_value (FILE *out, struct value *val, int options)
       struct prx *file;
       file = var->def->block->sub->code->file;
       if (var->def->status & OP_STAT_HASRELOC) {
-        isstring = valid_string (file, var->value);
+        isstring = print_string (out, file, var->value);
+      }
+      if (!isstring) {
+        outbuf_puts (out, "0x");
+        outbuf_hex (out, var->value, 8);
       }
-      if (isstring)
-        print_string (out, file, var->value);
-      else
-        fprintf (out, "0x%08X", var->value);
 
     } else {
       switch (var->type) {
       case SSAVAR_ARGUMENT:
         if (var->name.val.intval >= REGISTER_GPR_A0 &&
             var->name.val.intval <= REGISTER_GPR_T3) {
-          fprintf (out, "arg%d", var->name.val.intval - REGISTER_GPR_A0 + 1);
+          outbuf_puts (out, "arg");
+          outbuf_dec (out, var->name.val.intval - REGISTER_GPR_A0 + 1);
         } else {
           print_value (out, &var->name, options);
         }
         break;
       case SSAVAR_LOCAL:
-        fprintf (out, "var%d", var->info);
+        outbuf_puts (out, "var");
+        outbuf_dec (out, var->info);
         break;
       case SSAVAR_TEMP:
         options = OPTS_NORESULT;
         if (((struct value *) list_headvalue (var->def->results))->val.variable != var)
           options |= OPTS_SECONDRESULT;
         if (var->def->type != OP_MOVE)
-          fprintf (out, "(");
+          outbuf_putc (out, '(');
         print_operation (out, var->def, 0, options);
         if (var->def->type != OP_MOVE)
-          fprintf (out, ")");
+          outbuf_putc (out, ')');
         break;
       default:
         print_value (out, &var->name, options);
-        fprintf (out, "/* Invalid block %d %d */",
-            var->def->block->node.dfsnum,
-            var->def->type);
+        outbuf_puts (out, "/* Invalid block ");
+        outbuf_dec (out, var->def->block->node.dfsnum);
+        outbuf_putc (out, ' ');
+        outbuf_dec (out, var->def->type);
+        outbuf_puts (out, " */");
         break;
       }
     }
     break;
   case VAL_REGISTER:
-    if (val->val.intval == REGISTER_HI)      fprintf (out, "hi");
-    else if (val->val.intval == REGISTER_LO) fprintf (out, "lo");
-    else fprintf (out, "%s", gpr_names[val->val.intval]);
+    if (val->val.intval == REGISTER_HI)      outbuf_puts (out, "hi");
+    else if (val->val.intval == REGISTER_LO) outbuf_puts (out, "lo");
+    else outbuf_puts (out, gpr_names[val->val.intval]);
     break;
   default:
-    fprintf (out, "UNK");
+    outbuf_puts (out, "UNK");
   }
 }
 
 static
-void print_asm_reglist (FILE *out, list regs, int identsize, int options)
+void print_asm_reglist (struct outbuf *out, list regs, int identsize, int options)
 {
   element el;
 
-  fprintf (out, "\n");
+  outbuf_putc (out, '\n');
   ident_line (out, identsize);
-  fprintf (out, "  : ");
+  outbuf_puts (out, "  : ");
 
   el = list_head (regs);
   while (el) {
     struct value *val = element_getvalue (el);
     if (el != list_head (regs))
-      fprintf (out, ", ");
-    fprintf (out, "\"=r\"(");
+      outbuf_puts (out, ", ");
+    outbuf_puts (out, "\"=r\"(");
     print_value (out, val, 0);
-    fprintf (out, ")");
+    outbuf_putc (out, ')');
     el = element_next (el);
   }
 }
 
 static
-void print_asm (FILE *out, struct operation *op, int identsize, int options)
+void print_asm (struct outbuf *out, struct operation *op, int identsize, int options)
 {
   struct location *loc;
 
   ident_line (out, identsize);
-  fprintf (out, "__asm__ (");
+  outbuf_puts (out, "__asm__ (");
   for (loc = op->info.asmop.begin; ; loc++) {
     if (loc != op->info.asmop.begin) {
-      fprintf (out, "\n");
+      outbuf_putc (out, '\n');
       ident_line (out, identsize);
-      fprintf (out, "         ");
+      outbuf_puts (out, "         ");
     }
-    fprintf (out, "\"%s;\"", allegrex_disassemble (loc->opc, loc->address, FALSE));
+    outbuf_putc (out, '"');
+    print_disassembly (out, loc, FALSE);
+    outbuf_puts (out, ";\"");
     if (loc == op->info.asmop.end) break;
   }
   if (list_size (op->results) != 0 || list_size (op->operands) != 0) {
@@ -220,44 +219,49 @@ void print_asm (FILE *out, struct operation *op, int identsize, int options)
     }
   }
 
-  fprintf (out, ");\n");
+  outbuf_puts (out, ");\n");
 }
 
 static
-void print_binaryop (FILE *out, struct operation *op, const char *opsymbol, int options)
+void print_binaryop (struct outbuf *out, struct operation *op, const char *opsymbol, int options)
 {
   if (!(options & OPTS_NORESULT)) {
     print_value (out, list_headvalue (op->results), OPTS_RESULT);
-    fprintf (out, " = ");
+    outbuf_puts (out, " = ");
   }
   print_value (out, list_headvalue (op->operands), 0);
-  fprintf (out, " %s ", opsymbol);
+  outbuf_putc (out, ' ');
+  outbuf_puts (out, opsymbol);
+  outbuf_putc (out, ' ');
   print_value (out, list_tailvalue (op->operands), 0);
 }
 
 static
-void print_revbinaryop (FILE *out, struct operation *op, const char *opsymbol, int options)
+void print_revbinaryop (struct outbuf *out, struct operation *op, const char *opsymbol, int options)
 {
   if (!(options & OPTS_NORESULT)) {
     print_value (out, list_headvalue (op->results), OPTS_RESULT);
-    fprintf (out, " = ");
+    outbuf_puts (out, " = ");
   }
   print_value (out, list_tailvalue (op->operands), 0);
-  fprintf (out, " %s ", opsymbol);
+  outbuf_putc (out, ' ');
+  outbuf_puts (out, opsymbol);
+  outbuf_putc (out, ' ');
   print_value (out, list_headvalue (op->operands), 0);
 }
 
 static
-void print_complexop (FILE *out, struct operation *op, const char *opsymbol, int options)
+void print_complexop (struct outbuf *out, struct operation *op, const char *opsymbol, int options)
 {
   element el;
 
   if (list_size (op->results) != 0 && !(options & OPTS_NORESULT)) {
     print_value (out, list_headvalue (op->results), OPTS_RESULT);
-    fprintf (out, " = ");
+    outbuf_puts (out, " = ");
   }
 
-  fprintf (out, "%s (", opsymbol);
+  outbuf_puts (out, opsymbol);
+  outbuf_puts (out, " (");
   el = list_head (op->operands);
   while (el) {
     struct value *val;
@@ -266,15 +270,15 @@ void print_complexop (FILE *out, struct operation *op, const char *opsymbol, int
       if (val->val.variable->type == SSAVAR_INVALID) break;
     }
     if (el != list_head (op->operands))
-      fprintf (out, ", ");
+      outbuf_puts (out, ", ");
     print_value (out, val, 0);
     el = element_next (el);
   }
-  fprintf (out, ")");
+  outbuf_putc (out, ')');
 }
 
 static
-void print_call (FILE *out, struct operation *op, int options)
+void print_call (struct outbuf *out, struct operation *op, int options)
 {
   element el;
 
@@ -282,21 +286,21 @@ void print_call (FILE *out, struct operation *op, int options)
     el = list_head (op->info.callop.retvalues);
     while (el) {
       print_value (out, element_getvalue (el), OPTS_RESULT);
-      fprintf (out, " ");
+      outbuf_putc (out, ' ');
       el = element_next (el);
     }
-    fprintf (out, "= ");
+    outbuf_puts (out, "= ");
   }
 
   if (op->block->info.call.calltarget) {
     print_subroutine_name (out, op->block->info.call.calltarget);
   } else {
-    fprintf (out, "(*");
+    outbuf_puts (out, "(*");
     print_value (out, list_headvalue (op->block->info.call.from->jumpop->operands), 0);
-    fprintf (out, ")");
+    outbuf_putc (out, ')');
   }
 
-  fprintf (out, " (");
+  outbuf_puts (out, " (");
 
   el = list_head (op->info.callop.arguments);
   while (el) {
@@ -306,31 +310,31 @@ void print_call (FILE *out, struct operation *op, int options)
       if (val->val.variable->type == SSAVAR_INVALID) break;
     }
     if (el != list_head (op->info.callop.arguments))
-      fprintf (out, ", ");
+      outbuf_puts (out, ", ");
     print_value (out, val, 0);
     el = element_next (el);
   }
-  fprintf (out, ")");
+  outbuf_putc (out, ')');
 }
 
 static
-void print_return (FILE *out, struct operation *op, int options)
+void print_return (struct outbuf *out, struct operation *op, int options)
 {
   element el;
 
-  fprintf (out, "return");
+  outbuf_puts (out, "return");
   el = list_head (op->info.endop.arguments);
   while (el) {
     struct value *val;
     val = element_getvalue (el);
-    fprintf (out, " ");
+    outbuf_putc (out, ' ');
     print_value (out, val, 0);
     el = element_next (el);
   }
 }
 
 static
-void print_ext (FILE *out, struct operation *op, int options)
+void print_ext (struct outbuf *out, struct operation *op, int options)
 {
   struct value *val1, *val2, *val3;
   element el;
@@ -344,17 +348,20 @@ void print_ext (FILE *out, struct operation *op, int options)
   mask = 0xFFFFFFFF >> (32 - val3->val.intval);
   if (!(options & OPTS_NORESULT)) {
     print_value (out, list_headvalue (op->results), OPTS_RESULT);
-    fprintf (out, " = ");
+    outbuf_puts (out, " = ");
   }
 
-  fprintf (out, "(");
+  outbuf_putc (out, '(');
   print_value (out, val1, 0);
-  fprintf (out, " >> %d)", val2->val.intval);
-  fprintf (out, " & 0x%08X", mask);
+  outbuf_puts (out, " >> ");
+  outbuf_dec (out, val2->val.intval);
+  outbuf_putc (out, ')');
+  outbuf_puts (out, " & 0x");
+  outbuf_hex (out, mask, 8);
 }
 
 static
-void print_ins (FILE *out, struct operation *op, int options)
+void print_ins (struct outbuf *out, struct operation *op, int options)
 {
   struct value *val1, *val2, *val3, *val4;
   element el;
@@ -369,18 +376,22 @@ void print_ins (FILE *out, struct operation *op, int options)
   mask = 0xFFFFFFFF >> (32 - val4->val.intval);
   if (!(options & OPTS_NORESULT)) {
     print_value (out, list_headvalue (op->results), OPTS_RESULT);
-    fprintf (out, " = ");
+    outbuf_puts (out, " = ");
   }
 
-  fprintf (out, "(");
+  outbuf_putc (out, '(');
   print_value (out, val2, 0);
-  fprintf (out, " & 0x%08X) | (", ~(mask << val3->val.intval));
+  outbuf_puts (out, " & 0x");
+  outbuf_hex (out, ~(mask << val3->val.intval), 8);
+  outbuf_puts (out, ") | (");
   print_value (out, val1, 0);
-  fprintf (out, " & 0x%08X)", mask);
+  outbuf_puts (out, " & 0x");
+  outbuf_hex (out, mask, 8);
+  outbuf_putc (out, ')');
 }
 
 static
-void print_nor (FILE *out, struct operation *op, int options)
+void print_nor (struct outbuf *out, struct operation *op, int options)
 {
   struct value *val1, *val2;
   int simple = 0;
@@ -395,23 +406,23 @@ void print_nor (FILE *out, struct operation *op, int options)
 
   if (!(options & OPTS_NORESULT)) {
     print_value (out, list_headvalue (op->results), OPTS_RESULT);
-    fprintf (out, " = ");
+    outbuf_puts (out, " = ");
   }
 
   if (!simple) {
-    fprintf (out, "!(");
+    outbuf_puts (out, "!(");
     print_value (out, val1, 0);
-    fprintf (out, " | ");
+    outbuf_puts (out, " | ");
     print_value (out, val2, 0);
-    fprintf (out, ")");
+    outbuf_putc (out, ')');
   } else {
-    fprintf (out, "!");
+    outbuf_putc (out, '!');
     print_value (out, val1, 0);
   }
 }
 
 static
-void print_movnz (FILE *out, struct operation *op, int ismovn, int options)
+void print_movnz (struct outbuf *out, struct operation *op, int ismovn, int options)
 {
   struct value *val1, *val2, *val3;
   struct value *result;
@@ -425,42 +436,42 @@ void print_movnz (FILE *out, struct operation *op, int ismovn, int options)
 
   if (!(options & OPTS_NORESULT)) {
     print_value (out, result, OPTS_RESULT);
-    fprintf (out, " = ");
+    outbuf_puts (out, " = ");
   }
 
   if (ismovn)
-    fprintf (out, "(");
+    outbuf_putc (out, '(');
   else
-    fprintf (out, "!(");
+    outbuf_puts (out, "!(");
   print_value (out, val2, 0);
-  fprintf (out, ") ? ");
+  outbuf_puts (out, ") ? ");
   print_value (out, val1, 0);
-  fprintf (out, " : ");
+  outbuf_puts (out, " : ");
   print_value (out, val3, 0);
 }
 
 static
-void print_mult (FILE *out, struct operation *op, int options)
+void print_mult (struct outbuf *out, struct operation *op, int options)
 {
   if (!(options & OPTS_NORESULT)) {
     print_value (out, list_headvalue (op->results), OPTS_RESULT);
-    fprintf (out, " ");
+    outbuf_putc (out, ' ');
     print_value (out, list_tailvalue (op->results), OPTS_RESULT);
-    fprintf (out, " = ");
+    outbuf_puts (out, " = ");
   }
   if (options & OPTS_SECONDRESULT)
-    fprintf (out, "hi (");
+    outbuf_puts (out, "hi (");
 
   print_value (out, list_headvalue (op->operands), 0);
-  fprintf (out, " * ");
+  outbuf_puts (out, " * ");
   print_value (out, list_tailvalue (op->operands), 0);
 
   if (options & OPTS_SECONDRESULT)
-    fprintf (out, ")");
+    outbuf_putc (out, ')');
 }
 
 static
-void print_madd (FILE *out, struct operation *op, int options)
+void print_madd (struct outbuf *out, struct operation *op, int options)
 {
   struct value *val1, *val2, *val3, *val4;
   element el = list_head (op->operands);
@@ -472,25 +483,25 @@ void print_madd (FILE *out, struct operation *op, int options)
 
   if (!(options & OPTS_NORESULT)) {
     print_value (out, list_headvalue (op->results), OPTS_RESULT);
-    fprintf (out, " ");
+    outbuf_putc (out, ' ');
     print_value (out, list_tailvalue (op->results), OPTS_RESULT);
-    fprintf (out, " = ");
+    outbuf_puts (out, " = ");
   }
 
   print_value (out, val1, 0);
-  fprintf (out, " * ");
+  outbuf_puts (out, " * ");
   print_value (out, val2, 0);
 
-  fprintf (out, " + (");
+  outbuf_puts (out, " + (");
   print_value (out, val3, 0);
-  fprintf (out, " ");
+  outbuf_putc (out, ' ');
   print_value (out, val4, 0);
-  fprintf (out, ")");
+  outbuf_putc (out, ')');
 }
 
 
 static
-void print_msub (FILE *out, struct operation *op, int options)
+void print_msub (struct outbuf *out, struct operation *op, int options)
 {
   struct value *val1, *val2, *val3, *val4;
   element el = list_head (op->operands);
@@ -502,44 +513,44 @@ void print_msub (FILE *out, struct operation *op, int options)
 
   if (!(options & OPTS_NORESULT)) {
     print_value (out, list_headvalue (op->results), OPTS_RESULT);
-    fprintf (out, " ");
+    outbuf_putc (out, ' ');
     print_value (out, list_tailvalue (op->results), OPTS_RESULT);
-    fprintf (out, " = ");
+    outbuf_puts (out, " = ");
   }
 
-  fprintf (out, "(");
+  outbuf_putc (out, '(');
   print_value (out, val3, 0);
-  fprintf (out, " ");
+  outbuf_putc (out, ' ');
   print_value (out, val4, 0);
-  fprintf (out, ") - ");
+  outbuf_puts (out, ") - ");
 
   print_value (out, val1, 0);
-  fprintf (out, " * ");
+  outbuf_puts (out, " * ");
   print_value (out, val2, 0);
 
 }
 
 static
-void print_div (FILE *out, struct operation *op, int options)
+void print_div (struct outbuf *out, struct operation *op, int options)
 {
   if (!(options & OPTS_NORESULT)) {
     print_value (out, list_headvalue (op->results), OPTS_RESULT);
-    fprintf (out, " ");
+    outbuf_putc (out, ' ');
     print_value (out, list_tailvalue (op->results), OPTS_RESULT);
-    fprintf (out, " = ");
+    outbuf_puts (out, " = ");
   }
   print_value (out, list_headvalue (op->operands), 0);
 
   if (options & OPTS_SECONDRESULT)
-    fprintf (out, " %% ");
+    outbuf_puts (out, " % ");
   else
-    fprintf (out, " / ");
+    outbuf_puts (out, " / ");
 
   print_value (out, list_tailvalue (op->operands), 0);
 }
 
 static
-void print_slt (FILE *out, struct operation *op, int isunsigned, int options)
+void print_slt (struct outbuf *out, struct operation *op, int isunsigned, int options)
 {
   struct value *val1, *val2;
   struct value *result;
@@ -552,35 +563,35 @@ void print_slt (FILE *out, struct operation *op, int isunsigned, int options)
 
   if (!(options & OPTS_NORESULT)) {
     print_value (out, result, OPTS_RESULT);
-    fprintf (out, " = ");
+    outbuf_puts (out, " = ");
   }
 
-  fprintf (out, "(");
+  outbuf_putc (out, '(');
 
   print_value (out, val1, 0);
-  fprintf (out, " < ");
+  outbuf_puts (out, " < ");
   print_value (out, val2, 0);
-  fprintf (out, ")");
+  outbuf_putc (out, ')');
 }
 
 static
-void print_signextend (FILE *out, struct operation *op, int isbyte, int options)
+void print_signextend (struct outbuf *out, struct operation *op, int isbyte, int options)
 {
   if (!(options & OPTS_NORESULT)) {
     print_value (out, list_headvalue (op->results), OPTS_RESULT);
-    fprintf (out, " = ");
+    outbuf_puts (out, " = ");
   }
 
   if (isbyte)
-    fprintf (out, "(char) ");
+    outbuf_puts (out, "(char) ");
   else
-    fprintf (out, "(short) ");
+    outbuf_puts (out, "(short) ");
 
   print_value (out, list_headvalue (op->operands), 0);
 }
 
 static
-void print_memory_address (FILE *out, struct operation *op, int size, int isunsigned, int options)
+void print_memory_address (struct outbuf *out, struct operation *op, int size, int isunsigned, int options)
 {
   struct value *val;
   uint32 address;
@@ -602,62 +613,70 @@ void print_memory_address (FILE *out, struct operation *op, int size, int isunsi
       address = val->val.variable->value;
       val = list_tailvalue (op->operands);
       address += val->val.intval;
-      fprintf (out, "*((%s) 0x%08X)", type, address);
+      outbuf_puts (out, "*((");
+      outbuf_puts (out, type);
+      outbuf_puts (out, ") 0x");
+      outbuf_hex (out, address, 8);
+      outbuf_putc (out, ')');
       return;
     }
   }
 
-  fprintf (out, "((%s) ", type);
+  outbuf_puts (out, "((");
+  outbuf_puts (out, type);
+  outbuf_puts (out, ") ");
   print_value (out, val, 0);
   val = list_tailvalue (op->operands);
-  fprintf (out, ")[%d]", val->val.intval >> size);
+  outbuf_puts (out, ")[");
+  outbuf_dec (out, val->val.intval >> size);
+  outbuf_putc (out, ']');
 }
 
 static
-void print_load (FILE *out, struct operation *op, int size, int isunsigned, int options)
+void print_load (struct outbuf *out, struct operation *op, int size, int isunsigned, int options)
 {
   if (!(options & OPTS_NORESULT)) {
     print_value (out, list_headvalue (op->results), OPTS_RESULT);
-    fprintf (out, " = ");
+    outbuf_puts (out, " = ");
   }
   print_memory_address (out, op, size, isunsigned, options);
 }
 
 static
-void print_store (FILE *out, struct operation *op, int size, int isunsigned, int options)
+void print_store (struct outbuf *out, struct operation *op, int size, int isunsigned, int options)
 {
   struct value *val = element_getvalue (element_next (list_head (op->operands)));
   print_memory_address (out, op, size, isunsigned, options);
-  fprintf (out, " = ");
+  outbuf_puts (out, " = ");
   print_value (out, val, 0);
 }
 
 static
-void print_condition (FILE *out, struct operation *op, int options)
+void print_condition (struct outbuf *out, struct operation *op, int options)
 {
-  fprintf (out, "if (");
-  if (options & OPTS_REVERSECOND) fprintf (out, "!(");
+  outbuf_puts (out, "if (");
+  if (options & OPTS_REVERSECOND) outbuf_puts (out, "!(");
   print_value (out, list_headvalue (op->operands), 0);
   switch (op->info.iop.insn) {
   case I_BNE:
-    fprintf (out, " != ");
+    outbuf_puts (out, " != ");
     break;
   case I_BEQ:
-    fprintf (out, " == ");
+    outbuf_puts (out, " == ");
     break;
   case I_BGEZ:
   case I_BGEZAL:
-    fprintf (out, " >= 0");
+    outbuf_puts (out, " >= 0");
     break;
   case I_BGTZ:
-    fprintf (out, " > 0");
+    outbuf_puts (out, " > 0");
     break;
   case I_BLEZ:
-    fprintf (out, " <= 0");
+    outbuf_puts (out, " <= 0");
     break;
   case I_BLTZ:
   case I_BLTZAL:
-    fprintf (out, " < 0");
+    outbuf_puts (out, " < 0");
     break;
   default:
     break;
@@ -665,13 +684,13 @@ void print_condition (FILE *out, struct operation *op, int options)
   if (list_size (op->operands) == 2)
     print_value (out, list_tailvalue (op->operands), 0);
 
-  if (options & OPTS_REVERSECOND) fprintf (out, ")");
-  fprintf (out, ")");
+  if (options & OPTS_REVERSECOND) outbuf_putc (out, ')');
+  outbuf_putc (out, ')');
 }
 
 
 
-void print_operation (FILE *out, struct operation *op, int identsize, int options)
+void print_operation (struct outbuf *out, struct operation *op, int identsize, int options)
 {
   struct location *loc;
   int nosemicolon = FALSE;
@@ -696,7 +715,7 @@ void print_operation (FILE *out, struct operation *op, int identsize, int option
     struct value *val = list_headvalue (op->results);
     if (!(options & OPTS_NORESULT)) {
       print_value (out, val, OPTS_RESULT);
-      fprintf (out, " = ");
+      outbuf_puts (out, " = ");
     }
     print_value (out, val, 0);
   } else {
@@ -759,7 +778,7 @@ void print_operation (FILE *out, struct operation *op, int identsize, int option
     } else if (op->type == OP_MOVE) {
       if (!(options & OPTS_NORESULT)) {
         print_value (out, list_headvalue (op->results), OPTS_RESULT);
-        fprintf (out, " = ");
+        outbuf_puts (out, " = ");
       }
       print_value (out, list_headvalue (op->operands), 0);
     } else if (op->type == OP_CALL) {
@@ -772,8 +791,8 @@ void print_operation (FILE *out, struct operation *op, int identsize, int option
   }
 
   if (!(options & OPTS_NORESULT)) {
-    if (nosemicolon) fprintf (out, "\n");
-    else fprintf (out, ";\n");
+    if (nosemicolon) outbuf_putc (out, '\n');
+    else outbuf_puts (out, ";\n");
   }
 }
 
@@ -7,6 +7,7 @@
 
 #include <stddef.h>
 #include "code.h"
+#include "outbuf.h"
 
 #define OUT_PRINT_DFS          1
 #define OUT_PRINT_RDFS         2
@@ -27,14 +28,22 @@ extern int g_verbosity;
 extern int g_printoptions;
 
 
-void ident_line (FILE *out, int size);
+void ident_line (struct outbuf *out, int size);
+void print_disassembly (struct outbuf *out, struct location *loc, int prtall);
 void get_base_name (char *filename, char *basename, size_t len);
-void print_value (FILE *out, struct value *val, int options);
-void print_operation (FILE *out, struct operation *op, int identsize, int options);
-void print_subroutine_name (FILE *out, struct subroutine *sub);
-void print_subroutine_declaration (FILE *out, struct subroutine *sub);
+void print_value (struct outbuf *out, struct value *val, int options);
+void print_operation (struct outbuf *out, struct operation *op, int identsize, int options);
+void print_subroutine_name (struct outbuf *out, struct subroutine *sub);
+void print_subroutine_declaration (struct outbuf *out, struct subroutine *sub);
+
+void print_subroutine (struct outbuf *out, struct subroutine *sub);
+void print_source (struct outbuf *out, struct code *c, char *headerfilename);
+void print_subroutine_graph (struct outbuf *out, struct code *c, struct subroutine *sub);
 
 int print_code (struct code *c, char *filename);
 int print_graph (struct code *c, char *prxname);
+int print_export (struct code *c, char *filename, int binary);
+int print_listing (struct prx *p, char *prxname);
+int print_xrefs (struct outbuf *out, struct code *c, const char *query);
 
 #endif /* __OUTPUT_H */
@@ -0,0 +1,100 @@
+/**
+ * Author: Humberto Naves (hsnaves@gmail.com)
+ */
+
+#include <stdlib.h>
+
+#include "output.h"
+#include "strindex.h"
+#include "utils.h"
+
+/* Answers a query on the cross references. The query is the name of an
+ * import or export, or an address (0x...): inside the code it selects
+ * the subroutine there, outside the code the data at that address */
+
+static
+struct subroutine *sub_at (struct code *c, uint32 address)
+{
+  uint32 index = (address - c->baddr) >> 2;
+  if (address < c->baddr || index >= c->numopc) return NULL;
+  return c->base[index].sub;
+}
+
+static
+void print_address (struct outbuf *out, struct code *c, uint32 address)
+{
+  struct subroutine *sub = sub_at (c, address);
+  const char *text;
+  uint32 off, len;
+
+  if (sub && sub->begin->address == address) {
+    print_subroutine_name (out, sub);
+    return;
+  }
+
+  outbuf_puts (out, "0x");
+  outbuf_hex (out, address, 8);
+  if (sub) return;
+
+  off = prx_translate (c->file, address);
+  if (off && strindex_find (prx_strings (c->file), off, &text, &len)) {
+    outbuf_puts (out, " \"");
+    outbuf_write (out, text, len);
+    outbuf_putc (out, '"');
+  }
+}
+
+static
+void print_refs (struct outbuf *out, struct code *c, const char *verb,
+                 struct xref *refs, uint32 num, uint32 key, int bytarget)
+{
+  struct xref *ref;
+  uint32 count;
+
+  ref = xrefs_find (refs, num, key, bytarget, &count);
+  for (; count; count--, ref++) {
+    outbuf_puts (out, "  ");
+    outbuf_puts (out, verb);
+    outbuf_putc (out, ' ');
+    print_address (out, c, bytarget ? ref->from : ref->to);
+    outbuf_puts (out, " at 0x");
+    outbuf_hex (out, ref->site, 8);
+    outbuf_putc (out, '\n');
+  }
+}
+
+int print_xrefs (struct outbuf *out, struct code *c, const char *query)
+{
+  struct xrefs *x = &c->xrefs;
+  struct subroutine *sub = NULL;
+  uint32 address;
+  char *end;
+
+  if (query[0] == '0' && (query[1] == 'x' || query[1] == 'X')) {
+    address = strtoul (query, &end, 16);
+    if (*end) return 0;
+    sub = sub_at (c, address);
+  } else {
+    sub = code_find_function (c, query);
+    if (!sub) sub = code_find_import (c, query);
+    if (!sub) return 0;
+  }
+
+  if (!sub) {
+    print_address (out, c, address);
+    outbuf_putc (out, '\n');
+    print_refs (out, c, "referenced by", x->datausers, x->numdatarefs, address, TRUE);
+    return 1;
+  }
+
+  address = sub->begin->address;
+  print_subroutine_name (out, sub);
+  outbuf_puts (out, " 0x");
+  outbuf_hex (out, address, 8);
+  outbuf_putc (out, '\n');
+  print_refs (out, c, "called by", x->callers, x->numcalls, address, TRUE);
+  print_refs (out, c, "referenced by", x->datausers, x->numdatarefs, address, TRUE);
+  print_refs (out, c, "calls", x->calls, x->numcalls, address, FALSE);
+  print_refs (out, c, "references", x->datarefs, x->numdatarefs, address, FALSE);
+  return 1;
+}
@@ -0,0 +1,325 @@
+/**
+ * Author: Humberto Naves (hsnaves@gmail.com)
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "profile.h"
+#include "hash.h"
+#include "alloc.h"
+#include "utils.h"
+
+struct profsub {
+  uint32 address;
+  double total;
+  double stages[PROF_NUM_STAGES];
+};
+
+struct profstats {
+  int enabled;
+  int topn;
+
+  double starts[PROF_NUM_STAGES];
+  double totals[PROF_NUM_STAGES];
+  uint32 calls[PROF_NUM_STAGES];
+  long rssstarts[PROF_NUM_STAGES];
+  long rssgrowth[PROF_NUM_STAGES];
+  double stageinsns[PROF_NUM_STAGES];
+  uint32 numinsns;
+
+  hashpool pool;
+  hashtable subs;
+  fixedpool subspool;
+  uint32 numsubs;
+};
+
+static struct profstats stats;
+
+/* Only the decoding and the analysis go over all the instructions */
+#define HAS_THROUGHPUT(stage) ((stage) >= PROF_DECODE && (stage) <= PROF_XREFS)
+
+/* The stages that make a pass over the whole code, rather than over one
+ * subroutine or over the subroutines extracted */
+#define WHOLE_CODE(stage) ((stage) == PROF_DECODE || (stage) == PROF_SWITCHES || \
+                           (stage) == PROF_SUBROUTINES || (stage) == PROF_XREFS)
+
+static const char *stage_names[PROF_NUM_STAGES] = {
+  "nids_load",
+  "prx_load",
+  "prx_resolve_nids",
+  "decode_instructions",
+  "extract_switches",
+  "extract_subroutines",
+  "extract_cfg",
+  "extract_operations",
+  "live_registers",
+  "cfg_traverse",
+  "cfg_traverse_rev",
+  "fixup_call_arguments",
+  "build_ssa",
+  "live_registers_imports",
+  "propagate_constants",
+  "extract_variables",
+  "extract_structures",
+  "build_xrefs",
+  "cache_load",
+  "cache_save",
+  "print_graph",
+  "print_code",
+  "print_export",
+  "print_listing"
+};
+
+static
+double get_time (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (double) ts.tv_sec + ((double) ts.tv_nsec) * 1e-9;
+}
+
+static
+long get_maxrss (void)
+{
+  struct rusage usage;
+  if (getrusage (RUSAGE_SELF, &usage) != 0) return 0;
+  return usage.ru_maxrss;
+}
+
+void profile_enable (int topn)
+{
+  if (!stats.enabled) {
+    stats.pool = hashpool_create (4, 4096);
+    stats.subs = hashtable_alloc (stats.pool, 1024, NULL, &hashtable_pointer_compare);
+    stats.subspool = fixedpool_create (sizeof (struct profsub), 1024, TRUE);
+  }
+  stats.enabled = TRUE;
+  stats.topn = topn;
+}
+
+int profile_enabled (void)
+{
+  return stats.enabled;
+}
+
+void profile_instructions (uint32 numinsns)
+{
+  stats.numinsns = numinsns;
+}
+
+void profile_begin (enum profstage stage)
+{
+  if (!stats.enabled) return;
+  stats.starts[stage] = get_time ();
+  stats.rssstarts[stage] = get_maxrss ();
+}
+
+/* The memory of a stage is how much it raised the peak resident set
+ * size of the process, as that is all getrusage tells */
+static
+double stage_elapsed (enum profstage stage)
+{
+  double elapsed = get_time () - stats.starts[stage];
+  long maxrss = get_maxrss ();
+  stats.totals[stage] += elapsed;
+  stats.calls[stage]++;
+  if (maxrss > stats.rssstarts[stage])
+    stats.rssgrowth[stage] += maxrss - stats.rssstarts[stage];
+  return elapsed;
+}
+
+void profile_end (enum profstage stage)
+{
+  if (!stats.enabled) return;
+  stage_elapsed (stage);
+  if (WHOLE_CODE (stage))
+    stats.stageinsns[stage] += (double) stats.numinsns;
+}
+
+void profile_endsub (enum profstage stage, uint32 address, uint32 endaddress)
+{
+  struct profsub *ps;
+  double elapsed;
+
+  if (!stats.enabled) return;
+  elapsed = stage_elapsed (stage);
+  stats.stageinsns[stage] += (double) (((endaddress - address) >> 2) + 1);
+
+  ps = hashtable_searchhash (stats.subs, NULL, NULL, address);
+  if (!ps) {
+    ps = fixedpool_alloc (stats.subspool);
+    ps->address = address;
+    hashtable_inserthash (stats.subs, NULL, ps, address);
+    stats.numsubs++;
+  }
+  ps->total += elapsed;
+  ps->stages[stage] += elapsed;
+}
+
+static
+void collect_sub (void *key, void *value, unsigned int hash, void *arg)
+{
+  struct profsub ***pos = arg;
+  **pos = value;
+  (*pos)++;
+}
+
+static
+int cmp_profsub (const void *p1, const void *p2)
+{
+  const struct profsub *s1 = *((const struct profsub **) p1);
+  const struct profsub *s2 = *((const struct profsub **) p2);
+  if (s1->total > s2->total) return -1;
+  if (s1->total < s2->total) return 1;
+  if (s1->address < s2->address) return -1;
+  if (s1->address > s2->address) return 1;
+  return 0;
+}
+
+static
+struct profsub **sorted_subs (uint32 *count)
+{
+  struct profsub **result, **pos;
+
+  *count = 0;
+  if (!stats.numsubs) return NULL;
+
+  result = (struct profsub **) xmalloc (stats.numsubs * sizeof (struct profsub *));
+  pos = result;
+  hashtable_traverse (stats.subs, &collect_sub, &pos);
+  qsort (result, stats.numsubs, sizeof (struct profsub *), &cmp_profsub);
+
+  *count = MIN (stats.numsubs, (uint32) stats.topn);
+  return result;
+}
+
+static
+int slowest_stage (struct profsub *ps)
+{
+  int i, result = 0;
+  for (i = 1; i < PROF_NUM_STAGES; i++)
+    if (ps->stages[i] > ps->stages[result]) result = i;
+  return result;
+}
+
+/* Writes the instructions per second of the stage, or the empty value
+ * when the stage does not go over the instructions. Only the instructions
+ * of the subroutines a stage was run on are counted */
+static
+void stage_throughput (char *buffer, int stage, const char *empty)
+{
+  if (stats.stageinsns[stage] <= 0.0 || stats.totals[stage] <= 0.0)
+    strcpy (buffer, empty);
+  else
+    sprintf (buffer, "%.0f", stats.stageinsns[stage] / stats.totals[stage]);
+}
+
+void profile_print (void)
+{
+  struct profsub **subs;
+  double total = 0.0, analysis = 0.0;
+  long growth = 0;
+  char buffer[32];
+  uint32 i, count;
+
+  if (!stats.enabled) return;
+
+  for (i = 0; i < PROF_NUM_STAGES; i++) {
+    total += stats.totals[i];
+    growth += stats.rssgrowth[i];
+    if (HAS_THROUGHPUT (i)) analysis += stats.totals[i];
+  }
+
+  report ("\nProfile (%u instructions, peak RSS %ld KB):\n", stats.numinsns, get_maxrss ());
+  report ("  %-24s %8s %12s %7s %14s %14s\n", "Stage", "Calls", "Time (ms)", "%",
+          "Insns/s", "RSS grew (KB)");
+  for (i = 0; i < PROF_NUM_STAGES; i++) {
+    if (!stats.calls[i]) continue;
+    stage_throughput (buffer, i, "-");
+    report ("  %-24s %8u %12.3f %6.1f%% %14s %14ld\n", stage_names[i], stats.calls[i],
+            stats.totals[i] * 1000.0, (total > 0.0) ? 100.0 * stats.totals[i] / total : 0.0,
+            buffer, stats.rssgrowth[i]);
+  }
+  /* The throughput of the whole analysis, from the decoding on */
+  report ("  %-24s %8s %12.3f %7s %14.0f %14ld\n", "Total", "", total * 1000.0, "",
+          (analysis > 0.0) ? ((double) stats.numinsns) / analysis : 0.0, growth);
+
+  subs = sorted_subs (&count);
+  if (count) {
+    report ("\nSlowest subroutines:\n");
+    report ("  %-10s %12s  %s\n", "Address", "Time (ms)", "Slowest stage");
+    for (i = 0; i < count; i++) {
+      report ("  0x%08X %12.3f  %s\n", subs[i]->address, subs[i]->total * 1000.0,
+              stage_names[slowest_stage (subs[i])]);
+    }
+  }
+  if (subs) free (subs);
+}
+
+int profile_print_json (const char *path)
+{
+  struct profsub **subs;
+  char buffer[32];
+  uint32 i, count;
+  int j, first;
+  FILE *fp;
+
+  if (!stats.enabled) return 1;
+
+  fp = fopen (path, "w");
+  if (!fp) {
+    xerror (__FILE__ ": can't open file for writing `%s'", path);
+    return 0;
+  }
+
+  fprintf (fp, "{\n  \"instructions\": %u,\n  \"peak_rss_kb\": %ld,\n  \"stages\": [",
+           stats.numinsns, get_maxrss ());
+  first = TRUE;
+  for (i = 0; i < PROF_NUM_STAGES; i++) {
+    if (!stats.calls[i]) continue;
+    stage_throughput (buffer, i, "null");
+    fprintf (fp, "%s\n    { \"name\": \"%s\", \"calls\": %u, \"seconds\": %.9f, "
+                 "\"insns_per_second\": %s, \"rss_growth_kb\": %ld }",
+             first ? "" : ",", stage_names[i], stats.calls[i], stats.totals[i],
+             buffer, stats.rssgrowth[i]);
+    first = FALSE;
+  }
+  fprintf (fp, "\n  ],\n  \"subroutines\": [");
+
+  subs = sorted_subs (&count);
+  for (i = 0; i < count; i++) {
+    fprintf (fp, "%s\n    { \"address\": \"0x%08X\", \"seconds\": %.9f, \"stages\": {",
+             (i == 0) ? "" : ",", subs[i]->address, subs[i]->total);
+    first = TRUE;
+    for (j = 0; j < PROF_NUM_STAGES; j++) {
+      if (subs[i]->stages[j] == 0.0) continue;
+      fprintf (fp, "%s \"%s\": %.9f", first ? "" : ",", stage_names[j], subs[i]->stages[j]);
+      first = FALSE;
+    }
+    fprintf (fp, " } }");
+  }
+  if (subs) free (subs);
+
+  fprintf (fp, "\n  ]\n}\n");
+  fclose (fp);
+  return 1;
+}
+
+void profile_free (void)
+{
+  if (!stats.enabled) return;
+  if (stats.pool)
+    hashpool_destroy (stats.pool);
+  stats.pool = NULL;
+  stats.subs = NULL;
+  if (stats.subspool)
+    fixedpool_destroy (stats.subspool, NULL, NULL);
+  stats.subspool = NULL;
+  stats.enabled = FALSE;
+}
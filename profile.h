@@ -0,0 +1,53 @@
+/**
+ * Author: Humberto Naves (hsnaves@gmail.com)
+ */
+
+#ifndef __PROFILE_H
+#define __PROFILE_H
+
+#include <stdio.h>
+#include "types.h"
+
+enum profstage {
+  PROF_LOAD_NIDS = 0,
+  PROF_LOAD_PRX,
+  PROF_RESOLVE_NIDS,
+  PROF_DECODE,
+  PROF_SWITCHES,
+  PROF_SUBROUTINES,
+  PROF_CFG,
+  PROF_OPERATIONS,
+  PROF_LIVE_REGISTERS,
+  PROF_CFG_TRAVERSE,
+  PROF_CFG_TRAVERSE_REV,
+  PROF_FIXUP_CALL_ARGS,
+  PROF_SSA,
+  PROF_LIVE_IMPORTS,
+  PROF_CONSTANTS,
+  PROF_VARIABLES,
+  PROF_STRUCTURES,
+  PROF_XREFS,
+  PROF_CACHE_LOAD,
+  PROF_CACHE_SAVE,
+  PROF_PRINT_GRAPH,
+  PROF_PRINT_CODE,
+  PROF_PRINT_EXPORT,
+  PROF_PRINT_LISTING,
+  PROF_NUM_STAGES
+};
+
+#define PROFILE_DEFAULT_TOP 10
+
+void profile_enable (int topn);
+int profile_enabled (void);
+void profile_instructions (uint32 numinsns);
+
+void profile_begin (enum profstage stage);
+void profile_end (enum profstage stage);
+void profile_endsub (enum profstage stage, uint32 address, uint32 endaddress);
+
+void profile_print (void);
+int profile_print_json (const char *path);
+void profile_free (void);
+
+#endif /* __PROFILE_H */
@@ -7,15 +7,15 @@
 
 #include "prx.h"
 #include "nids.h"
+#include "hash.h"
 #include "utils.h"
 
 #define ELF_HEADER_SIZE              52
 #define ELF_SECTION_HEADER_ENT_SIZE  40
 #define ELF_PROGRAM_HEADER_ENT_SIZE  32
 #define ELF_PRX_FLAGS                (ELF_FLAGS_MIPS_ARCH2 | ELF_FLAGS_MACH_ALLEGREX | ELF_FLAGS_MACH_ALLEGREX)
-#define PRX_MODULE_INFO_SIZE         52
 
-extern int load_relocs (struct prx *p);
+extern int load_relocs (struct prx *p, int lazy);
 extern void free_relocs (struct prx *p);
 extern void print_relocs (struct prx *p);
 
@@ -323,7 +323,7 @@ int load_programs (struct prx *p)
   return 1;
 }
 
-struct prx *prx_load (const char *path)
+struct prx *prx_load (const char *path, int flags)
 {
   struct prx *p;
   uint8 *elf_bytes;
@@ -342,6 +342,8 @@ struct prx *prx_load (const char *path)
   memset (p, 0, sizeof (struct prx));
   p->size = elf_size;
   p->data = elf_bytes;
+  p->hash[0] = hashtable_hash_bytes (elf_bytes, elf_size);
+  p->hash[1] = hashtable_hash_fnv (elf_bytes, elf_size);
 
   memcpy (p->ident, p->data, ELF_HEADER_IDENT);
   p->type = read_uint16_le (&p->data[ELF_HEADER_IDENT]);
@@ -374,7 +376,7 @@ struct prx *prx_load (const char *path)
     return NULL;
   }
 
-  if (!load_relocs (p)) {
+  if (!load_relocs (p, flags & PRX_LAZY_RELOCS)) {
     prx_free (p);
     return NULL;
   }
@@ -409,6 +411,9 @@ void prx_free (struct prx *p)
   free_programs (p);
   free_relocs (p);
   free_module_info (p);
+  if (p->strings)
+    strindex_free (p->strings);
+  p->strings = NULL;
   if (p->data)
     free ((void *) p->data);
   p->data = NULL;
@@ -487,6 +492,18 @@ void prx_print (struct prx *p, int prtrelocs)
   report ("\n");
 }
 
+/* The string index covers the whole relocated image, so every
+ * relocation is applied before it is built. It is only asked for when
+ * printing the code, and not from two threads at once the first time */
+struct strindex *prx_strings (struct prx *p)
+{
+  if (!p->strings) {
+    prx_resolve_all_relocs (p);
+    p->strings = strindex_build (p->data, p->size);
+  }
+  return p->strings;
+}
+
 uint32 prx_translate (struct prx *p, uint32 vaddr)
 {
   uint32 idx;
@@ -7,6 +7,7 @@
 
 #include "types.h"
 #include "nids.h"
+#include "strindex.h"
 
 #define ELF_HEADER_IDENT        16
 #define ELF_PRX_TYPE            0xFFA0
@@ -37,6 +38,7 @@ struct prx
 
   uint32 size;
   const uint8 *data;
+  uint32 hash[2];      /* Hashes of the file contents (before relocating) */
 
   struct elf_section *sections;
 
@@ -45,8 +47,15 @@ struct prx
   uint32 relocnum;
   struct prx_reloc *relocs;
   struct prx_reloc *relocsbyaddr;
+  uint32 *relocmap;
+  uint32 *relocrank;
+  uint32 relocmapbase;
+  uint32 relocmapsize;
+  struct relocstate *relocstate;
 
   struct prx_modinfo *modinfo;
+
+  struct strindex *strings;  /* Built on first use by prx_strings */
 };
 
 #define SHT_NULL            0
@@ -203,13 +212,18 @@ uint32 read_uint32_le (const uint8 *bytes);
 uint16 read_uint16_le (const uint8 *bytes);
 void write_uint32_le (uint8 *bytes, uint32 val);
 
-struct prx *prx_load (const char *path);
+#define PRX_LAZY_RELOCS 1
+
+#define PRX_MODULE_INFO_SIZE 52
+
+struct prx *prx_load (const char *path, int flags);
 void prx_free (struct prx *p);
 void prx_print (struct prx *p, int prtrelocs);
 
 void prx_resolve_nids (struct prx *p, struct nidstable *nids);
 
 uint32 prx_translate (struct prx *p, uint32 vaddr);
+struct strindex *prx_strings (struct prx *p);
 
 int prx_inside_prx (struct prx *p, uint32 offset, uint32 size);
 int prx_inside_progfile (struct elf_program *program, uint32 vaddr, uint32 size);
@@ -218,6 +232,9 @@ int prx_inside_strprogfile (struct elf_program *program, uint32 vaddr);
 
 uint32 prx_findreloc (struct prx *p, uint32 target);
 uint32 prx_findrelocbyaddr (struct prx *p, uint32 vaddr);
+int prx_hasreloc (struct prx *p, uint32 vaddr);
+void prx_resolve_relocs (struct prx *p, uint32 vaddr, uint32 size);
+void prx_resolve_all_relocs (struct prx *p);
 
 
 
@@ -0,0 +1,223 @@
+/**
+ * Author: Humberto Naves (hsnaves@gmail.com)
+ */
+
+#include <string.h>
+
+#include "pspdecompiler.h"
+#include "code.h"
+#include "prx.h"
+#include "nids.h"
+#include "output.h"
+#include "outbuf.h"
+#include "intern.h"
+#include "threads.h"
+#include "utils.h"
+
+int pspdec_version (void)
+{
+  return PSPDEC_API_VERSION;
+}
+
+void pspdec_set_threads (int numthreads)
+{
+  g_numthreads = numthreads;
+}
+
+void pspdec_set_budget (unsigned int subunits, unsigned int stageunits)
+{
+  g_subbudget = subunits;
+  g_stagebudget = stageunits;
+}
+
+void pspdec_cleanup (void)
+{
+  intern_free ();
+}
+
+
+pspdec_nids *pspdec_nids_load (const char *path)
+{
+  return nids_load (path);
+}
+
+void pspdec_nids_free (pspdec_nids *nids)
+{
+  nids_free (nids);
+}
+
+pspdec_prx *pspdec_prx_load (const char *path)
+{
+  return prx_load (path, PRX_LAZY_RELOCS);
+}
+
+void pspdec_prx_resolve_nids (pspdec_prx *p, pspdec_nids *nids)
+{
+  prx_resolve_nids (p, nids);
+}
+
+void pspdec_prx_free (pspdec_prx *p)
+{
+  prx_free (p);
+}
+
+
+pspdec_code *pspdec_analyse (pspdec_prx *p)
+{
+  return code_analyse (p);
+}
+
+pspdec_code *pspdec_analyse_function (pspdec_prx *p, const char *function)
+{
+  return code_analyse_function (p, function);
+}
+
+void pspdec_code_free (pspdec_code *c)
+{
+  code_free (c);
+}
+
+
+pspdec_sub *pspdec_sub_first (pspdec_code *c)
+{
+  return list_headvalue (c->subroutines);
+}
+
+/* The subroutines are contiguous, so the next one starts right
+ * after the end of this one */
+pspdec_sub *pspdec_sub_next (pspdec_sub *sub)
+{
+  struct code *c = sub->code;
+  if ((uint32) (sub->end - c->base) + 1 >= c->numopc) return NULL;
+  return sub->end[1].sub;
+}
+
+pspdec_sub *pspdec_sub_find (pspdec_code *c, const char *function)
+{
+  return code_find_function (c, function);
+}
+
+unsigned int pspdec_sub_address (pspdec_sub *sub)
+{
+  return sub->begin->address;
+}
+
+unsigned int pspdec_sub_end (pspdec_sub *sub)
+{
+  return sub->end->address;
+}
+
+const char *pspdec_sub_name (pspdec_sub *sub)
+{
+  if (sub->export) return sub->export->name;
+  if (sub->import) return sub->import->name;
+  return NULL;
+}
+
+int pspdec_sub_numargs (pspdec_sub *sub)
+{
+  return sub->numregargs;
+}
+
+int pspdec_sub_numret (pspdec_sub *sub)
+{
+  return sub->numregout;
+}
+
+int pspdec_sub_isimport (pspdec_sub *sub)
+{
+  return sub->import != NULL;
+}
+
+int pspdec_sub_isexport (pspdec_sub *sub)
+{
+  return sub->export != NULL;
+}
+
+int pspdec_sub_haserror (pspdec_sub *sub)
+{
+  return sub->haserror;
+}
+
+
+pspdec_block *pspdec_block_first (pspdec_sub *sub)
+{
+  if (!sub->blocks || sub->haserror) return NULL;
+  return list_headvalue (sub->blocks);
+}
+
+pspdec_block *pspdec_block_next (pspdec_block *block)
+{
+  element el = element_next (block->blockel);
+  return el ? element_getvalue (el) : NULL;
+}
+
+enum pspdec_blocktype pspdec_block_type (pspdec_block *block)
+{
+  return (enum pspdec_blocktype) block->type;
+}
+
+unsigned int pspdec_block_begin (pspdec_block *block)
+{
+  if (block->type != BLOCK_SIMPLE) return 0;
+  return block->info.simple.begin->address;
+}
+
+unsigned int pspdec_block_end (pspdec_block *block)
+{
+  if (block->type != BLOCK_SIMPLE) return 0;
+  return block->info.simple.end->address;
+}
+
+int pspdec_block_dfsnum (pspdec_block *block)
+{
+  return block->node.dfsnum;
+}
+
+pspdec_sub *pspdec_block_calltarget (pspdec_block *block)
+{
+  if (block->type != BLOCK_CALL) return NULL;
+  return block->info.call.calltarget;
+}
+
+
+/* Copies the output into buf and frees it */
+static
+size_t copy_output (struct outbuf *out, char *buf, size_t size)
+{
+  struct outchunk *chunk;
+  size_t len = out->size, pos = 0;
+
+  if (size > 0) {
+    for (chunk = out->head; chunk && pos < size - 1; chunk = chunk->next) {
+      size_t n = MIN (chunk->size, size - 1 - pos);
+      memcpy (&buf[pos], chunk->data, n);
+      pos += n;
+    }
+    buf[pos] = '\0';
+  }
+  outbuf_free (out);
+  return len;
+}
+
+size_t pspdec_render_source (pspdec_code *c, const char *headername, char *buf, size_t size)
+{
+  struct outbuf *out = outbuf_alloc ();
+  print_source (out, c, (char *) headername);
+  return copy_output (out, buf, size);
+}
+
+size_t pspdec_render_sub (pspdec_sub *sub, char *buf, size_t size)
+{
+  struct outbuf *out = outbuf_alloc ();
+  print_subroutine (out, sub);
+  return copy_output (out, buf, size);
+}
+
+size_t pspdec_render_graph (pspdec_sub *sub, char *buf, size_t size)
+{
+  struct outbuf *out = outbuf_alloc ();
+  if (!sub->import && !sub->haserror)
+    print_subroutine_graph (out, sub->code, sub);
+  return copy_output (out, buf, size);
+}
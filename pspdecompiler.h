@@ -0,0 +1,93 @@
+/**
+ * Author: Humberto Naves (hsnaves@gmail.com)
+ */
+
+#ifndef __PSPDECOMPILER_H
+#define __PSPDECOMPILER_H
+
+#include <stddef.h>
+
+/* The public interface of libpspdecompiler. All the handles are opaque,
+ * and only this header needs to be installed. A prx handle is completed
+ * lazily by the code handles made from it, so the prx, its code handles
+ * and their subroutines and blocks must all stay on one thread at a time.
+ * Handles made from different prx handles can be used by different
+ * threads. Errors are reported to stderr, and the loading and analysing
+ * functions return NULL on failure. */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PSPDEC_API_VERSION 2
+
+typedef struct nidstable  pspdec_nids;
+typedef struct prx        pspdec_prx;
+typedef struct code       pspdec_code;
+typedef struct subroutine pspdec_sub;
+typedef struct basicblock pspdec_block;
+
+enum pspdec_blocktype {
+  PSPDEC_BLOCK_START = 0,
+  PSPDEC_BLOCK_SIMPLE,
+  PSPDEC_BLOCK_CALL,
+  PSPDEC_BLOCK_END
+};
+
+int pspdec_version (void);
+void pspdec_set_threads (int numthreads);
+/* Work units allowed to each subroutine, in total and in each stage,
+ * before its analysis is given up (0 is unlimited) */
+void pspdec_set_budget (unsigned int subunits, unsigned int stageunits);
+/* Releases the names shared by all the handles; call it after
+ * freeing every handle */
+void pspdec_cleanup (void);
+
+pspdec_nids *pspdec_nids_load (const char *path);
+void pspdec_nids_free (pspdec_nids *nids);
+
+pspdec_prx *pspdec_prx_load (const char *path);
+void pspdec_prx_resolve_nids (pspdec_prx *p, pspdec_nids *nids);
+void pspdec_prx_free (pspdec_prx *p);
+
+/* The prx must outlive the code */
+pspdec_code *pspdec_analyse (pspdec_prx *p);
+pspdec_code *pspdec_analyse_function (pspdec_prx *p, const char *function);
+void pspdec_code_free (pspdec_code *c);
+
+/* Subroutines, in address order. A function is an export name or
+ * an address (0x...) */
+pspdec_sub *pspdec_sub_first (pspdec_code *c);
+pspdec_sub *pspdec_sub_next (pspdec_sub *sub);
+pspdec_sub *pspdec_sub_find (pspdec_code *c, const char *function);
+unsigned int pspdec_sub_address (pspdec_sub *sub);
+unsigned int pspdec_sub_end (pspdec_sub *sub);
+const char *pspdec_sub_name (pspdec_sub *sub);
+int pspdec_sub_numargs (pspdec_sub *sub);
+int pspdec_sub_numret (pspdec_sub *sub);
+int pspdec_sub_isimport (pspdec_sub *sub);
+int pspdec_sub_isexport (pspdec_sub *sub);
+int pspdec_sub_haserror (pspdec_sub *sub);
+
+/* Blocks of an analysed subroutine; the simple blocks have addresses,
+ * the call blocks have a target */
+pspdec_block *pspdec_block_first (pspdec_sub *sub);
+pspdec_block *pspdec_block_next (pspdec_block *block);
+enum pspdec_blocktype pspdec_block_type (pspdec_block *block);
+unsigned int pspdec_block_begin (pspdec_block *block);
+unsigned int pspdec_block_end (pspdec_block *block);
+int pspdec_block_dfsnum (pspdec_block *block);
+pspdec_sub *pspdec_block_calltarget (pspdec_block *block);
+
+/* Rendering into a caller supplied buffer. Like snprintf, at most
+ * size - 1 bytes and a terminating null are written, and the length of
+ * the whole output is returned, so that a larger buffer can be tried */
+size_t pspdec_render_source (pspdec_code *c, const char *headername, char *buf, size_t size);
+size_t pspdec_render_sub (pspdec_sub *sub, char *buf, size_t size);
+size_t pspdec_render_graph (pspdec_sub *sub, char *buf, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PSPDECOMPILER_H */
@@ -10,38 +10,122 @@
 
 
 
+#define RELOC_KEY(r, bytarget) ((bytarget) ? (r)->target : (r)->vaddr)
+
+/* Stable LSD radix sort of src into dst, by target or by vaddr.
+ * If order is given, it receives the source index of each entry */
 static
-int cmp_relocs (const void *p1, const void *p2)
+void sort_relocs (const struct prx_reloc *src, struct prx_reloc *dst, uint32 num, int bytarget, uint32 *order)
 {
-  const struct prx_reloc *r1 = p1;
-  const struct prx_reloc *r2 = p2;
-  if (r1->target < r2->target) return -1;
-  if (r1->target > r2->target) return 1;
-  return 0;
+  uint32 *buffer, *keys, *idx, *tkeys, *tidx, *swap;
+  uint32 counts[256];
+  uint32 i, shift, sum, temp;
+
+  buffer = (uint32 *) xmalloc (4 * num * sizeof (uint32));
+  keys = buffer;
+  idx = &keys[num];
+  tkeys = &keys[2 * num];
+  tidx = &keys[3 * num];
+
+  for (i = 0; i < num; i++) {
+    keys[i] = RELOC_KEY (&src[i], bytarget);
+    idx[i] = i;
+  }
+
+  for (shift = 0; shift < 32; shift += 8) {
+    memset (counts, 0, sizeof (counts));
+    for (i = 0; i < num; i++)
+      counts[(keys[i] >> shift) & 0xFF]++;
+
+    /* All keys share this byte */
+    if (counts[(keys[0] >> shift) & 0xFF] == num) continue;
+
+    sum = 0;
+    for (i = 0; i < 256; i++) {
+      temp = counts[i];
+      counts[i] = sum;
+      sum += temp;
+    }
+
+    for (i = 0; i < num; i++) {
+      temp = counts[(keys[i] >> shift) & 0xFF]++;
+      tkeys[temp] = keys[i];
+      tidx[temp] = idx[i];
+    }
+
+    swap = keys; keys = tkeys; tkeys = swap;
+    swap = idx; idx = tidx; tidx = swap;
+  }
+
+  for (i = 0; i < num; i++)
+    dst[i] = src[idx[i]];
+  if (order)
+    memcpy (order, idx, num * sizeof (uint32));
+
+  free (buffer);
 }
 
+/* Builds a bitmap with one bit per word that holds a relocation,
+ * plus the number of relocations before each word of the bitmap.
+ * Falls back to the binary search if some relocation is not word
+ * aligned or shares its address with another one */
 static
-int cmp_relocs_by_addr (const void *p1, const void *p2)
+void build_relocmap (struct prx *p)
 {
-  const struct prx_reloc *r1 = p1;
-  const struct prx_reloc *r2 = p2;
-  if (r1->vaddr < r2->vaddr) return -1;
-  if (r1->vaddr > r2->vaddr) return 1;
-  return 0;
+  uint32 i, word, size;
+
+  p->relocmap = NULL;
+  p->relocrank = NULL;
+  p->relocmapsize = 0;
+  if (!p->relocnum) return;
+
+  for (i = 0; i < p->relocnum; i++) {
+    if (p->relocsbyaddr[i].vaddr & 0x03) return;
+    if (i && p->relocsbyaddr[i].vaddr == p->relocsbyaddr[i - 1].vaddr) return;
+  }
+
+  p->relocmapbase = p->relocsbyaddr[0].vaddr;
+  size = ((p->relocsbyaddr[p->relocnum - 1].vaddr - p->relocmapbase) >> 7) + 1;
+
+  p->relocmap = (uint32 *) xmalloc (2 * size * sizeof (uint32));
+  p->relocrank = &p->relocmap[size];
+  p->relocmapsize = size;
+  memset (p->relocmap, 0, 2 * size * sizeof (uint32));
+
+  for (i = 0; i < p->relocnum; i++) {
+    word = (p->relocsbyaddr[i].vaddr - p->relocmapbase) >> 2;
+    p->relocmap[word >> 5] |= 1U << (word & 31);
+  }
+
+  p->relocrank[0] = 0;
+  for (i = 1; i < size; i++)
+    p->relocrank[i] = p->relocrank[i - 1] + popcount (p->relocmap[i - 1]);
 }
 
+#define RELOC_NONE 0xFFFFFFFF
+
+/* Bookkeeping for resolving the relocations in units. A unit is a run
+ * of hi16 with their matching lo16 or a single relocation. The relocations
+ * are kept in file order here until they are all resolved */
+struct relocstate {
+  struct prx_reloc *relocs;
+  uint32 *unit;
+  uint32 *lastxhi;
+  uint32 *order;
+  uint32 *pos;
+  uint8 *done;
+  uint32 numdone;
+};
+
 static
-int check_apply_relocs (struct prx *p)
+int validate_relocs (struct prx *p, struct prx_reloc *relocs)
 {
-  struct prx_reloc *r, *lastxhi = NULL;
+  struct prx_reloc *r;
   struct elf_program *offsbase;
-  struct elf_program *addrbase;
-  uint32 index, addend, base, temp;
-  uint32 hiaddr, loaddr;
-
+  uint32 index;
 
   for (index = 0; index < p->relocnum; index++) {
-    r = &p->relocs[index];
+    r = &relocs[index];
     if (r->offsbase >= p->phnum) {
       error (__FILE__ ": invalid offset base for relocation (%d)", r->offsbase);
       return 0;
@@ -53,7 +137,6 @@ int check_apply_relocs (struct prx *p)
     }
 
     offsbase = &p->programs[r->offsbase];
-    addrbase = &p->programs[r->addrbase];
 
     r->vaddr = r->offset + offsbase->vaddr;
     if (!prx_inside_progfile (offsbase, r->vaddr, 4)) {
@@ -61,45 +144,54 @@ int check_apply_relocs (struct prx *p)
       return 0;
     }
   }
+  return 1;
+}
 
-  for (index = 0; index < p->relocnum; index++) {
-    r = &p->relocs[index];
-    offsbase = &p->programs[r->offsbase];
-    addrbase = &p->programs[r->addrbase];
+static
+int group_relocs (struct prx *p, struct relocstate *st)
+{
+  struct prx_reloc *r, *relocs = st->relocs;
+  struct elf_program *offsbase;
+  uint32 index, addend, base, temp;
+  uint32 lastxhi = RELOC_NONE;
 
-    addend = read_uint32_le (&offsbase->data[r->offset]);
+  for (index = 0; index < p->relocnum; index++) {
+    r = &relocs[index];
+    st->unit[index] = index;
+    st->lastxhi[index] = lastxhi;
 
     switch (r->type) {
     case R_MIPS_NONE:
-      break;
     case R_MIPS_26:
     case R_MIPSX_J26:
     case R_MIPSX_JAL26:
-      r->target = (r->offset + offsbase->vaddr) & 0xF0000000;
-      r->target = (((addend & 0x3FFFFFF) << 2) | r->target) + addrbase->vaddr;
-      addend = (addend & ~0x3FFFFFF) | (r->target >> 2);
-      if (!prx_inside_progfile (addrbase, r->target, 8)) {
-        error (__FILE__ ": mips26 reference out of range at 0x%08X (0x%08X)", r->vaddr, r->target);
-      }
-      write_uint32_le ((uint8 *)&offsbase->data[r->offset], addend);
+    case R_MIPS_16:
+    case R_MIPS_LO16:
+    case R_MIPS_32:
+      break;
+    case R_MIPSX_HI16:
+      lastxhi = index;
       break;
     case R_MIPS_HI16:
+      offsbase = &p->programs[r->offsbase];
+      addend = read_uint32_le (&offsbase->data[r->offset]);
       base = index;
       while (++index < p->relocnum) {
-        if (p->relocs[index].type != R_MIPS_HI16) break;
-        if (p->relocs[index].offsbase != r->offsbase) {
+        if (relocs[index].type != R_MIPS_HI16) break;
+        if (relocs[index].offsbase != r->offsbase) {
           error (__FILE__ ": changed offset base");
           return 0;
         }
-        if (p->relocs[index].addrbase != r->addrbase) {
+        if (relocs[index].addrbase != r->addrbase) {
           error (__FILE__ ": changed offset base");
           return 0;
         }
-        temp = read_uint32_le (&offsbase->data[p->relocs[index].offset]) & 0xFFFF;
+        temp = read_uint32_le (&offsbase->data[relocs[index].offset]) & 0xFFFF;
         if (temp != (addend & 0xFFFF)) {
           error (__FILE__ ": changed hi");
           return 0;
         }
+        st->unit[index] = base;
       }
 
       if (index == p->relocnum) {
@@ -107,228 +199,300 @@ int check_apply_relocs (struct prx *p)
         return 0;
       }
 
-      if (p->relocs[index].type != R_MIPS_LO16 ||
-          p->relocs[index].offsbase != r->offsbase ||
-          p->relocs[index].addrbase != r->addrbase) {
+      if (relocs[index].type != R_MIPS_LO16 ||
+          relocs[index].offsbase != r->offsbase ||
+          relocs[index].addrbase != r->addrbase) {
         error (__FILE__ ": hi16 without matching lo16");
         return 0;
       }
 
-      temp = read_uint32_le (&offsbase->data[p->relocs[index].offset]) & 0xFFFF;
-      if (temp & 0x8000) temp |= ~0xFFFF;
-
-      r->target = ((addend & 0xFFFF) << 16) + addrbase->vaddr + temp;
-      addend = temp & 0xFFFF;
-      if (!prx_inside_progmem (addrbase, r->target, 1)) {
-        error (__FILE__ ": hi16 reference out of range at 0x%08X (0x%08X)", r->vaddr, r->target);
-      }
-
-      loaddr = r->target & 0xFFFF;
-      hiaddr = (((r->target >> 15) + 1) >> 1) & 0xFFFF;
-
-      while (base < index) {
-        p->relocs[base].target = r->target;
-        temp = (read_uint32_le (&offsbase->data[p->relocs[base].offset]) & ~0xFFFF) | hiaddr;
-        write_uint32_le ((uint8 *) &offsbase->data[p->relocs[base].offset], temp);
-        base++;
-      }
-
+      addend = read_uint32_le (&offsbase->data[relocs[index].offset]) & 0xFFFF;
       while (index < p->relocnum) {
-        temp = read_uint32_le (&offsbase->data[p->relocs[index].offset]);
+        temp = read_uint32_le (&offsbase->data[relocs[index].offset]);
         if ((temp & 0xFFFF) != addend) break;
-        if (p->relocs[index].type != R_MIPS_LO16) break;
-        if (p->relocs[index].offsbase != r->offsbase) break;
-        if (p->relocs[index].addrbase != r->addrbase) break;
-
-        p->relocs[index].target = r->target;
-
-        temp = (temp & ~0xFFFF) | loaddr;
-        write_uint32_le ((uint8 *) &offsbase->data[p->relocs[index].offset], temp);
+        if (relocs[index].type != R_MIPS_LO16) break;
+        if (relocs[index].offsbase != r->offsbase) break;
+        if (relocs[index].addrbase != r->addrbase) break;
+        st->unit[index] = base;
         index++;
       }
       index--;
       break;
-    case R_MIPSX_HI16:
-      r->target = ((addend & 0xFFFF) << 16) + addrbase->vaddr + r->addend;
-      addend = (addend & ~0xFFFF) | ((((r->target >> 15) + 1) >> 1) & 0xFFFF);
-      if (!prx_inside_progmem (addrbase, r->target, 1)) {
-        error (__FILE__ ": xhi16 reference out of range at 0x%08X (0x%08X)", r->vaddr, r->target);
-      }
-      write_uint32_le ((uint8 *)&offsbase->data[r->offset], addend);
-      lastxhi = r;
-      break;
-
-    case R_MIPS_16:
-    case R_MIPS_LO16:
-      r->target = (addend & 0xFFFF) + addrbase->vaddr;
-      if (lastxhi) {
-        if ((lastxhi->target & 0xFFFF) == (r->target & 0xFFFF) &&
-            lastxhi->addrbase == r->addrbase &&
-            lastxhi->offsbase == r->offsbase) {
-          r->target = lastxhi->target;
-        }
-      }
-      addend = (addend & ~0xFFFF) | (r->target & 0xFFFF);
-      if (!prx_inside_progmem (addrbase, r->target, 1)) {
-        error (__FILE__ ": lo16 reference out of range at 0x%08X (0x%08X)", r->vaddr, r->target);
-      }
-      write_uint32_le ((uint8 *)&offsbase->data[r->offset], addend);
-      break;
-
-    case R_MIPS_32:
-      r->target = addend + addrbase->vaddr;
-      addend = r->target;
-      /*if (!inside_progmem (addrbase, r->target, 1)) {
-        error (__FILE__ ": mips32 reference out of range at 0x%08X (0x%08X)", r->vaddr, r->target);
-      }*/
-      write_uint32_le ((uint8 *)&offsbase->data[r->offset], addend);
-      break;
 
     default:
       error (__FILE__ ": invalid reference type %d", r->type);
       return 0;
     }
-
   }
-
-
-  p->relocsbyaddr = xmalloc (p->relocnum * sizeof (struct prx_reloc));
-  memcpy (p->relocsbyaddr, p->relocs, p->relocnum * sizeof (struct prx_reloc));
-
-  qsort (p->relocs, p->relocnum, sizeof (struct prx_reloc), &cmp_relocs);
-  qsort (p->relocsbyaddr, p->relocnum, sizeof (struct prx_reloc), &cmp_relocs_by_addr);
-
   return 1;
 }
 
-
 static
-uint32 count_relocs_b (uint32 prgidx, const uint8 *data, uint32 size)
+void apply_unit (struct prx *p, struct relocstate *st, uint32 index)
 {
-  const uint8 *end;
-  uint8 part1s, part2s;
-  uint32 block1s, block2s;
-  uint8 block1[256], block2[256];
-  uint32 temp1, temp2, part1, part2;
-  uint32 count = 0, nbits;
+  struct prx_reloc *r, *lastxhi, *relocs = st->relocs;
+  struct elf_program *offsbase;
+  struct elf_program *addrbase;
+  uint32 addend, base, temp, start;
+  uint32 hiaddr, loaddr;
 
-  end = data + size;
-  for (nbits = 1; (1 << nbits) < prgidx; nbits++) {
-    if (nbits >= 33) {
-      error (__FILE__  ": invalid number of bits for indexes");
-      return 0;
+  start = index = st->unit[index];
+  if (st->done[index]) return;
+  st->done[index] = TRUE;
+  st->numdone++;
+
+  r = &relocs[index];
+  offsbase = &p->programs[r->offsbase];
+  addrbase = &p->programs[r->addrbase];
+
+  addend = read_uint32_le (&offsbase->data[r->offset]);
+
+  switch (r->type) {
+  case R_MIPS_NONE:
+    break;
+  case R_MIPS_26:
+  case R_MIPSX_J26:
+  case R_MIPSX_JAL26:
+    r->target = (r->offset + offsbase->vaddr) & 0xF0000000;
+    r->target = (((addend & 0x3FFFFFF) << 2) | r->target) + addrbase->vaddr;
+    addend = (addend & ~0x3FFFFFF) | (r->target >> 2);
+    if (!prx_inside_progfile (addrbase, r->target, 8)) {
+      error (__FILE__ ": mips26 reference out of range at 0x%08X (0x%08X)", r->vaddr, r->target);
+    }
+    write_uint32_le ((uint8 *)&offsbase->data[r->offset], addend);
+    break;
+  case R_MIPS_HI16:
+    base = index;
+    while (relocs[index].type == R_MIPS_HI16) index++;
+
+    temp = read_uint32_le (&offsbase->data[relocs[index].offset]) & 0xFFFF;
+    if (temp & 0x8000) temp |= ~0xFFFF;
+
+    r->target = ((addend & 0xFFFF) << 16) + addrbase->vaddr + temp;
+    if (!prx_inside_progmem (addrbase, r->target, 1)) {
+      error (__FILE__ ": hi16 reference out of range at 0x%08X (0x%08X)", r->vaddr, r->target);
     }
-  }
 
-  if (read_uint16_le (data) != 0) {
-    error (__FILE__  ": invalid header for relocation");
-    return 0;
-  }
+    loaddr = r->target & 0xFFFF;
+    hiaddr = (((r->target >> 15) + 1) >> 1) & 0xFFFF;
 
-  part1s = data[2];
-  part2s = data[3];
+    while (base < index) {
+      relocs[base].target = r->target;
+      temp = (read_uint32_le (&offsbase->data[relocs[base].offset]) & ~0xFFFF) | hiaddr;
+      write_uint32_le ((uint8 *) &offsbase->data[relocs[base].offset], temp);
+      base++;
+    }
 
-  block1s = data[4];
-  data += 4;
+    base = st->unit[index];
+    while (index < p->relocnum && st->unit[index] == base) {
+      temp = read_uint32_le (&offsbase->data[relocs[index].offset]);
+      relocs[index].target = r->target;
 
-  if (block1s) {
-    memcpy (block1, data, block1s);
-    data += block1s;
+      temp = (temp & ~0xFFFF) | loaddr;
+      write_uint32_le ((uint8 *) &offsbase->data[relocs[index].offset], temp);
+      index++;
+    }
+    break;
+  case R_MIPSX_HI16:
+    r->target = ((addend & 0xFFFF) << 16) + addrbase->vaddr + r->addend;
+    addend = (addend & ~0xFFFF) | ((((r->target >> 15) + 1) >> 1) & 0xFFFF);
+    if (!prx_inside_progmem (addrbase, r->target, 1)) {
+      error (__FILE__ ": xhi16 reference out of range at 0x%08X (0x%08X)", r->vaddr, r->target);
+    }
+    write_uint32_le ((uint8 *)&offsbase->data[r->offset], addend);
+    break;
+
+  case R_MIPS_16:
+  case R_MIPS_LO16:
+    r->target = (addend & 0xFFFF) + addrbase->vaddr;
+    if (st->lastxhi[index] != RELOC_NONE) {
+      apply_unit (p, st, st->lastxhi[index]);
+      lastxhi = &relocs[st->lastxhi[index]];
+      if ((lastxhi->target & 0xFFFF) == (r->target & 0xFFFF) &&
+          lastxhi->addrbase == r->addrbase &&
+          lastxhi->offsbase == r->offsbase) {
+        r->target = lastxhi->target;
+      }
+    }
+    addend = (addend & ~0xFFFF) | (r->target & 0xFFFF);
+    if (!prx_inside_progmem (addrbase, r->target, 1)) {
+      error (__FILE__ ": lo16 reference out of range at 0x%08X (0x%08X)", r->vaddr, r->target);
+    }
+    write_uint32_le ((uint8 *)&offsbase->data[r->offset], addend);
+    break;
+
+  case R_MIPS_32:
+    r->target = addend + addrbase->vaddr;
+    addend = r->target;
+    /*if (!inside_progmem (addrbase, r->target, 1)) {
+      error (__FILE__ ": mips32 reference out of range at 0x%08X (0x%08X)", r->vaddr, r->target);
+    }*/
+    write_uint32_le ((uint8 *)&offsbase->data[r->offset], addend);
+    break;
   }
 
-  block2s = *data;
-  if (block2s) {
-    memcpy (block2, data, block2s);
-    data += block2s;
+  /* Keep the copy sorted by address up to date */
+  if (st->pos) {
+    index = start;
+    do {
+      p->relocsbyaddr[st->pos[index]].target = relocs[index].target;
+      index++;
+    } while (index < p->relocnum && st->unit[index] == start);
   }
+}
 
+static
+void free_relocstate (struct prx *p)
+{
+  struct relocstate *st = p->relocstate;
+  if (!st) return;
+  if (st->relocs) free (st->relocs);
+  if (st->unit) free (st->unit);
+  if (st->order) free (st->order);
+  if (st->done) free (st->done);
+  free (st);
+  p->relocstate = NULL;
+}
 
-  count = 0;
-  while (data < end) {
-    uint32 cmd = read_uint16_le (data);
-    temp1 = (cmd << (16 - part1s)) & 0xFFFF;
-    temp1 = (temp1 >> (16 -part1s)) & 0xFFFF;
+/* Resolves whatever is left and builds the copy sorted by target */
+static
+void finish_relocs (struct prx *p)
+{
+  struct relocstate *st = p->relocstate;
+  uint32 index;
+
+  for (index = 0; index < p->relocnum && st->numdone < p->relocnum; index++)
+    apply_unit (p, st, index);
+
+  p->relocs = xmalloc (p->relocnum * sizeof (struct prx_reloc));
+  sort_relocs (st->relocs, p->relocs, p->relocnum, TRUE, NULL);
+  if (!p->relocsbyaddr) {
+    p->relocsbyaddr = xmalloc (p->relocnum * sizeof (struct prx_reloc));
+    sort_relocs (st->relocs, p->relocsbyaddr, p->relocnum, FALSE, NULL);
+    build_relocmap (p);
+  }
 
-    data = data + 2;
-    if (temp1 >= block1s) {
-      error (__FILE__ ": invalid index for the first part");
-      return 0;
-    }
-    part1 = block1[temp1];
-    if ((part1 & 0x06) == 0x06) {
-      error (__FILE__ ": invalid size");
-      return 0;
-    }
+  free_relocstate (p);
+}
 
-    data += part1 & 0x06;
+static
+int check_apply_relocs (struct prx *p, int lazy)
+{
+  struct relocstate *st;
+  uint32 index;
 
-    if ((part1 & 0x01) == 0) {
-      if ((part1 & 0x06) == 2) {
-        error (__FILE__ ": invalid size of part1");
-        return 0;
-      }
-    } else {
-      temp2 = (cmd << (16 - (part1s + nbits + part2s))) & 0xFFFF;
-      temp2 = (temp2 >> (16 - part2s)) & 0xFFFF;
-      if (temp2 >= block2s) {
-        error (__FILE__ ": invalid index for the second part");
-        return 0;
-      }
+  if (!validate_relocs (p, p->relocs)) return 0;
 
-      part2 = block2[temp2];
+  st = (struct relocstate *) xmalloc (sizeof (struct relocstate));
+  memset (st, 0, sizeof (struct relocstate));
+  p->relocstate = st;
 
-      switch (part1 & 0x38) {
-      case 0x00:
-        break;
-      case 0x08:
-        break;
-      case 0x10:
-        data += 2;
-        break;
-      default:
-        error (__FILE__ ": invalid addendum size");
-        return 0;
-      }
+  st->relocs = p->relocs;
+  p->relocs = NULL;
+  st->unit = (uint32 *) xmalloc (2 * p->relocnum * sizeof (uint32));
+  st->lastxhi = &st->unit[p->relocnum];
+  st->done = (uint8 *) xmalloc (p->relocnum);
+  memset (st->done, 0, p->relocnum);
 
-      switch (part2) {
-      case 1: case 2: case 3:
-      case 4: case 5: case 6: case 7:
-        count++;
-        break;
-      case 0:
-        break;
-      default:
-        error (__FILE__ ": invalid relocation type %d", part2);
-        return 0;
-      }
-    }
+  if (!group_relocs (p, st)) return 0;
+
+  if (!lazy) {
+    finish_relocs (p);
+    return 1;
+  }
+
+  /* The addresses are known, so the index by address can be built now */
+  st->order = (uint32 *) xmalloc (2 * p->relocnum * sizeof (uint32));
+  st->pos = &st->order[p->relocnum];
+  p->relocsbyaddr = xmalloc (p->relocnum * sizeof (struct prx_reloc));
+  sort_relocs (st->relocs, p->relocsbyaddr, p->relocnum, FALSE, st->order);
+  for (index = 0; index < p->relocnum; index++)
+    st->pos[st->order[index]] = index;
+
+  build_relocmap (p);
+  return 1;
+}
+
+void prx_resolve_relocs (struct prx *p, uint32 vaddr, uint32 size)
+{
+  struct relocstate *st = p->relocstate;
+  uint32 pos;
+
+  if (!st) return;
+  for (pos = prx_findrelocbyaddr (p, vaddr); pos < p->relocnum; pos++) {
+    if (p->relocsbyaddr[pos].vaddr - vaddr >= size) break;
+    apply_unit (p, st, st->order[pos]);
   }
+}
+
+void prx_resolve_all_relocs (struct prx *p)
+{
+  if (p->relocstate) finish_relocs (p);
+}
+
+
+#define RELOCB_SKIP     -1
+#define RELOCB_INVALID  -2
 
-  return count;
+static
+void grow_relocs (struct prx *p, uint32 *capacity, uint32 needed)
+{
+  uint32 newcap = *capacity;
+  if (needed <= newcap) return;
+  while (newcap < needed) newcap = newcap ? 2 * newcap : 64;
+  p->relocs = (struct prx_reloc *) xrealloc (p->relocs, newcap * sizeof (struct prx_reloc));
+  memset (&p->relocs[*capacity], 0, (newcap - *capacity) * sizeof (struct prx_reloc));
+  *capacity = newcap;
 }
 
+/* Decodes the compressed relocations in a single pass, appending them
+ * to p->relocs. The part1 and part2 fields are validated once per
+ * stream and looked up in tables for every entry */
 static
-int load_relocs_b (struct elf_program *programs, struct prx_reloc *out, uint32 prgidx, const uint8 *data, uint32 size)
+int load_relocs_b (struct prx *p, uint32 *count, uint32 *capacity, uint32 prgidx, const uint8 *data, uint32 size)
 {
   const uint8 *end;
   uint32 nbits;
   uint8 part1s, part2s;
   uint32 block1s, block2s;
   uint8 block1[256], block2[256];
+  const char *part1error[256];
+  int part2type[256];
+  uint32 part1mask, basemask, part2mask, part2shift, offsshift;
   uint32 temp1, temp2;
   uint32 part1, part2, lastpart2;
   uint32 addend = 0, offset = 0;
   uint32 offsbase = 0xFFFFFFFF;
   uint32 addrbase;
-  uint32 count;
+  uint32 start = *count, i;
+  struct prx_reloc *out;
 
   end = data + size;
   for (nbits = 1; (1 << nbits) < prgidx; nbits++) {
+    if (nbits >= 33) {
+      error (__FILE__  ": invalid number of bits for indexes");
+      return 0;
+    }
+  }
+
+  if (read_uint16_le (data) != 0) {
+    error (__FILE__  ": invalid header for relocation");
+    return 0;
   }
 
   part1s = data[2];
   part2s = data[3];
 
+  /* The fields are parts of a 16 bit command */
+  if (part1s > 16) {
+    error (__FILE__ ": invalid index for the first part");
+    return 0;
+  }
+  if (part2s > 16) {
+    error (__FILE__ ": invalid index for the second part");
+    return 0;
+  }
+
   block1s = data[4];
   data += 4;
 
@@ -343,20 +507,65 @@ int load_relocs_b (struct elf_program *programs, struct prx_reloc *out, uint32 p
     data += block2s;
   }
 
+  for (i = 0; i < 256; i++) {
+    part1error[i] = "invalid index for the first part";
+    part2type[i] = RELOCB_INVALID;
+  }
+
+  for (i = 0; i < block1s; i++) {
+    part1 = block1[i];
+    part1error[i] = NULL;
+    if ((part1 & 0x06) == 0x06) {
+      part1error[i] = "invalid size";
+    } else if ((part1 & 0x01) == 0) {
+      if ((part1 & 0x06) == 2)
+        part1error[i] = "invalid size of part1";
+    } else {
+      if ((part1 & 0x38) != 0x00 && (part1 & 0x38) != 0x08 && (part1 & 0x38) != 0x10)
+        part1error[i] = "invalid addendum size";
+    }
+  }
+
+  for (i = 0; i < block2s; i++) {
+    switch (block2[i]) {
+    case 0: part2type[i] = RELOCB_SKIP; break;
+    case 1: part2type[i] = R_MIPS_LO16; break;
+    case 2: part2type[i] = R_MIPS_32; break;
+    case 3: part2type[i] = R_MIPS_26; break;
+    case 4: part2type[i] = R_MIPSX_HI16; break;
+    case 5: part2type[i] = R_MIPS_LO16; break;
+    case 6: part2type[i] = R_MIPSX_J26; break;
+    case 7: part2type[i] = R_MIPSX_JAL26; break;
+    }
+  }
+
+  part1mask = (1 << part1s) - 1;
+  basemask = (1 << nbits) - 1;
+  part2mask = (1 << part2s) - 1;
+  part2shift = part1s + nbits;
+  offsshift = part1s + part2s + nbits;
+
+  /* Every entry takes at least two bytes */
+  grow_relocs (p, capacity, *count + (size >> 2));
 
-  count = 0;
   lastpart2 = block2s;
   while (data < end) {
     uint32 cmd = read_uint16_le (data);
-    temp1 = (cmd << (16 - part1s)) & 0xFFFF;
-    temp1 = (temp1 >> (16 -part1s)) & 0xFFFF;
+    temp1 = cmd & part1mask;
 
     data += 2;
-    part1= block1[temp1];
+    if (temp1 >= block1s) {
+      error (__FILE__ ": invalid index for the first part");
+      return 0;
+    }
+    if (part1error[temp1]) {
+      error (__FILE__ ": %s", part1error[temp1]);
+      return 0;
+    }
+    part1 = block1[temp1];
 
     if ((part1 & 0x01) == 0) {
-      offsbase = (cmd << (16 - part1s - nbits)) & 0xFFFF;
-      offsbase = (offsbase >> (16 - nbits)) & 0xFFFF;
+      offsbase = (cmd >> part1s) & basemask;
       if (!(offsbase < prgidx)) {
         error (__FILE__ ": invalid offset base");
         return 0;
@@ -367,31 +576,41 @@ int load_relocs_b (struct elf_program *programs, struct prx_reloc *out, uint32 p
       offset = read_uint32_le (data);
       data += 4;
     } else {
-      temp2 = (cmd << (16 - (part1s + nbits + part2s))) & 0xFFFF;
-      temp2 = (temp2 >> (16 - part2s)) & 0xFFFF;
+      temp2 = (cmd >> part2shift) & part2mask;
+      if (temp2 >= block2s) {
+        error (__FILE__ ": invalid index for the second part");
+        return 0;
+      }
+      if (part2type[temp2] == RELOCB_INVALID) {
+        error (__FILE__ ": invalid relocation type %d", block2[temp2]);
+        return 0;
+      }
 
-      addrbase = (cmd << (16 - part1s - nbits)) & 0xFFFF;
-      addrbase = (addrbase >> (16 - nbits)) & 0xFFFF;
+      addrbase = (cmd >> part1s) & basemask;
       if (!(addrbase < prgidx)) {
         error (__FILE__ ": invalid address base");
         return 0;
       }
+      if (!(offsbase < prgidx)) {
+        error (__FILE__ ": invalid offset base");
+        return 0;
+      }
       part2 = block2[temp2];
 
       switch (part1 & 0x06) {
       case 0:
         if (cmd & 0x8000) {
           cmd |= ~0xFFFF;
-          cmd >>= part1s + part2s + nbits;
+          cmd >>= offsshift;
           cmd |= ~0xFFFF;
         } else {
-          cmd >>= part1s + part2s + nbits;
+          cmd >>= offsshift;
         }
         offset += cmd;
         break;
       case 2:
         if (cmd & 0x8000) cmd |= ~0xFFFF;
-        cmd = (cmd >> (part1s + part2s + nbits)) << 16;
+        cmd = (cmd >> offsshift) << 16;
         cmd |= read_uint16_le (data);
         offset += cmd;
         data += 2;
@@ -402,7 +621,7 @@ int load_relocs_b (struct elf_program *programs, struct prx_reloc *out, uint32 p
         break;
       }
 
-      if (!(offset < programs[offsbase].filesz)) {
+      if (!(offset < p->programs[offsbase].filesz)) {
         error (__FILE__ ": invalid relocation offset");
         return 0;
       }
@@ -423,129 +642,82 @@ int load_relocs_b (struct elf_program *programs, struct prx_reloc *out, uint32 p
       }
 
       lastpart2 = part2;
-
-      out[count].addrbase = addrbase;
-      out[count].offsbase = offsbase;
-      out[count].offset = offset;
-      out[count].extra = 0;
-
-      switch (part2) {
-      case 2:
-        out[count++].type = R_MIPS_32;
-        break;
-      case 0:
-        break;
-      case 3:
-        out[count++].type = R_MIPS_26;
-        break;
-      case 4:
+      if (part2type[temp2] == RELOCB_SKIP) continue;
+
+      if (*count == *capacity)
+        grow_relocs (p, capacity, *count + 1);
+
+      out = &p->relocs[(*count)++];
+      out->addrbase = addrbase;
+      out->offsbase = offsbase;
+      out->offset = offset;
+      out->extra = 0;
+      out->type = part2type[temp2];
+      if (part2 == 4) {
         if (addend & 0x8000) addend |= ~0xFFFF;
-        out[count].addend = addend;
-        out[count++].type = R_MIPSX_HI16;
-        break;
-      case 1:
-      case 5:
-        out[count++].type = R_MIPS_LO16;
-        break;
-      case 6:
-        out[count++].type = R_MIPSX_J26;
-        break;
-      case 7:
-        out[count++].type = R_MIPSX_JAL26;
-        break;
+        out->addend = addend;
       }
     }
   }
 
-  return count;
+  /* An empty stream is treated as an error */
+  return (*count != start);
+}
+
+static
+void load_relocs_a (struct prx *p, uint32 *count, uint32 *capacity, uint32 offset, uint32 num)
+{
+  uint32 j;
+
+  grow_relocs (p, capacity, *count + num);
+  for (j = 0; j < num; j++) {
+    struct prx_reloc *r = &p->relocs[(*count)++];
+    r->offset = read_uint32_le (&p->data[offset]);
+    r->type = p->data[offset + 4];
+    r->offsbase = p->data[offset + 5];
+    r->addrbase = p->data[offset + 6];
+    r->extra = p->data[offset + 7];
+    offset += 8;
+  }
 }
 
 
-int load_relocs (struct prx *p)
+int load_relocs (struct prx *p, int lazy)
 {
-  uint32 i, ret, count = 0;
+  uint32 i, count = 0, capacity = 0;
 
+  p->relocs = NULL;
   for (i = 0; i < p->shnum; i++) {
     struct elf_section *section = &p->sections[i];
-    if (section->type == SHT_PRXRELOC) {
-      count += section->size >> 3;
-    }
+    if (section->type == SHT_PRXRELOC)
+      load_relocs_a (p, &count, &capacity, section->offset, section->size >> 3);
   }
+
   for (i = 0; i < p->phnum; i++) {
     struct elf_program *program = &p->programs[i];
     if (program->type == PT_PRXRELOC) {
-      count += program->filesz >> 3;
+      load_relocs_a (p, &count, &capacity, program->offset, program->filesz >> 3);
     } else if (program->type == PT_PRXRELOC2) {
-      ret = count_relocs_b (i, program->data, program->filesz);
-      if (!ret) return 0;
-      count += ret;
+      if (!load_relocs_b (p, &count, &capacity, i, program->data, program->filesz))
+        return 0;
     }
   }
 
-  p->relocs = NULL;
   if (!count) {
     error (__FILE__ ": no relocation found");
     return 0;
   }
 
   p->relocnum = count;
-  p->relocs = (struct prx_reloc *) xmalloc (count * sizeof (struct prx_reloc));
-  memset (p->relocs, 0, count * sizeof (struct prx_reloc));
-
-  count = 0;
-  for (i = 0; i < p->shnum; i++) {
-    struct elf_section *section = &p->sections[i];
-    if (section->type == SHT_PRXRELOC) {
-      uint32 j, secsize;
-      uint32 offset;
-      offset = section->offset;
-      secsize = section->size >> 3;
-      for (j = 0; j < secsize; j++) {
-        p->relocs[count].offset = read_uint32_le (&p->data[offset]);
-        p->relocs[count].type = p->data[offset + 4];
-        p->relocs[count].offsbase = p->data[offset + 5];
-        p->relocs[count].addrbase = p->data[offset + 6];
-        p->relocs[count].extra = p->data[offset + 7];
-
-        count++;
-        offset += 8;
-      }
-    }
-  }
-
-  for (i = 0; i < p->phnum; i++) {
-    struct elf_program *program = &p->programs[i];
-    if (program->type == PT_PRXRELOC) {
-      uint32 j, progsize;
-      uint32 offset;
-      offset = program->offset;
-      progsize = program->filesz >> 3;
-      for (j = 0; j < progsize; j++) {
-        p->relocs[count].offset = read_uint32_le (&p->data[offset]);
-        p->relocs[count].type = p->data[offset + 4];
-        p->relocs[count].offsbase = p->data[offset + 5];
-        p->relocs[count].addrbase = p->data[offset + 6];
-        p->relocs[count].extra = p->data[offset + 7];
-
-        count++;
-        offset += 8;
-      }
-    } else if (program->type == PT_PRXRELOC2) {
-      ret = load_relocs_b (p->programs, &p->relocs[count], i, program->data, program->filesz);
-      if (!ret) {
-        return 0;
-      }
-      count += ret;
-    }
-  }
-
-  if (!check_apply_relocs (p)) return 0;
+  if (!check_apply_relocs (p, lazy)) return 0;
 
   return 1;
 }
 
 void free_relocs (struct prx *p)
 {
+  free_relocstate (p);
+
   if (p->relocs)
     free (p->relocs);
   p->relocs = NULL;
@@ -553,6 +725,11 @@ void free_relocs (struct prx *p)
   if (p->relocsbyaddr)
     free (p->relocsbyaddr);
   p->relocsbyaddr = NULL;
+
+  if (p->relocmap)
+    free (p->relocmap);
+  p->relocmap = NULL;
+  p->relocrank = NULL;
 }
 
 
@@ -561,6 +738,8 @@ uint32 prx_findreloc (struct prx *p, uint32 target)
 {
   uint32 first, last, i;
 
+  prx_resolve_all_relocs (p);
+
   first = 0;
   last = p->relocnum;
   while (first < last) {
@@ -579,6 +758,13 @@ uint32 prx_findrelocbyaddr (struct prx *p, uint32 vaddr)
 {
   uint32 first, last, i;
 
+  if (p->relocmap) {
+    if (vaddr <= p->relocmapbase) return 0;
+    i = (vaddr - p->relocmapbase + 3) >> 2;
+    if ((i >> 5) >= p->relocmapsize) return p->relocnum;
+    return p->relocrank[i >> 5] + popcount (p->relocmap[i >> 5] & ((1U << (i & 31)) - 1U));
+  }
+
   first = 0;
   last = p->relocnum;
   while (first < last) {
@@ -593,10 +779,26 @@ uint32 prx_findrelocbyaddr (struct prx *p, uint32 vaddr)
   return first;
 }
 
+int prx_hasreloc (struct prx *p, uint32 vaddr)
+{
+  uint32 i;
+
+  if (p->relocmap) {
+    if (vaddr < p->relocmapbase || (vaddr & 0x03)) return FALSE;
+    i = (vaddr - p->relocmapbase) >> 2;
+    if ((i >> 5) >= p->relocmapsize) return FALSE;
+    return (p->relocmap[i >> 5] >> (i & 31)) & 1;
+  }
+
+  i = prx_findrelocbyaddr (p, vaddr);
+  return (i < p->relocnum && p->relocsbyaddr[i].vaddr == vaddr);
+}
 
 void print_relocs (struct prx *p)
 {
   uint32 i;
+
+  prx_resolve_all_relocs (p);
   report ("\nRelocs:\n");
   for (i = 0; i < p->relocnum; i++) {
     const char *type = "unk";
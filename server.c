@@ -0,0 +1,445 @@
+/**
+ * Author: Humberto Naves (hsnaves@gmail.com)
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "server.h"
+#include "code.h"
+#include "prx.h"
+#include "nids.h"
+#include "output.h"
+#include "outbuf.h"
+#include "utils.h"
+
+/* The server listens on a unix domain socket and keeps the most recently
+ * used nids tables and analysed modules in memory, keyed by their path
+ * and modification time.
+ *
+ * Every request and every response starts with a 32 bit little endian
+ * length. A request is made of lines, separated by '\n':
+ *   command, prx file, nids file (empty for the server default), argument
+ * where the command is one of:
+ *   info       the prx information (as -i -vv)
+ *   code       the whole C source of the prx
+ *   function   the C source of the function given by the argument
+ *   graph      the dot graph of the function given by the argument
+ *   xref       the cross references of the argument, as in --xref
+ *   shutdown   stops the server
+ * The argument is an export name or an address (0x...), as in --function;
+ * xref also takes an import name.
+ * The response length is followed by a 32 bit little endian status
+ * (0 for success) and the output, or an error message. */
+
+struct nidsentry {
+  char *path;
+  time_t mtime;
+  struct nidstable *nids;
+  unsigned long lastuse;
+};
+
+struct moduleentry {
+  char *path;
+  time_t mtime;
+  off_t size;
+  char *nidspath;
+  time_t nidsmtime;
+  struct prx *p;
+  struct code *c;
+  unsigned long lastuse;
+};
+
+struct server {
+  struct nidsentry nids[SERVER_MAX_NIDS];
+  struct moduleentry modules[SERVER_MAX_MODULES];
+  unsigned long clock;
+  const char *defnids;
+  int shutdown;
+};
+
+static
+char *dup_string (const char *str)
+{
+  char *result = (char *) xmalloc (strlen (str) + 1);
+  strcpy (result, str);
+  return result;
+}
+
+static
+void free_nids (struct nidsentry *entry)
+{
+  if (entry->path) free (entry->path);
+  if (entry->nids) nids_free (entry->nids);
+  memset (entry, 0, sizeof (struct nidsentry));
+}
+
+static
+void free_module (struct moduleentry *entry)
+{
+  if (entry->path) free (entry->path);
+  if (entry->nidspath) free (entry->nidspath);
+  if (entry->c) code_free (entry->c);
+  if (entry->p) prx_free (entry->p);
+  memset (entry, 0, sizeof (struct moduleentry));
+}
+
+static
+struct nidstable *get_nids (struct server *s, const char *path, time_t *mtime)
+{
+  struct nidsentry *entry = NULL;
+  struct stat st;
+  int i;
+
+  if (stat (path, &st) != 0) return NULL;
+  *mtime = st.st_mtime;
+
+  for (i = 0; i < SERVER_MAX_NIDS; i++) {
+    struct nidsentry *e = &s->nids[i];
+    if (e->path && strcmp (e->path, path) == 0) {
+      if (e->mtime == st.st_mtime) {
+        e->lastuse = ++s->clock;
+        return e->nids;
+      }
+      entry = e;
+      break;
+    }
+  }
+
+  if (!entry) {
+    entry = &s->nids[0];
+    for (i = 0; i < SERVER_MAX_NIDS; i++) {
+      if (!s->nids[i].path) {
+        entry = &s->nids[i];
+        break;
+      }
+      if (s->nids[i].lastuse < entry->lastuse)
+        entry = &s->nids[i];
+    }
+  }
+
+  free_nids (entry);
+  entry->nids = nids_load (path);
+  if (!entry->nids) return NULL;
+  entry->path = dup_string (path);
+  entry->mtime = st.st_mtime;
+  entry->lastuse = ++s->clock;
+  return entry->nids;
+}
+
+/* The module is only analysed by the first request that needs the code */
+static
+struct moduleentry *analyse_module (struct moduleentry *entry, int analyse, struct outbuf *err)
+{
+  if (!analyse || entry->c) return entry;
+
+  entry->c = code_analyse (entry->p);
+  if (!entry->c) {
+    free_module (entry);
+    outbuf_puts (err, "can't analyse prx file");
+    return NULL;
+  }
+  return entry;
+}
+
+static
+struct moduleentry *get_module (struct server *s, const char *path, const char *nidspath,
+                               int analyse, struct outbuf *err)
+{
+  struct moduleentry *entry = NULL;
+  struct nidstable *nids = NULL;
+  time_t nidsmtime = 0;
+  struct stat st;
+  int i;
+
+  if (stat (path, &st) != 0) {
+    outbuf_puts (err, "can't find prx file");
+    return NULL;
+  }
+
+  if (!nidspath[0] && s->defnids) nidspath = s->defnids;
+  if (nidspath[0]) {
+    nids = get_nids (s, nidspath, &nidsmtime);
+    if (!nids) {
+      outbuf_puts (err, "can't load nids file");
+      return NULL;
+    }
+  }
+
+  for (i = 0; i < SERVER_MAX_MODULES; i++) {
+    struct moduleentry *e = &s->modules[i];
+    if (e->path && strcmp (e->path, path) == 0 && strcmp (e->nidspath, nidspath) == 0) {
+      if (e->mtime == st.st_mtime && e->size == st.st_size && e->nidsmtime == nidsmtime) {
+        e->lastuse = ++s->clock;
+        return analyse_module (e, analyse, err);
+      }
+      entry = e;
+      break;
+    }
+  }
+
+  if (!entry) {
+    entry = &s->modules[0];
+    for (i = 0; i < SERVER_MAX_MODULES; i++) {
+      if (!s->modules[i].path) {
+        entry = &s->modules[i];
+        break;
+      }
+      if (s->modules[i].lastuse < entry->lastuse)
+        entry = &s->modules[i];
+    }
+  }
+
+  free_module (entry);
+  entry->p = prx_load (path, PRX_LAZY_RELOCS);
+  if (!entry->p) {
+    outbuf_puts (err, "can't load prx file");
+    return NULL;
+  }
+  if (nids) prx_resolve_nids (entry->p, nids);
+
+  entry->path = dup_string (path);
+  entry->mtime = st.st_mtime;
+  entry->size = st.st_size;
+  entry->nidspath = dup_string (nidspath);
+  entry->nidsmtime = nidsmtime;
+  entry->lastuse = ++s->clock;
+  return analyse_module (entry, analyse, err);
+}
+
+static
+int print_info (struct outbuf *out, struct prx *p)
+{
+  char buffer[4096];
+  size_t len;
+  FILE *fp;
+
+  fp = tmpfile ();
+  if (!fp) return 0;
+
+  report_redirect (fp);
+  prx_print (p, TRUE);
+  report_redirect (NULL);
+
+  rewind (fp);
+  while ((len = fread (buffer, 1, sizeof (buffer), fp)) > 0)
+    outbuf_write (out, buffer, len);
+  fclose (fp);
+  return 1;
+}
+
+static
+int handle_request (struct server *s, char *request, struct outbuf *out)
+{
+  char *fields[4];
+  struct moduleentry *entry;
+  struct subroutine *sub;
+  char basename[32], header[40];
+  int i;
+
+  for (i = 0; i < 4; i++) {
+    fields[i] = request;
+    request = strchr (request, '\n');
+    if (request) *request++ = '\0';
+    else request = &fields[i][strlen (fields[i])];
+  }
+
+  if (strcmp (fields[0], "shutdown") == 0) {
+    s->shutdown = TRUE;
+    return 1;
+  }
+
+  if (strcmp (fields[0], "info") != 0 && strcmp (fields[0], "code") != 0 &&
+      strcmp (fields[0], "function") != 0 && strcmp (fields[0], "graph") != 0 &&
+      strcmp (fields[0], "xref") != 0) {
+    outbuf_puts (out, "unknown command");
+    return 0;
+  }
+
+  entry = get_module (s, fields[1], fields[2], strcmp (fields[0], "info") != 0, out);
+  if (!entry) return 0;
+
+  if (strcmp (fields[0], "info") == 0) {
+    if (!print_info (out, entry->p)) {
+      outbuf_puts (out, "can't create temporary file");
+      return 0;
+    }
+  } else if (strcmp (fields[0], "code") == 0) {
+    get_base_name (fields[1], basename, sizeof (basename));
+    sprintf (header, "%s.h", basename);
+    print_source (out, entry->c, header);
+  } else if (strcmp (fields[0], "xref") == 0) {
+    if (!print_xrefs (out, entry->c, fields[3])) {
+      outbuf_puts (out, "can't find function or address");
+      return 0;
+    }
+  } else {
+    sub = code_find_function (entry->c, fields[3]);
+    if (!sub || sub->import) {
+      outbuf_puts (out, "can't find function");
+      return 0;
+    }
+    if (strcmp (fields[0], "function") == 0) {
+      print_subroutine (out, sub);
+    } else {
+      if (sub->haserror) {
+        outbuf_puts (out, "subroutine has errors");
+        return 0;
+      }
+      print_subroutine_graph (out, entry->c, sub);
+    }
+  }
+  return 1;
+}
+
+static
+int read_all (int fd, void *buf, size_t len)
+{
+  char *ptr = buf;
+  while (len > 0) {
+    ssize_t r = read (fd, ptr, len);
+    if (r < 0 && errno == EINTR) continue;
+    if (r <= 0) return 0;
+    ptr += r;
+    len -= r;
+  }
+  return 1;
+}
+
+static
+int write_all (int fd, const void *buf, size_t len)
+{
+  const char *ptr = buf;
+  while (len > 0) {
+    ssize_t w = write (fd, ptr, len);
+    if (w < 0 && errno == EINTR) continue;
+    if (w <= 0) return 0;
+    ptr += w;
+    len -= w;
+  }
+  return 1;
+}
+
+static
+void encode_uint32 (unsigned char *buf, uint32 val)
+{
+  buf[0] = val & 0xFF;
+  buf[1] = (val >> 8) & 0xFF;
+  buf[2] = (val >> 16) & 0xFF;
+  buf[3] = (val >> 24) & 0xFF;
+}
+
+static
+int send_response (int fd, int status, struct outbuf *out)
+{
+  unsigned char header[8];
+  struct outchunk *chunk;
+
+  encode_uint32 (header, out->size + 4);
+  encode_uint32 (&header[4], status ? 0 : 1);
+  if (!write_all (fd, header, sizeof (header))) return 0;
+
+  for (chunk = out->head; chunk; chunk = chunk->next)
+    if (!write_all (fd, chunk->data, chunk->size)) return 0;
+  return 1;
+}
+
+/* Answers the requests of a connection until it is closed */
+static
+void handle_connection (struct server *s, int fd)
+{
+  unsigned char header[4];
+  char *request;
+  uint32 len;
+
+  while (!s->shutdown && read_all (fd, header, sizeof (header))) {
+    struct outbuf *out;
+    int status;
+
+    len = header[0] | (header[1] << 8) | (header[2] << 16) | ((uint32) header[3] << 24);
+    if (len > SERVER_MAX_REQUEST) {
+      error (__FILE__ ": request too large");
+      break;
+    }
+
+    request = (char *) xmalloc (len + 1);
+    if (!read_all (fd, request, len)) {
+      free (request);
+      break;
+    }
+    request[len] = '\0';
+
+    out = outbuf_alloc ();
+    status = handle_request (s, request, out);
+    free (request);
+
+    status = send_response (fd, status, out);
+    outbuf_free (out);
+    if (!status) break;
+  }
+}
+
+int server_run (const char *path, const char *nidsfile)
+{
+  struct sockaddr_un addr;
+  struct server s;
+  int fd, i;
+
+  if (strlen (path) >= sizeof (addr.sun_path)) {
+    error (__FILE__ ": socket path too long `%s'", path);
+    return 0;
+  }
+
+  fd = socket (AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    xerror (__FILE__ ": can't create socket");
+    return 0;
+  }
+
+  memset (&addr, 0, sizeof (addr));
+  addr.sun_family = AF_UNIX;
+  strcpy (addr.sun_path, path);
+  unlink (path);
+
+  if (bind (fd, (struct sockaddr *) &addr, sizeof (addr)) != 0 || listen (fd, 8) != 0) {
+    xerror (__FILE__ ": can't listen on socket `%s'", path);
+    close (fd);
+    return 0;
+  }
+
+  /* A client going away must not kill the server */
+  signal (SIGPIPE, SIG_IGN);
+
+  memset (&s, 0, sizeof (s));
+  s.defnids = nidsfile;
+
+  while (!s.shutdown) {
+    int conn = accept (fd, NULL, NULL);
+    if (conn < 0) {
+      if (errno == EINTR) continue;
+      xerror (__FILE__ ": can't accept connection");
+      break;
+    }
+    handle_connection (&s, conn);
+    close (conn);
+  }
+
+  close (fd);
+  unlink (path);
+
+  for (i = 0; i < SERVER_MAX_MODULES; i++)
+    free_module (&s.modules[i]);
+  for (i = 0; i < SERVER_MAX_NIDS; i++)
+    free_nids (&s.nids[i]);
+  return 1;
+}
@@ -0,0 +1,14 @@
+/**
+ * Author: Humberto Naves (hsnaves@gmail.com)
+ */
+
+#ifndef __SERVER_H
+#define __SERVER_H
+
+#define SERVER_MAX_MODULES   8
+#define SERVER_MAX_NIDS      4
+#define SERVER_MAX_REQUEST   65536
+
+int server_run (const char *path, const char *nidsfile);
+
+#endif /* __SERVER_H */
@@ -2,6 +2,8 @@
  * Author: Humberto Naves (hsnaves@gmail.com)
  */
 
+#include <stdlib.h>
+
 #include "code.h"
 #include "utils.h"
 
@@ -41,6 +43,7 @@ void ssa_place_phis (struct subroutine *sub, list *defblocks)
 
     while (list_size (worklist) != 0) {
       block = list_removehead (worklist);
+      if (!budget_spend (sub, 1 + list_size (block->node.frontier))) return;
       ref = list_head (block->node.frontier);
       while (ref) {
         brefnode = element_getvalue (ref);
@@ -67,14 +70,16 @@ void ssa_place_phis (struct subroutine *sub, list *defblocks)
   }
 }
 
+/* Renames the variables of the block, and marks in pushed the
+ * registers whose definitions were pushed into vars */
 static
-void ssa_search (struct basicblock *block, list *vars)
+void ssa_rename (struct basicblock *block, list *vars, uint32 *pushed)
 {
   element el;
-  int regno, pushed[NUM_REGISTERS];
+  int regno;
 
-  for (regno = 1; regno < NUM_REGISTERS; regno++)
-    pushed[regno] = FALSE;
+  for (regno = 0; regno < NUM_REGMASK; regno++)
+    pushed[regno] = 0;
 
   el = list_head (block->operations);
   while (el) {
@@ -111,8 +116,8 @@ void ssa_search (struct basicblock *block, list *vars)
         var->name.val.intval = val->val.intval;
         var->def = op;
         list_inserttail (block->sub->ssavars, var);
-        if (!pushed[val->val.intval]) {
-          pushed[val->val.intval] = TRUE;
+        if (!IS_BIT_SET (pushed, val->val.intval)) {
+          BIT_SET (pushed, val->val.intval);
           list_inserthead (vars[val->val.intval], var);
         } else {
           element_setvalue (list_head (vars[val->val.intval]), var);
@@ -157,19 +162,56 @@ void ssa_search (struct basicblock *block, list *vars)
     el = element_next (el);
   }
 
-  el = list_head (block->node.children);
-  while (el) {
-    struct basicblocknode *childnode;
-    struct basicblock *child;
+}
 
-    childnode = element_getvalue (el);
-    child = element_getvalue (childnode->blockel);
-    ssa_search (child, vars);
-    el = element_next (el);
+/* The renaming walks the dominator tree with an explicit stack, as its
+ * depth grows with the length of the subroutine */
+struct ssaframe {
+  struct basicblock *block;
+  element child;
+  uint32 pushed[NUM_REGMASK];
+};
+
+static
+void ssa_search (struct basicblock *start, list *vars)
+{
+  struct ssaframe *frames;
+  int count = 0, alloc = 64, regno;
+
+  frames = (struct ssaframe *) xmalloc (alloc * sizeof (struct ssaframe));
+  frames[0].block = start;
+  frames[0].child = list_head (start->node.children);
+  ssa_rename (start, vars, frames[0].pushed);
+  count = 1;
+
+  while (count) {
+    struct ssaframe *f = &frames[count - 1];
+
+    if (f->child) {
+      struct basicblocknode *childnode;
+      struct basicblock *child;
+
+      childnode = element_getvalue (f->child);
+      child = element_getvalue (childnode->blockel);
+      f->child = element_next (f->child);
+
+      if (count == alloc) {
+        alloc *= 2;
+        frames = (struct ssaframe *) xrealloc (frames, alloc * sizeof (struct ssaframe));
+      }
+      f = &frames[count++];
+      f->block = child;
+      f->child = list_head (child->node.children);
+      ssa_rename (child, vars, f->pushed);
+      if (!budget_spend (child->sub, list_size (child->operations))) break;
+    } else {
+      for (regno = 1; regno < NUM_REGISTERS; regno++)
+        if (IS_BIT_SET (f->pushed, regno)) list_removehead (vars[regno]);
+      count--;
+    }
   }
 
-  for (regno = 1; regno < NUM_REGISTERS; regno++)
-    if (pushed[regno]) list_removehead (vars[regno]);
+  free (frames);
 }
 
 void build_ssa (struct subroutine *sub)
@@ -196,7 +238,8 @@ void build_ssa (struct subroutine *sub)
   }
 
   ssa_place_phis (sub, reglist);
-  ssa_search (sub->startblock, reglist);
+  if (!sub->haserror)
+    ssa_search (sub->startblock, reglist);
 
   for (regno = 1; regno < NUM_REGISTERS; regno++) {
     list_free (reglist[regno]);
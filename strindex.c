@@ -0,0 +1,191 @@
+/**
+ * Author: Humberto Naves (hsnaves@gmail.com)
+ */
+
+#include <stdlib.h>
+
+#include "strindex.h"
+#include "utils.h"
+
+/* The shortest run shown as a string */
+#define STRINDEX_MINLEN  4
+#define STRINDEX_RAW     0xFFFFFFFF
+
+#define IS_STRCHAR(ch) (((ch) >= 32 && (ch) < 127) || ((ch) >= '\t' && (ch) <= '\r'))
+
+struct strrun {
+  uint32 begin, end;               /* The run, in file offsets */
+  uint32 escaped, escapedlen;      /* Its escaped text (or STRINDEX_RAW) */
+};
+
+/* The runs are found in a single pass over the file. A bitmap with one
+ * bit per byte marks where each run begins, and the number of runs
+ * before each word of the bitmap turns an offset into its run with a
+ * population count. Only the runs with characters to escape keep an
+ * escaped copy, the others are printed straight from the file data.
+ * A second bitmap marks these characters, so that the position of an
+ * offset in the escaped copy is also found with population counts */
+struct strindex {
+  const uint8 *data;
+  uint32 size;
+  uint32 *starts;
+  uint32 *rank;
+  uint32 *escapes;
+  uint32 *escrank;
+  struct strrun *runs;
+  uint32 numruns, runsalloc;
+  char *escaped;
+  uint32 escapedsize, escapedalloc;
+};
+
+static
+char escape_char (uint8 ch)
+{
+  switch (ch) {
+  case '\t': return 't';
+  case '\r': return 'r';
+  case '\n': return 'n';
+  case '\v': return 'v';
+  case '\f': return 'f';
+  }
+  return 0;
+}
+
+static
+void escape_run (struct strindex *idx, struct strrun *run)
+{
+  uint32 off;
+
+  run->escaped = idx->escapedsize;
+  for (off = run->begin; off < run->end; off++) {
+    uint8 ch = idx->data[off];
+    char esc = escape_char (ch);
+
+    if (idx->escapedsize + 2 > idx->escapedalloc) {
+      idx->escapedalloc = idx->escapedalloc ? 2 * idx->escapedalloc : 4096;
+      idx->escaped = (char *) xrealloc (idx->escaped, idx->escapedalloc);
+    }
+    if (esc) {
+      idx->escaped[idx->escapedsize++] = '\\';
+      idx->escaped[idx->escapedsize++] = esc;
+    } else {
+      idx->escaped[idx->escapedsize++] = ch;
+    }
+  }
+  run->escapedlen = idx->escapedsize - run->escaped;
+}
+
+static
+void add_run (struct strindex *idx, uint32 begin, uint32 end, int hasescapes)
+{
+  struct strrun *run;
+
+  if (idx->numruns == idx->runsalloc) {
+    idx->runsalloc = idx->runsalloc ? 2 * idx->runsalloc : 256;
+    idx->runs = (struct strrun *) xrealloc (idx->runs, idx->runsalloc * sizeof (struct strrun));
+  }
+  run = &idx->runs[idx->numruns++];
+  run->begin = begin;
+  run->end = end;
+  run->escaped = STRINDEX_RAW;
+  run->escapedlen = 0;
+  if (hasescapes) escape_run (idx, run);
+
+  idx->starts[begin >> 5] |= 1U << (begin & 31);
+}
+
+struct strindex *strindex_build (const uint8 *data, uint32 size)
+{
+  struct strindex *idx;
+  uint32 off, begin, words, i;
+  int hasescapes;
+
+  idx = (struct strindex *) xmalloc (sizeof (struct strindex));
+  idx->data = data;
+  idx->size = size;
+  idx->runs = NULL;
+  idx->numruns = idx->runsalloc = 0;
+  idx->escaped = NULL;
+  idx->escapedsize = idx->escapedalloc = 0;
+
+  words = (size >> 5) + 1;
+  idx->starts = (uint32 *) xmalloc (4 * words * sizeof (uint32));
+  idx->rank = &idx->starts[words];
+  idx->escapes = &idx->starts[2 * words];
+  idx->escrank = &idx->starts[3 * words];
+  for (i = 0; i < words; i++)
+    idx->starts[i] = idx->escapes[i] = 0;
+
+  off = 0;
+  while (off < size) {
+    while (off < size && !IS_STRCHAR (data[off])) off++;
+
+    begin = off;
+    hasescapes = FALSE;
+    while (off < size && IS_STRCHAR (data[off])) {
+      if (data[off] < 32) {
+        idx->escapes[off >> 5] |= 1U << (off & 31);
+        hasescapes = TRUE;
+      }
+      off++;
+    }
+
+    if (off - begin >= STRINDEX_MINLEN)
+      add_run (idx, begin, off, hasescapes);
+  }
+
+  idx->rank[0] = idx->escrank[0] = 0;
+  for (i = 1; i < words; i++) {
+    idx->rank[i] = idx->rank[i - 1] + popcount (idx->starts[i - 1]);
+    idx->escrank[i] = idx->escrank[i - 1] + popcount (idx->escapes[i - 1]);
+  }
+
+  return idx;
+}
+
+void strindex_free (struct strindex *idx)
+{
+  if (idx->runs) free (idx->runs);
+  if (idx->escaped) free (idx->escaped);
+  free (idx->starts);
+  free (idx);
+}
+
+/* The number of characters to escape before offset */
+static
+uint32 escapes_before (struct strindex *idx, uint32 offset)
+{
+  uint32 word = offset >> 5;
+  return idx->escrank[word] +
+    popcount (idx->escapes[word] & ((1U << (offset & 31)) - 1U));
+}
+
+int strindex_find (struct strindex *idx, uint32 offset, const char **text, uint32 *len)
+{
+  struct strrun *run;
+  uint32 word, count, pos;
+
+  if (offset >= idx->size) return FALSE;
+
+  /* The runs beginning at or before offset */
+  word = offset >> 5;
+  count = idx->rank[word] +
+    popcount (idx->starts[word] & (((uint32) 2 << (offset & 31)) - 1));
+  if (!count) return FALSE;
+
+  run = &idx->runs[count - 1];
+  if (offset >= run->end || run->end - offset < STRINDEX_MINLEN)
+    return FALSE;
+
+  if (run->escaped == STRINDEX_RAW) {
+    *text = (const char *) &idx->data[offset];
+    *len = run->end - offset;
+  } else {
+    /* Every escaped character takes two */
+    pos = run->escaped + (offset - run->begin) +
+      escapes_before (idx, offset) - escapes_before (idx, run->begin);
+    *text = &idx->escaped[pos];
+    *len = run->escaped + run->escapedlen - pos;
+  }
+  return TRUE;
+}
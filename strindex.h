@@ -0,0 +1,21 @@
+/**
+ * Author: Humberto Naves (hsnaves@gmail.com)
+ */
+
+#ifndef __STRINDEX_H
+#define __STRINDEX_H
+
+#include "types.h"
+
+/* The runs of printable characters of a file that are long enough to
+ * be shown as string literals, indexed by file offset */
+struct strindex;
+
+struct strindex *strindex_build (const uint8 *data, uint32 size);
+void strindex_free (struct strindex *idx);
+
+/* Finds the string starting at offset, which can be inside a run. The
+ * text is already escaped for a C string literal (without the quotes) */
+int strindex_find (struct strindex *idx, uint32 offset, const char **text, uint32 *len);
+
+#endif /* __STRINDEX_H */
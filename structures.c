@@ -2,6 +2,8 @@
  * Author: Humberto Naves (hsnaves@gmail.com)
  */
 
+#include <stdlib.h>
+
 #include "code.h"
 #include "utils.h"
 
@@ -14,144 +16,289 @@ struct ctrlstruct *alloc_ctrlstruct (struct basicblock *block, enum ctrltype typ
   return st;
 }
 
+/* The loops are found with Havlak's loop nesting forest algorithm. The
+ * blocks are numbered in the preorder of the depth first search tree
+ * (kept in mark1), and the headers are visited in reverse preorder, so
+ * that the inner loops are found first. Each loop found is collapsed
+ * into its header with a union-find, so that the body of an outer loop
+ * is walked through the headers of its inner loops only. A loop entered
+ * elsewhere than through its header is irreducible: its header is the
+ * block with the lowest preorder number, and the other entries are gotos */
+struct loopforest {
+  struct subroutine *sub;
+  int count;
+  struct basicblock **blocks;    /* The blocks in preorder */
+  int *last;                     /* The last preorder number in the subtree */
+  int *uf;                       /* Union-find parent */
+  int *header;                   /* The innermost loop header (or -1) */
+  int *depth;                    /* The nesting depth of each header */
+  int *inloop;                   /* Marks the blocks already in the loop */
+  int *worklist;
+  struct ctrlstruct **loops;     /* The loop of each header */
+  list *entries;                 /* The edges entering an irreducible loop */
+};
+
+#define IS_ANCESTOR(f, a, b) ((a) <= (b) && (b) <= (f)->last[a])
+
 static
-int mark_backward (struct basicblock *start, list worklist, int num)
+void number_preorder (struct loopforest *f)
 {
-  struct basicblock *block;
-  element ref;
-  int count = 0;
+  struct basicblocknode **stack;
+  element *next;
+  int top = 0, num = 0;
+
+  stack = (struct basicblocknode **) xmalloc (f->count * sizeof (struct basicblocknode *));
+  next = (element *) xmalloc (f->count * sizeof (element));
+
+  stack[0] = &f->sub->startblock->node;
+  next[0] = list_head (stack[0]->children);
+  f->sub->startblock->mark1 = num;
+  f->blocks[num++] = f->sub->startblock;
+
+  while (top >= 0) {
+    if (next[top]) {
+      struct basicblocknode *child = element_getvalue (next[top]);
+      struct basicblock *block = element_getvalue (child->blockel);
+      next[top] = element_next (next[top]);
+
+      block->mark1 = num;
+      f->blocks[num++] = block;
+      stack[++top] = child;
+      next[top] = list_head (child->children);
+    } else {
+      struct basicblock *block = element_getvalue (stack[top]->blockel);
+      f->last[block->mark1] = num - 1;
+      top--;
+    }
+  }
 
-  while (list_size (worklist) != 0) {
-    block = list_removetail (worklist);
-    if (block->mark1 == num) continue;
-    block->mark1 = num;
-    count++;
+  free (stack);
+  free (next);
+}
 
-    ref = list_head (block->inrefs);
-    while (ref) {
-      struct basicedge *edge = element_getvalue (ref);
-      struct basicblock *next = edge->from;
-      ref = element_next (ref);
+static
+int loop_find (struct loopforest *f, int x)
+{
+  int root = x;
+  while (f->uf[root] != root) root = f->uf[root];
+  while (f->uf[x] != root) {
+    int parent = f->uf[x];
+    f->uf[x] = root;
+    x = parent;
+  }
+  return root;
+}
 
-      if (next->node.dfsnum < start->node.dfsnum)
-        continue;
+/* Adds the entry y of the loop being built at w, or records it as an
+ * irreducible entry when it comes from outside the subtree of w */
+static
+void loop_visit (struct loopforest *f, int w, struct basicedge *edge, int *count)
+{
+  int y = loop_find (f, edge->from->mark1);
+
+  if (!IS_ANCESTOR (f, w, y)) {
+    if (!f->entries[w])
+      f->entries[w] = list_alloc (f->sub->code->lstpool);
+    list_inserttail (f->entries[w], edge);
+  } else if (y != w && f->inloop[y] != w) {
+    f->inloop[y] = w;
+    f->worklist[(*count)++] = y;
+  }
+}
 
-      if (next->node.dfsnum >= block->node.dfsnum)
-        if (!dom_isancestor (&block->node, &next->node) ||
-            !dom_isancestor (&block->revnode, &next->revnode))
-          continue;
+static
+void build_loop (struct loopforest *f, int w)
+{
+  struct basicblock *block = f->blocks[w];
+  struct ctrlstruct *loop = NULL;
+  int count = 0, pos = 0;
+  element ref;
 
-      if (next->mark1 != num) {
-        list_inserthead (worklist, next);
-      }
+  ref = list_head (block->inrefs);
+  while (ref) {
+    struct basicedge *edge = element_getvalue (ref);
+    int v = edge->from->mark1;
+    ref = element_next (ref);
+
+    if (!IS_ANCESTOR (f, w, v)) continue;
+
+    edge->type = EDGE_CONTINUE;
+    if (!loop) {
+      loop = alloc_ctrlstruct (block, CONTROL_LOOP);
+      loop->info.loopctrl.edges = list_alloc (f->sub->code->lstpool);
+    }
+    list_inserttail (loop->info.loopctrl.edges, edge);
+
+    v = loop_find (f, v);
+    if (v != w && f->inloop[v] != w) {
+      f->inloop[v] = w;
+      f->worklist[count++] = v;
     }
   }
 
-  return count;
-}
+  if (!loop) return;
+  f->loops[w] = loop;
 
-static
-void mark_forward (struct basicblock *start, struct ctrlstruct *loop, int num, int count)
-{
-  element el, ref;
+  while (pos < count) {
+    int x = f->worklist[pos++];
 
-  el = start->node.blockel;
-  while (el && count) {
-    struct basicblock *block = element_getvalue (el);
-    if (block->mark1 == num) {
-      block->loopst = loop; count--;
-      ref = list_head (block->outrefs);
+    ref = list_head (f->blocks[x]->inrefs);
+    while (ref) {
+      struct basicedge *edge = element_getvalue (ref);
+      ref = element_next (ref);
+      if (!IS_ANCESTOR (f, x, edge->from->mark1))
+        loop_visit (f, w, edge, &count);
+    }
+
+    if (f->entries[x]) {
+      ref = list_head (f->entries[x]);
       while (ref) {
-        struct basicedge *edge = element_getvalue (ref);
-        struct basicblock *next = edge->to;
-        if (next->mark1 != num) {
-          /* edge->type = EDGE_GOTO;
-          next->status |= BLOCK_STAT_HASLABEL; */
-          if (!loop->end) loop->end = next;
-          if (list_size (loop->end->inrefs) < list_size (next->inrefs))
-            loop->end = next;
-        }
+        loop_visit (f, w, element_getvalue (ref), &count);
         ref = element_next (ref);
       }
     }
+  }
 
-    el = element_next (el);
+  while (count > 0) {
+    int x = f->worklist[--count];
+    f->header[x] = w;
+    f->uf[x] = w;
   }
 }
 
 static
-void mark_loop (struct ctrlstruct *loop, int num)
+struct ctrlstruct *block_loop (struct loopforest *f, int x)
 {
-  element el;
-  list worklist;
-  int count;
+  if (f->loops[x]) return f->loops[x];
+  if (f->header[x] < 0) return NULL;
+  return f->loops[f->header[x]];
+}
 
-  worklist = list_alloc (loop->start->sub->code->lstpool);
-  el = list_head (loop->info.loopctrl.edges);
-  while (el) {
-    struct basicedge *edge = element_getvalue (el);
-    struct basicblock *block = edge->from;
+/* The header of the loop enclosing the loop of header w */
+static
+int parent_loop (struct loopforest *f, int w)
+{
+  return f->header[w];
+}
 
-    list_inserttail (worklist, block);
-    el = element_next (el);
-  }
-  count = mark_backward (loop->start, worklist, num);
-
-  mark_forward (loop->start, loop, num, count);
-  if (loop->end) {
-    /* loop->end->status &= ~BLOCK_STAT_HASLABEL; */
-    el = list_head (loop->end->inrefs);
-    while (el) {
-      struct basicedge *edge = element_getvalue (el);
-      if (edge->from->loopst == loop)
-        edge->type = EDGE_BREAK;
-      el = element_next (el);
+/* Updates the end of the loops left by the edge */
+static
+void loop_exits (struct loopforest *f, struct basicedge *edge)
+{
+  int a, b;
+
+  a = f->loops[edge->from->mark1] ? edge->from->mark1 : f->header[edge->from->mark1];
+  b = f->loops[edge->to->mark1] ? edge->to->mark1 : f->header[edge->to->mark1];
+
+  while (a >= 0 && a != b) {
+    if (b < 0 || f->depth[a] >= f->depth[b]) {
+      struct ctrlstruct *loop = f->loops[a];
+      if (!loop->end) loop->end = edge->to;
+      if (list_size (loop->end->inrefs) < list_size (edge->to->inrefs))
+        loop->end = edge->to;
+      a = parent_loop (f, a);
+    } else {
+      b = parent_loop (f, b);
     }
   }
+}
 
-  list_free (worklist);
+/* Is the block x inside the loop of header w? */
+static
+int in_loop (struct loopforest *f, int w, int x)
+{
+  if (!f->loops[x]) x = f->header[x];
+  while (x >= 0 && f->depth[x] > f->depth[w])
+    x = parent_loop (f, x);
+  return x == w;
 }
 
 static
 void extract_loops (struct subroutine *sub)
 {
-  struct basicblock *block;
-  struct basicedge *edge;
-  struct ctrlstruct *loop;
+  struct loopforest f;
+  int i, irreducible = FALSE;
   element el, ref;
-  int num = 0;
+
+  f.sub = sub;
+  f.count = list_size (sub->dfsblocks);
+  f.blocks = (struct basicblock **) xmalloc (f.count * sizeof (struct basicblock *));
+  f.last = (int *) xmalloc (f.count * sizeof (int));
+  f.uf = (int *) xmalloc (f.count * sizeof (int));
+  f.header = (int *) xmalloc (f.count * sizeof (int));
+  f.depth = (int *) xmalloc (f.count * sizeof (int));
+  f.inloop = (int *) xmalloc (f.count * sizeof (int));
+  f.worklist = (int *) xmalloc (f.count * sizeof (int));
+  f.loops = (struct ctrlstruct **) xmalloc (f.count * sizeof (struct ctrlstruct *));
+  f.entries = (list *) xmalloc (f.count * sizeof (list));
+
+  number_preorder (&f);
+  for (i = 0; i < f.count; i++) {
+    f.uf[i] = i;
+    f.header[i] = -1;
+    f.inloop[i] = -1;
+    f.loops[i] = NULL;
+    f.entries[i] = NULL;
+  }
+
+  for (i = f.count - 1; i >= 0; i--)
+    build_loop (&f, i);
+
+  for (i = 0; i < f.count; i++) {
+    f.depth[i] = 0;
+    if (f.loops[i])
+      f.depth[i] = (f.header[i] >= 0) ? f.depth[f.header[i]] + 1 : 1;
+    f.blocks[i]->loopst = block_loop (&f, i);
+  }
 
   el = list_head (sub->dfsblocks);
   while (el) {
-    block = element_getvalue (el);
-
-    loop = NULL;
-    ref = list_head (block->inrefs);
+    struct basicblock *block = element_getvalue (el);
+    ref = list_head (block->outrefs);
     while (ref) {
-      edge = element_getvalue (ref);
-      if (edge->from->node.dfsnum >= block->node.dfsnum) {
-        edge->type = EDGE_CONTINUE;
-        if (!dom_isancestor (&block->node, &edge->from->node)) {
-          error (__FILE__ ": graph of sub 0x%08X is not reducible (using goto)", sub->begin->address);
-          edge->type = EDGE_INVALID;
-          edge->to->status |= BLOCK_STAT_HASLABEL;
-        } else if (block->loopst == edge->from->loopst) {
-          if (!loop) {
-            loop = alloc_ctrlstruct (block, CONTROL_LOOP);
-            loop->info.loopctrl.edges = list_alloc (sub->code->lstpool);
-          }
-          list_inserttail (loop->info.loopctrl.edges, edge);
-        }/* else {
-          edge->type = EDGE_GOTO;
-          edge->to->status |= BLOCK_STAT_HASLABEL;
-        }*/
-      }
+      loop_exits (&f, element_getvalue (ref));
       ref = element_next (ref);
     }
-    if (loop)
-      mark_loop (loop, ++num);
     el = element_next (el);
   }
+
+  for (i = 0; i < f.count; i++) {
+    struct ctrlstruct *loop = f.loops[i];
+    if (!loop || !loop->end) continue;
+    ref = list_head (loop->end->inrefs);
+    while (ref) {
+      struct basicedge *edge = element_getvalue (ref);
+      if (in_loop (&f, i, edge->from->mark1))
+        edge->type = EDGE_BREAK;
+      ref = element_next (ref);
+    }
+  }
+
+  for (i = 0; i < f.count; i++) {
+    if (!f.entries[i]) continue;
+    irreducible = TRUE;
+    ref = list_head (f.entries[i]);
+    while (ref) {
+      struct basicedge *edge = element_getvalue (ref);
+      edge->type = EDGE_GOTO;
+      edge->to->status |= BLOCK_STAT_HASLABEL;
+      ref = element_next (ref);
+    }
+    list_free (f.entries[i]);
+  }
+
+  if (irreducible)
+    error (__FILE__ ": graph of sub 0x%08X is not reducible (using goto)", sub->begin->address);
+
+  free (f.blocks);
+  free (f.last);
+  free (f.uf);
+  free (f.header);
+  free (f.depth);
+  free (f.inloop);
+  free (f.worklist);
+  free (f.loops);
+  free (f.entries);
 }
 
 static
@@ -178,36 +325,124 @@ void extract_returns (struct subroutine *sub)
   extract_returns_step (sub->endblock);
 }
 
+/* The structures are found with a depth first search, that keeps its
+ * frames in an explicit stack instead of recursing, so that the long
+ * chains of blocks found in large subroutines can't overflow the stack.
+ * Each frame resumes at the state where the recursive search would
+ * return from the visit of a successor */
+enum searchstate {
+  SEARCH_ENTER,
+  SEARCH_LOOP,
+  SEARCH_SWITCH,
+  SEARCH_IFELSE,
+  SEARCH_IFEND,
+  SEARCH_DONE
+};
+
+struct searchframe {
+  struct basicblock *block;
+  struct ctrlstruct *parentst;
+  int blockcond;
+  enum searchstate state;
+  struct ctrlstruct *nst;
+  struct basicblock *end;
+  struct basicedge *edge1, *edge2;
+  element ref;
+};
+
+struct searchstack {
+  struct searchframe *frames;
+  int count, alloc;
+};
+
 static
-void structure_search (struct basicblock *block, struct ctrlstruct *parentst, int blockcond)
+void search_push (struct searchstack *s, struct basicblock *block, struct ctrlstruct *parentst, int blockcond)
 {
-  block->st = parentst;
+  struct searchframe *f;
+
+  if (s->count == s->alloc) {
+    s->alloc = s->alloc ? 2 * s->alloc : 64;
+    s->frames = (struct searchframe *) xrealloc (s->frames, s->alloc * sizeof (struct searchframe));
+  }
+  f = &s->frames[s->count++];
+  f->block = block;
+  f->parentst = parentst;
+  f->blockcond = blockcond;
+  f->state = SEARCH_ENTER;
+}
+
+/* Visits the block and resumes the current frame at state next. When
+ * there is nothing left to do in the current frame, it is reused */
+static
+void search_visit (struct searchstack *s, enum searchstate next,
+                   struct basicblock *block, struct ctrlstruct *parentst, int blockcond)
+{
+  s->frames[s->count - 1].state = next;
+  if (next == SEARCH_DONE) s->count--;
+  search_push (s, block, parentst, blockcond);
+}
+
+static
+void search_enter (struct searchstack *s, struct searchframe *f)
+{
+  struct basicblock *block = f->block;
+
+  block->st = f->parentst;
   block->mark1 = 1;
-  block->blockcond = blockcond;
+  block->blockcond = f->blockcond;
+  f->state = SEARCH_LOOP;
 
   if (block->loopst) {
     if (block->loopst->start == block) {
       if (block->loopst->end) {
         if (block->loopst->end->mark1) {
-          if (parentst->end != block->loopst->end) {
+          if (f->parentst->end != block->loopst->end) {
             block->loopst->hasendgoto = TRUE;
             block->loopst->end->status |= BLOCK_STAT_HASLABEL;
           }
         } else {
           block->loopst->endfollow = TRUE;
-          structure_search (block->loopst->end, parentst, blockcond);
+          search_visit (s, SEARCH_LOOP, block->loopst->end, f->parentst, f->blockcond);
         }
       }
+    }
+  }
+}
+
+/* Follows the only unknown edge of the block */
+static
+void search_next (struct searchstack *s, struct basicblock *block, struct basicedge *edge, int blockcond)
+{
+  if (edge->to == block->st->end && block->st->type == CONTROL_IF) {
+    edge->type = EDGE_IFEXIT;
+  } else {
+    if (edge->to->mark1) {
+      edge->type = EDGE_GOTO;
+      edge->to->status |= BLOCK_STAT_HASLABEL;
+    } else {
+      edge->type = EDGE_NEXT;
+      search_visit (s, SEARCH_DONE, edge->to, block->st, blockcond);
+    }
+  }
+}
+
+static
+void search_block (struct searchstack *s, struct searchframe *f)
+{
+  struct basicblock *block = f->block;
 
+  f->state = SEARCH_DONE;
+
+  if (block->loopst) {
+    if (block->loopst->start == block) {
       block->st = block->loopst;
-      block->st->parent = parentst;
-      block->st->identsize = parentst->identsize + 1;
+      block->st->parent = f->parentst;
+      block->st->identsize = f->parentst->identsize + 1;
     }
   }
 
   if (block->status & BLOCK_STAT_ISSWITCH) {
     struct ctrlstruct *nst;
-    element ref;
 
     nst = alloc_ctrlstruct (block, CONTROL_SWITCH);
     nst->end = element_getvalue (block->revnode.dominator->blockel);
@@ -215,23 +450,9 @@ void structure_search (struct basicblock *block, struct ctrlstruct *parentst, in
     nst->identsize = block->st->identsize + 1;
     block->ifst = nst;
 
-    ref = list_head (block->outrefs);
-    while (ref) {
-      struct basicedge *edge = element_getvalue (ref);
-
-      if (edge->type == EDGE_UNKNOWN) {
-        edge->type = EDGE_CASE;
-        if (!edge->to->mark1) {
-          structure_search (edge->to, nst, edge->fromnum);
-        } else {
-          if (edge->to->st != nst) {
-            edge->type = EDGE_GOTO;
-            edge->to->status |= BLOCK_STAT_HASLABEL;
-          }
-        }
-      }
-      ref = element_next (ref);
-    }
+    f->nst = nst;
+    f->ref = list_head (block->outrefs);
+    f->state = SEARCH_SWITCH;
   } else if (list_size (block->outrefs) == 2) {
     struct basicblock *end;
     struct basicedge *edge1, *edge2;
@@ -267,57 +488,25 @@ void structure_search (struct basicblock *block, struct ctrlstruct *parentst, in
         }
       }
 
+      f->nst = nst;
+      f->end = end;
+      f->edge1 = edge1;
+      f->edge2 = edge2;
+      f->state = SEARCH_IFELSE;
+
       if (edge1->to == end) {
         edge1->type = EDGE_IFEXIT;
       } else {
         edge1->type = EDGE_IFENTER;
-        structure_search (edge1->to, nst, TRUE);
-      }
-
-      if (edge2->to == end) {
-        edge2->type = EDGE_IFEXIT;
-      } else {
-        if (edge2->to->mark1) {
-          edge2->type = EDGE_GOTO;
-          edge2->to->status |= BLOCK_STAT_HASLABEL;
-        } else {
-          edge2->type = EDGE_IFENTER;
-          structure_search (edge2->to, nst, FALSE);
-        }
-      }
-
-      if (edge2->type != EDGE_IFEXIT) {
-        if (edge1->type == EDGE_IFEXIT)
-          block->status |= BLOCK_STAT_REVCOND;
-        else
-          block->status |= BLOCK_STAT_HASELSE;
-      }
-
-      if (nst->endfollow) {
-        end->mark1 = 0;
-        structure_search (end, block->st, blockcond);
+        search_visit (s, SEARCH_IFELSE, edge1->to, nst, TRUE);
       }
 
     } else if (edge1->type == EDGE_UNKNOWN || edge2->type == EDGE_UNKNOWN) {
-      struct basicedge *edge;
-
       if (edge1->type == EDGE_UNKNOWN) {
         block->status |= BLOCK_STAT_REVCOND;
-        edge = edge1;
-      } else {
-        edge = edge2;
-      }
-
-      if (edge->to == block->st->end && block->st->type == CONTROL_IF) {
-        edge->type = EDGE_IFEXIT;
+        search_next (s, block, edge1, f->blockcond);
       } else {
-        if (edge->to->mark1) {
-          edge->type = EDGE_GOTO;
-          edge->to->status |= BLOCK_STAT_HASLABEL;
-        } else {
-          edge->type = EDGE_NEXT;
-          structure_search (edge->to, block->st, blockcond);
-        }
+        search_next (s, block, edge2, f->blockcond);
       }
     }
   } else {
@@ -325,20 +514,95 @@ void structure_search (struct basicblock *block, struct ctrlstruct *parentst, in
     edge = list_headvalue (block->outrefs);
     if (edge) {
       if (edge->type == EDGE_UNKNOWN) {
-        if (edge->to == block->st->end && block->st->type == CONTROL_IF) {
-          edge->type = EDGE_IFEXIT;
-        } else {
-          if (edge->to->mark1) {
-            edge->type = EDGE_GOTO;
-            edge->to->status |= BLOCK_STAT_HASLABEL;
-          } else {
-            edge->type = EDGE_NEXT;
-            structure_search (edge->to, block->st, blockcond);
-          }
+        search_next (s, block, edge, f->blockcond);
+      }
+    }
+  }
+}
+
+static
+void search_switch (struct searchstack *s, struct searchframe *f)
+{
+  while (f->ref) {
+    struct basicedge *edge = element_getvalue (f->ref);
+    f->ref = element_next (f->ref);
+
+    if (edge->type == EDGE_UNKNOWN) {
+      edge->type = EDGE_CASE;
+      if (!edge->to->mark1) {
+        search_visit (s, SEARCH_SWITCH, edge->to, f->nst, edge->fromnum);
+        return;
+      } else {
+        if (edge->to->st != f->nst) {
+          edge->type = EDGE_GOTO;
+          edge->to->status |= BLOCK_STAT_HASLABEL;
         }
       }
     }
   }
+  f->state = SEARCH_DONE;
+}
+
+static
+void search_ifelse (struct searchstack *s, struct searchframe *f)
+{
+  struct basicedge *edge2 = f->edge2;
+
+  f->state = SEARCH_IFEND;
+  if (edge2->to == f->end) {
+    edge2->type = EDGE_IFEXIT;
+  } else {
+    if (edge2->to->mark1) {
+      edge2->type = EDGE_GOTO;
+      edge2->to->status |= BLOCK_STAT_HASLABEL;
+    } else {
+      edge2->type = EDGE_IFENTER;
+      search_visit (s, SEARCH_IFEND, edge2->to, f->nst, FALSE);
+    }
+  }
+}
+
+static
+void search_ifend (struct searchstack *s, struct searchframe *f)
+{
+  struct basicblock *block = f->block;
+
+  f->state = SEARCH_DONE;
+  if (f->edge2->type != EDGE_IFEXIT) {
+    if (f->edge1->type == EDGE_IFEXIT)
+      block->status |= BLOCK_STAT_REVCOND;
+    else
+      block->status |= BLOCK_STAT_HASELSE;
+  }
+
+  if (f->nst->endfollow) {
+    f->end->mark1 = 0;
+    search_visit (s, SEARCH_DONE, f->end, block->st, f->blockcond);
+  }
+}
+
+static
+void structure_search (struct basicblock *start, struct ctrlstruct *mainst)
+{
+  struct searchstack s;
+
+  s.frames = NULL;
+  s.count = s.alloc = 0;
+  search_push (&s, start, mainst, 0);
+
+  while (s.count) {
+    struct searchframe *f = &s.frames[s.count - 1];
+    switch (f->state) {
+    case SEARCH_ENTER:  search_enter (&s, f);  break;
+    case SEARCH_LOOP:   search_block (&s, f);  break;
+    case SEARCH_SWITCH: search_switch (&s, f); break;
+    case SEARCH_IFELSE: search_ifelse (&s, f); break;
+    case SEARCH_IFEND:  search_ifend (&s, f);  break;
+    case SEARCH_DONE:   s.count--;             break;
+    }
+  }
+
+  free (s.frames);
 }
 
 void reset_marks (struct subroutine *sub)
@@ -360,6 +624,9 @@ void extract_structures (struct subroutine *sub)
   st->start = sub->startblock;
   st->end = sub->endblock;
 
+  if (!budget_spend (sub, list_size (sub->blocks))) return;
+  cfg_reverse (sub, FALSE);
+  if (sub->haserror) return;
   reset_marks (sub);
   extract_loops (sub);
 
@@ -370,7 +637,7 @@ void extract_structures (struct subroutine *sub)
   while (el) {
     struct basicblock *block = element_getvalue (el);
     if (!block->mark1)
-      structure_search (block, st, 0);
+      structure_search (block, st);
     el = element_next (el);
   }
 }
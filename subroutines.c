@@ -3,6 +3,7 @@
  */
 
 #include "code.h"
+#include "profile.h"
 #include "utils.h"
 
 
@@ -356,10 +357,9 @@ void check_subroutine (struct subroutine *sub)
   sub->haserror = TRUE;
 }
 
-void extract_subroutines (struct code *c)
+void find_subroutines (struct code *c)
 {
-  element el;
-
+  profile_begin (PROF_SUBROUTINES);
   c->subroutines = list_alloc (c->lstpool);
 
   extract_from_exports (c);
@@ -373,30 +373,47 @@ void extract_subroutines (struct code *c)
 
   extract_hidden_subroutines (c);
   delimit_borders (c);
+  profile_end (PROF_SUBROUTINES);
+}
 
+void extract_subroutine (struct subroutine *sub)
+{
+  if (sub->import) return;
+
+  profile_begin (PROF_SUBROUTINES);
+  check_switches (sub);
+  check_subroutine (sub);
+  profile_endsub (PROF_SUBROUTINES, sub->begin->address, sub->end->address);
+
+  if (!sub->haserror) {
+    sub->status |= SUB_STAT_EXTRACTED;
+    profile_begin (PROF_CFG);
+    extract_cfg (sub);
+    profile_endsub (PROF_CFG, sub->begin->address, sub->end->address);
+  }
 
-  el = list_head (c->subroutines);
-  while (el) {
-    struct subroutine *sub = element_getvalue (el);
-    if (!sub->import) {
-      check_switches (sub);
-      check_subroutine (sub);
+  if (!sub->haserror) {
+    sub->status |= SUB_STAT_CFG_EXTRACTED;
+    profile_begin (PROF_OPERATIONS);
+    extract_operations (sub);
+    profile_endsub (PROF_OPERATIONS, sub->begin->address, sub->end->address);
+  }
 
-      if (!sub->haserror) {
-        sub->status |= SUB_STAT_EXTRACTED;
-        extract_cfg (sub);
-      }
+  if (!sub->haserror) {
+    sub->status |= SUB_STAT_OPERATIONS_EXTRACTED;
+  }
+}
 
-      if (!sub->haserror) {
-        sub->status |= SUB_STAT_CFG_EXTRACTED;
-        extract_operations (sub);
-      }
+void extract_subroutines (struct code *c)
+{
+  element el;
 
-      if (!sub->haserror) {
-        sub->status |= SUB_STAT_OPERATIONS_EXTRACTED;
-      }
-    }
+  find_subroutines (c);
+
+  el = list_head (c->subroutines);
+  while (el) {
+    struct subroutine *sub = element_getvalue (el);
+    extract_subroutine (sub);
     el = element_next (el);
   }
 }
-
@@ -2,6 +2,8 @@
  * Author: Humberto Naves (hsnaves@gmail.com)
  */
 
+#include <stdlib.h>
+
 #include "code.h"
 #include "utils.h"
 
@@ -64,46 +66,97 @@ int check_switch (struct code *c, struct codeswitch *cs)
   return 1;
 }
 
-void extract_switches (struct code *c)
+static
+int cmp_target (const void *p1, const void *p2)
+{
+  const struct prx_reloc *r1 = *((const struct prx_reloc **) p1);
+  const struct prx_reloc *r2 = *((const struct prx_reloc **) p2);
+  if (r1->target != r2->target) return (r1->target < r2->target) ? -1 : 1;
+  if (r1->vaddr != r2->vaddr) return (r1->vaddr < r2->vaddr) ? -1 : 1;
+  return 0;
+}
+
+/* Returns the number of words of the jump table made of the run of
+ * relocations starting at rel, of the given length. The relocations
+ * sorted by target, from end onwards, point past its base */
+static
+uint32 table_size (struct prx_reloc *rel, uint32 length, struct prx_reloc **bytarget, uint32 end, uint32 num)
 {
   struct prx_reloc *aux;
-  uint32 base, end, count = 0;
+
+  /* The table ends where the next referenced address begins */
+  if (end < num) {
+    aux = bytarget[end];
+    if (aux->target & 0x03) {
+      error (__FILE__ ": relocation target not word aligned 0x%08X", aux->target);
+      return 0;
+    }
+    if (length > ((aux->target - rel->vaddr) >> 2))
+      length = (aux->target - rel->vaddr) >> 2;
+  }
+  return length;
+}
+
+/* The jump tables are found in one sweep over the relocations sorted by
+ * address. Only the relocations of the code and the word relocations
+ * can make a table or refer to one, so only these are resolved. The
+ * runs of word relocations pointing into the code are measured once,
+ * from the last relocation backwards, so that every relocation knows the
+ * longest table starting at it. As the candidates come in address order,
+ * the references to their bases are found by merging with the resolved
+ * relocations sorted by target */
+void extract_switches (struct code *c)
+{
+  struct prx *p = c->file;
+  struct prx_reloc *aux, **bytarget;
+  uint32 *runs;
+  uint32 base, end, count, num = 0;
   uint32 i, j, tgt;
 
-  for (i = 0; i < c->file->relocnum; i++) {
-    struct prx_reloc *rel = &c->file->relocsbyaddr[i];
-    count = 0;
-    do {
-      if (rel->type != R_MIPS_32) break;
-      tgt = (rel[count].target - c->baddr) >> 2;
-      if (tgt >= c->numopc) break;
-      if (rel[count].target & 0x03) break;
-
-      count++;
-    } while ((i + count) < c->file->relocnum);
-
-    if (count == 0) continue;
-
-    base = end = prx_findreloc (c->file, rel->vaddr);
-    if (base >= c->file->relocnum) continue;
-    if (c->file->relocs[base].target != rel->vaddr) continue;
-
-    for (; end < c->file->relocnum; end++) {
-      aux = &c->file->relocs[end];
-      if (aux->target != rel->vaddr) {
-        if (aux->target & 0x03) {
-          error (__FILE__ ": relocation target not word aligned 0x%08X", aux->target);
-          count = 0;
-        } else if (count > ((aux->target - rel->vaddr) >> 2))
-          count = (aux->target - rel->vaddr) >> 2;
-        break;
-      }
+  if (!p->relocnum) return;
+  prx_resolve_relocs (p, c->baddr, c->numopc << 2);
+
+  runs = (uint32 *) xmalloc ((p->relocnum + 1) * sizeof (uint32));
+  bytarget = (struct prx_reloc **) xmalloc ((p->relocnum + 1) * sizeof (struct prx_reloc *));
+  runs[p->relocnum] = 0;
+  for (i = p->relocnum; i-- > 0;) {
+    struct prx_reloc *rel = &p->relocsbyaddr[i];
+    runs[i] = 0;
+    if (rel->type == R_MIPS_32) {
+      prx_resolve_relocs (p, rel->vaddr, 4);
+    } else if (rel->vaddr - c->baddr >= (c->numopc << 2)) {
+      continue;
     }
+    bytarget[num++] = rel;
+
+    if (rel->type != R_MIPS_32) continue;
+    if (rel->target & 0x03) continue;
+    tgt = (rel->target - c->baddr) >> 2;
+    if (tgt >= c->numopc) continue;
+    runs[i] = 1;
+    if (i + 1 < p->relocnum && rel[1].vaddr == rel->vaddr + 4)
+      runs[i] += runs[i + 1];
+  }
+  qsort (bytarget, num, sizeof (struct prx_reloc *), &cmp_target);
+
+  base = 0;
+  for (i = 0; i < p->relocnum; i++) {
+    struct prx_reloc *rel = &p->relocsbyaddr[i];
 
+    if (runs[i] == 0) continue;
+
+    while (base < num && bytarget[base]->target < rel->vaddr) base++;
+    if (base >= num) break;
+    if (bytarget[base]->target != rel->vaddr) continue;
+
+    for (end = base; end < num; end++)
+      if (bytarget[end]->target != rel->vaddr) break;
+
+    count = table_size (rel, runs[i], bytarget, end, num);
     if (count <= 1) continue;
 
-    for (;base < end; base++) {
-      aux = &c->file->relocs[base];
+    for (j = base; j < end; j++) {
+      aux = bytarget[j];
       tgt = (aux->vaddr - c->baddr) >> 2;
       if (tgt >= c->numopc) continue;
       if (aux->vaddr & 0x03) {
@@ -113,6 +166,7 @@ void extract_switches (struct code *c)
 
       if (aux->type == R_MIPS_LO16) {
         struct codeswitch *cs;
+        uint32 k;
 
         cs = fixedpool_alloc (c->switchpool);
 
@@ -121,8 +175,8 @@ void extract_switches (struct code *c)
         cs->location = &c->base[tgt];
         cs->count = count;
         cs->references = list_alloc (c->lstpool);
-        for (j = 0; j < count; j++) {
-          tgt = (rel[j].target - c->baddr) >> 2;
+        for (k = 0; k < count; k++) {
+          tgt = (rel[k].target - c->baddr) >> 2;
           list_inserttail (cs->references, &c->base[tgt]);
         }
 
@@ -132,6 +186,7 @@ void extract_switches (struct code *c)
       }
     }
   }
-}
-
 
+  free (bytarget);
+  free (runs);
+}
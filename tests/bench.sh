@@ -0,0 +1,27 @@
+#!/bin/sh
+
+# Runs the decompiler over synthetic PRX files of increasing size
+# and reports the time and memory growth of each stage and the
+# throughput of the analysis.
+# The sizes are given as "subroutines:blocks" pairs.
+
+SIZES=${*:-"100:20 1000:20 4000:30"}
+BENCHDIR=bench
+
+mkdir -p $BENCHDIR
+cd $BENCHDIR
+
+for SIZE in $SIZES; do
+        SUBS=`echo $SIZE | cut -d: -f1`;
+        BLOCKS=`echo $SIZE | cut -d: -f2`;
+        NAME=bench_${SUBS}_${BLOCKS};
+
+        echo "=== $SUBS subroutines, $BLOCKS blocks per subroutine ===";
+        ../genprx -s $SUBS -b $BLOCKS -d $SUBS -n $NAME.xml $NAME.prx || exit 1;
+        ../../pspdecompiler -n $NAME.xml -c -g --profile --profile-top 5 \
+                --profile-json $NAME.json $NAME.prx || exit 1;
+        rm -f *.c *.h *.dot;
+        echo;
+done
+
+cd ..
@@ -0,0 +1,799 @@
+/**
+ * Author: Humberto Naves (hsnaves@gmail.com)
+ */
+
+/*
+ * Synthetic PRX generator used to benchmark the decompiler.
+ * It writes a module with a configurable number of subroutines,
+ * basic blocks, switch tables, imports, exports and relocations.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../types.h"
+
+#define SEGMENT_OFFSET     0x80
+
+#define R_MIPS_32          2
+#define R_MIPS_26          4
+#define R_MIPS_HI16        5
+#define R_MIPS_LO16        6
+#define R_MIPSX_HI16      13
+
+#define REG_ZERO  0
+#define REG_V0    2
+#define REG_A0    4
+#define REG_A1    5
+#define REG_T0    8
+#define REG_T1    9
+#define REG_T2   10
+#define REG_S0   16
+#define REG_SP   29
+#define REG_RA   31
+
+#define OP_SPECIAL  0
+#define OP_JAL      3
+#define OP_BEQ      4
+#define OP_BNE      5
+#define OP_ADDIU    9
+#define OP_SLTIU   11
+#define OP_LUI     15
+#define OP_LW      35
+#define OP_SW      43
+
+#define FN_SLL      0
+#define FN_JR       8
+#define FN_ADDU  0x21
+
+#define ITYPE(op, rs, rt, imm) \
+  (((uint32) (op) << 26) | ((rs) << 21) | ((rt) << 16) | ((imm) & 0xFFFF))
+#define RTYPE(rs, rt, rd, sa, fn) \
+  (((uint32) (rs) << 21) | ((rt) << 16) | ((rd) << 11) | ((sa) << 6) | (fn))
+#define JTYPE(op, addr) \
+  (((uint32) (op) << 26) | (((addr) >> 2) & 0x3FFFFFF))
+
+#define NOP         0
+
+enum fixuptype {
+  FIX_CALL,
+  FIX_IMPORT,
+  FIX_HI16,
+  FIX_LO16,
+  FIX_WORD
+};
+
+enum targettype {
+  TARGET_SUB,
+  TARGET_STUB,
+  TARGET_STRING,
+  TARGET_TABLE,
+  TARGET_DATA,
+  TARGET_ADDRESS
+};
+
+struct fixup {
+  uint32 vaddr;
+  enum fixuptype type;
+  enum targettype target;
+  uint32 id;
+};
+
+struct reloc {
+  uint32 offset;
+  uint32 type;
+  uint32 addend;
+};
+
+struct options {
+  uint32 numsubs;
+  uint32 numblocks;
+  uint32 switchpct;
+  uint32 numcases;
+  uint32 numimports;
+  uint32 funcsperimport;
+  uint32 numexports;
+  uint32 numdatarelocs;
+  uint32 irreduciblepct;
+  uint32 seed;
+  int typeb;
+  const char *nidspath;
+  const char *outpath;
+};
+
+static uint8 *image = NULL;
+static uint32 imagesize = 0, imagealloc = 0;
+
+static struct fixup *fixups = NULL;
+static uint32 numfixups = 0, fixupsalloc = 0;
+
+static struct reloc *relocs = NULL;
+static uint32 numrelocs = 0, relocsalloc = 0;
+
+static uint32 *subaddrs, *stubaddrs, *stringaddrs, *tableaddrs;
+static uint32 *tablecases, *tablesizes;
+static uint32 numstrings = 0, numtables = 0;
+static uint32 dataaddr, codesize;
+
+static uint32 randseed;
+
+static
+uint32 next_random (uint32 range)
+{
+  randseed = randseed * 1103515245 + 12345;
+  if (!range) return 0;
+  return ((randseed >> 8) & 0xFFFFFF) % range;
+}
+
+static
+void *xrealloc_array (void *ptr, uint32 *alloc, uint32 needed, size_t size)
+{
+  if (needed <= *alloc) return ptr;
+  while (*alloc < needed)
+    *alloc = (*alloc) ? (*alloc) * 2 : 1024;
+  ptr = realloc (ptr, (*alloc) * size);
+  if (!ptr) {
+    fprintf (stderr, "genprx: out of memory\n");
+    exit (1);
+  }
+  return ptr;
+}
+
+static
+void put_uint32 (uint8 *bytes, uint32 val)
+{
+  bytes[0] = val & 0xFF; val >>= 8;
+  bytes[1] = val & 0xFF; val >>= 8;
+  bytes[2] = val & 0xFF; val >>= 8;
+  bytes[3] = val & 0xFF;
+}
+
+static
+uint32 get_uint32 (const uint8 *bytes)
+{
+  return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (bytes[3] << 24);
+}
+
+static
+void put_uint16 (uint8 *bytes, uint32 val)
+{
+  bytes[0] = val & 0xFF;
+  bytes[1] = (val >> 8) & 0xFF;
+}
+
+static
+uint32 emit_bytes (const void *data, uint32 size)
+{
+  uint32 vaddr = imagesize;
+  image = xrealloc_array (image, &imagealloc, imagesize + size, 1);
+  if (data) memcpy (&image[imagesize], data, size);
+  else memset (&image[imagesize], 0, size);
+  imagesize += size;
+  return vaddr;
+}
+
+static
+void align_image (uint32 align)
+{
+  while (imagesize & (align - 1))
+    emit_bytes (NULL, 1);
+}
+
+static
+uint32 emit (uint32 word)
+{
+  uint8 bytes[4];
+  put_uint32 (bytes, word);
+  return emit_bytes (bytes, 4);
+}
+
+static
+uint32 emit_string (const char *str)
+{
+  return emit_bytes (str, strlen (str) + 1);
+}
+
+static
+void add_fixup (uint32 vaddr, enum fixuptype type, enum targettype target, uint32 id)
+{
+  fixups = xrealloc_array (fixups, &fixupsalloc, numfixups + 1, sizeof (struct fixup));
+  fixups[numfixups].vaddr = vaddr;
+  fixups[numfixups].type = type;
+  fixups[numfixups].target = target;
+  fixups[numfixups].id = id;
+  numfixups++;
+}
+
+static
+void add_reloc (uint32 offset, uint32 type, uint32 addend)
+{
+  relocs = xrealloc_array (relocs, &relocsalloc, numrelocs + 1, sizeof (struct reloc));
+  relocs[numrelocs].offset = offset;
+  relocs[numrelocs].type = type;
+  relocs[numrelocs].addend = addend;
+  numrelocs++;
+}
+
+static
+uint32 branch_offset (uint32 from, uint32 to)
+{
+  return ((to - (from + 4)) >> 2) & 0xFFFF;
+}
+
+static
+void emit_call (enum fixuptype type, enum targettype target, uint32 id)
+{
+  add_fixup (emit (JTYPE (OP_JAL, 0)), type, target, id);
+  emit (RTYPE (REG_S0, REG_ZERO, REG_A0, 0, FN_ADDU));
+}
+
+static
+void emit_switch (uint32 table, uint32 numcases)
+{
+  uint32 i, enddef, addr;
+
+  emit (ITYPE (OP_SLTIU, REG_A0, REG_T1, numcases));
+  /* sltiu, beq, nop, lui, sll, addiu, addu, lw, jr, nop, cases */
+  enddef = imagesize + 4 * (10 + 3 * numcases);
+  addr = emit (ITYPE (OP_BEQ, REG_T1, REG_ZERO, 0));
+  put_uint32 (&image[addr], ITYPE (OP_BEQ, REG_T1, REG_ZERO, branch_offset (addr, enddef)));
+  emit (NOP);
+  add_fixup (emit (ITYPE (OP_LUI, 0, REG_T2, 0)), FIX_HI16, TARGET_TABLE, table);
+  emit (RTYPE (0, REG_A0, REG_T1, 2, FN_SLL));
+  add_fixup (emit (ITYPE (OP_ADDIU, REG_T2, REG_T2, 0)), FIX_LO16, TARGET_TABLE, table);
+  emit (RTYPE (REG_T1, REG_T2, REG_T1, 0, FN_ADDU));
+  emit (ITYPE (OP_LW, REG_T1, REG_T1, 0));
+  emit (RTYPE (REG_T1, 0, 0, 0, FN_JR));
+  emit (NOP);
+
+  tablecases[table] = imagesize;
+  tablesizes[table] = numcases;
+  for (i = 0; i < numcases; i++) {
+    emit (ITYPE (OP_ADDIU, REG_V0, REG_V0, i + 1));
+    addr = emit (ITYPE (OP_BEQ, REG_ZERO, REG_ZERO, 0));
+    put_uint32 (&image[addr], ITYPE (OP_BEQ, REG_ZERO, REG_ZERO, branch_offset (addr, enddef)));
+    emit (NOP);
+  }
+}
+
+static
+void emit_block (struct options *opts, uint32 subidx)
+{
+  uint32 addr, top;
+
+  if (opts->irreduciblepct && next_random (100) < opts->irreduciblepct) {
+    /* loop with a second entry point */
+    emit (ITYPE (OP_ADDIU, REG_ZERO, REG_T0, 1 + next_random (16)));
+    emit (ITYPE (OP_BEQ, REG_A0, REG_ZERO, 2));
+    emit (NOP);
+    top = emit (ITYPE (OP_ADDIU, REG_V0, REG_V0, 1));
+    emit (ITYPE (OP_ADDIU, REG_T0, REG_T0, -1));
+    addr = emit (ITYPE (OP_BNE, REG_T0, REG_ZERO, 0));
+    put_uint32 (&image[addr], ITYPE (OP_BNE, REG_T0, REG_ZERO, branch_offset (addr, top)));
+    emit (NOP);
+    return;
+  }
+
+  switch (next_random (6)) {
+  case 0:
+    /* if (a0 != 0) v0 += k; */
+    emit (ITYPE (OP_BEQ, REG_A0, REG_ZERO, 2));
+    emit (NOP);
+    emit (ITYPE (OP_ADDIU, REG_V0, REG_V0, next_random (100)));
+    break;
+  case 1:
+    /* if (a0 == 0) v0 += 1; else v0 += 2; */
+    emit (ITYPE (OP_BNE, REG_A0, REG_ZERO, 4));
+    emit (NOP);
+    emit (ITYPE (OP_ADDIU, REG_V0, REG_V0, 1));
+    emit (ITYPE (OP_BEQ, REG_ZERO, REG_ZERO, 2));
+    emit (NOP);
+    emit (ITYPE (OP_ADDIU, REG_V0, REG_V0, 2));
+    break;
+  case 2:
+    /* counted loop */
+    emit (ITYPE (OP_ADDIU, REG_ZERO, REG_T0, 1 + next_random (16)));
+    top = emit (ITYPE (OP_ADDIU, REG_V0, REG_V0, 1));
+    emit (ITYPE (OP_ADDIU, REG_T0, REG_T0, -1));
+    addr = emit (ITYPE (OP_BNE, REG_T0, REG_ZERO, 0));
+    put_uint32 (&image[addr], ITYPE (OP_BNE, REG_T0, REG_ZERO, branch_offset (addr, top)));
+    emit (NOP);
+    break;
+  case 3:
+    if (subidx + 1 < opts->numsubs) {
+      emit_call (FIX_CALL, TARGET_SUB, subidx + 1 + next_random (opts->numsubs - subidx - 1));
+      break;
+    }
+    /* fall through */
+  case 4:
+    if (opts->numimports && opts->funcsperimport) {
+      emit_call (FIX_IMPORT, TARGET_STUB, next_random (opts->numimports * opts->funcsperimport));
+      break;
+    }
+    /* fall through */
+  default:
+    /* pass a string to a function */
+    add_fixup (emit (ITYPE (OP_LUI, 0, REG_A1, 0)), FIX_HI16, TARGET_STRING, numstrings);
+    add_fixup (emit (ITYPE (OP_ADDIU, REG_A1, REG_A1, 0)), FIX_LO16, TARGET_STRING, numstrings);
+    numstrings++;
+    if (opts->numimports && opts->funcsperimport)
+      emit_call (FIX_IMPORT, TARGET_STUB, next_random (opts->numimports * opts->funcsperimport));
+    else
+      emit (ITYPE (OP_ADDIU, REG_A1, REG_V0, 0));
+    break;
+  }
+}
+
+static
+void emit_subroutine (struct options *opts, uint32 subidx)
+{
+  uint32 i;
+
+  subaddrs[subidx] = imagesize;
+  emit (ITYPE (OP_ADDIU, REG_SP, REG_SP, -32));
+  emit (ITYPE (OP_SW, REG_SP, REG_RA, 28));
+  emit (ITYPE (OP_SW, REG_SP, REG_S0, 24));
+  emit (RTYPE (REG_A0, REG_ZERO, REG_S0, 0, FN_ADDU));
+  emit (RTYPE (REG_ZERO, REG_ZERO, REG_V0, 0, FN_ADDU));
+
+  /* Make sure every subroutine is reachable */
+  if (subidx + 1 < opts->numsubs)
+    emit_call (FIX_CALL, TARGET_SUB, subidx + 1);
+
+  for (i = 0; i < opts->numblocks; i++)
+    emit_block (opts, subidx);
+
+  if (opts->numcases && next_random (100) < opts->switchpct) {
+    emit_switch (numtables++, opts->numcases);
+  }
+
+  emit (ITYPE (OP_LW, REG_SP, REG_S0, 24));
+  emit (ITYPE (OP_LW, REG_SP, REG_RA, 28));
+  emit (RTYPE (REG_RA, 0, 0, 0, FN_JR));
+  emit (ITYPE (OP_ADDIU, REG_SP, REG_SP, 32));
+}
+
+static
+uint32 target_address (enum targettype target, uint32 id)
+{
+  switch (target) {
+  case TARGET_SUB: return subaddrs[id];
+  case TARGET_STUB: return stubaddrs[id];
+  case TARGET_STRING: return stringaddrs[id];
+  case TARGET_TABLE: return tableaddrs[id];
+  case TARGET_DATA: return dataaddr + 4 * id;
+  case TARGET_ADDRESS: return id;
+  }
+  return 0;
+}
+
+static
+void apply_fixups (struct options *opts)
+{
+  uint32 i, addr, word;
+
+  for (i = 0; i < numfixups; i++) {
+    struct fixup *fix = &fixups[i];
+    addr = target_address (fix->target, fix->id);
+    word = get_uint32 (&image[fix->vaddr]);
+
+    switch (fix->type) {
+    case FIX_CALL:
+    case FIX_IMPORT:
+      word = JTYPE (OP_JAL, addr);
+      add_reloc (fix->vaddr, R_MIPS_26, 0);
+      break;
+    case FIX_HI16:
+      word = (word & ~0xFFFF) | (((addr + 0x8000) >> 16) & 0xFFFF);
+      add_reloc (fix->vaddr, opts->typeb ? R_MIPSX_HI16 : R_MIPS_HI16, addr & 0xFFFF);
+      break;
+    case FIX_LO16:
+      word = (word & ~0xFFFF) | (addr & 0xFFFF);
+      add_reloc (fix->vaddr, R_MIPS_LO16, 0);
+      break;
+    case FIX_WORD:
+      word = addr;
+      add_reloc (fix->vaddr, R_MIPS_32, 0);
+      break;
+    }
+    put_uint32 (&image[fix->vaddr], word);
+  }
+}
+
+static
+uint32 make_nid (uint32 lib, uint32 func)
+{
+  uint32 nid = 0x9E3779B9 * (lib + 1) + 0x85EBCA6B * (func + 1);
+  nid ^= nid >> 15;
+  return nid ? nid : 1;
+}
+
+static
+void build_image (struct options *opts, uint32 *modinfo)
+{
+  uint32 i, j, numstubs, numexports;
+  uint32 expvaddr, expbtm, impvaddr, impbtm;
+  uint32 sysexp, libexp, libname;
+  char name[64];
+
+  numstubs = opts->numimports * opts->funcsperimport;
+  numexports = opts->numexports;
+  if (numexports > opts->numsubs - 1) numexports = opts->numsubs - 1;
+
+  subaddrs = calloc (opts->numsubs, sizeof (uint32));
+  stubaddrs = calloc (numstubs + 1, sizeof (uint32));
+  stringaddrs = calloc (opts->numsubs * (opts->numblocks + 1), sizeof (uint32));
+  tableaddrs = calloc (opts->numsubs + 1, sizeof (uint32));
+  tablecases = calloc (opts->numsubs + 1, sizeof (uint32));
+  tablesizes = calloc (opts->numsubs + 1, sizeof (uint32));
+
+  /* .text */
+  for (i = 0; i < opts->numsubs; i++)
+    emit_subroutine (opts, i);
+
+  /* .sceStub.text */
+  for (i = 0; i < numstubs; i++) {
+    stubaddrs[i] = emit (RTYPE (REG_RA, 0, 0, 0, FN_JR));
+    emit (NOP);
+  }
+  codesize = imagesize;
+
+  /* .lib.ent.top */
+  emit (0);
+
+  /* .lib.ent */
+  expvaddr = emit_bytes (NULL, numexports ? 32 : 16);
+  expbtm = imagesize;
+
+  /* .lib.stub */
+  impvaddr = emit_bytes (NULL, 20 * (opts->funcsperimport ? opts->numimports : 0));
+  impbtm = imagesize;
+
+  /* .rodata.sceModuleInfo */
+  *modinfo = emit_bytes (NULL, 52);
+  put_uint16 (&image[*modinfo], 0);
+  put_uint16 (&image[*modinfo + 2], 0x0101);
+  strcpy ((char *) &image[*modinfo + 4], "GeneratedModule");
+  put_uint32 (&image[*modinfo + 36], expvaddr);
+  put_uint32 (&image[*modinfo + 40], expbtm);
+  put_uint32 (&image[*modinfo + 44], impvaddr);
+  put_uint32 (&image[*modinfo + 48], impbtm);
+
+  /* .rodata.sceResident */
+  sysexp = emit (0xD632ACDB);
+  emit (subaddrs[0]);
+  put_uint32 (&image[expvaddr + 4], 0x80000000);
+  image[expvaddr + 8] = 4;
+  put_uint16 (&image[expvaddr + 10], 1);
+  put_uint32 (&image[expvaddr + 12], sysexp);
+
+  if (numexports) {
+    libexp = imagesize;
+    for (i = 0; i < numexports; i++)
+      emit (make_nid (0xFFFF, i));
+    for (i = 0; i < numexports; i++)
+      emit (subaddrs[i + 1]);
+    libname = emit_string ("GenLib");
+    align_image (4);
+    put_uint32 (&image[expvaddr + 16], libname);
+    put_uint32 (&image[expvaddr + 20], 0x00010001);
+    image[expvaddr + 24] = 4;
+    put_uint16 (&image[expvaddr + 26], numexports);
+    put_uint32 (&image[expvaddr + 28], libexp);
+  }
+
+  /* .rodata.sceNid */
+  for (i = 0; i < opts->numimports && opts->funcsperimport; i++) {
+    uint32 entry = impvaddr + 20 * i;
+    put_uint32 (&image[entry + 4], 0x00090011);
+    image[entry + 8] = 5;
+    put_uint16 (&image[entry + 10], opts->funcsperimport);
+    put_uint32 (&image[entry + 12], imagesize);
+    put_uint32 (&image[entry + 16], stubaddrs[i * opts->funcsperimport]);
+    for (j = 0; j < opts->funcsperimport; j++)
+      emit (make_nid (i, j));
+  }
+  for (i = 0; i < opts->numimports && opts->funcsperimport; i++) {
+    sprintf (name, "GenImport%u", (unsigned int) i);
+    put_uint32 (&image[impvaddr + 20 * i], emit_string (name));
+  }
+
+  /* .rodata */
+  for (i = 0; i < numstrings; i++) {
+    sprintf (name, "Generated string number %u\n", (unsigned int) i);
+    stringaddrs[i] = emit_string (name);
+  }
+  align_image (4);
+  for (i = 0; i < numtables; i++) {
+    tableaddrs[i] = imagesize;
+    for (j = 0; j < tablesizes[i]; j++)
+      add_fixup (emit (0), FIX_WORD, TARGET_ADDRESS, tablecases[i] + 12 * j);
+  }
+
+  /* .data */
+  dataaddr = imagesize;
+  for (i = 0; i < opts->numdatarelocs; i++)
+    add_fixup (emit (0), FIX_WORD, TARGET_DATA, next_random (opts->numdatarelocs));
+
+  apply_fixups (opts);
+}
+
+static
+uint8 *encode_relocs_a (uint32 *size)
+{
+  uint8 *out;
+  uint32 i;
+
+  *size = 8 * numrelocs;
+  out = malloc (*size);
+  for (i = 0; i < numrelocs; i++) {
+    put_uint32 (&out[8 * i], relocs[i].offset);
+    out[8 * i + 4] = relocs[i].type;
+    out[8 * i + 5] = 0;
+    out[8 * i + 6] = 0;
+    out[8 * i + 7] = 0;
+  }
+  return out;
+}
+
+/* Type B relocations: part1 uses 3 bits, the base index 1 bit
+ * and part2 3 bits, leaving 9 bits for the relative offset */
+static
+uint8 *encode_relocs_b (uint32 *size)
+{
+  static const uint8 block1[] = { 6, 0x04, 0x01, 0x05, 0x11, 0x15 };
+  static const uint8 block2[] = { 8, 1, 2, 3, 4, 5, 6, 7 };
+  uint8 *out;
+  uint32 i, pos, last = 0;
+
+  out = malloc (4 + sizeof (block1) + sizeof (block2) + 10 * numrelocs + 6);
+  put_uint16 (out, 0);
+  out[2] = 3;
+  out[3] = 3;
+  memcpy (&out[4], block1, sizeof (block1));
+  memcpy (&out[4 + sizeof (block1)], block2, sizeof (block2));
+  pos = 4 + sizeof (block1) + sizeof (block2);
+
+  /* Set the offset base to program 0 */
+  put_uint16 (&out[pos], 1);
+  put_uint32 (&out[pos + 2], 0);
+  pos += 6;
+
+  for (i = 0; i < numrelocs; i++) {
+    uint32 part2, delta, cmd;
+    int hasaddend;
+
+    switch (relocs[i].type) {
+    case R_MIPS_32: part2 = 2; break;
+    case R_MIPS_26: part2 = 3; break;
+    case R_MIPSX_HI16: part2 = 4; break;
+    default: part2 = 5; break;
+    }
+
+    hasaddend = (relocs[i].type == R_MIPSX_HI16);
+    delta = relocs[i].offset - last;
+    if (relocs[i].offset >= last && delta < 0x100) {
+      cmd = (hasaddend ? 4 : 2) | (part2 << 4) | (delta << 7);
+      put_uint16 (&out[pos], cmd);
+      pos += 2;
+    } else {
+      cmd = (hasaddend ? 5 : 3) | (part2 << 4);
+      put_uint16 (&out[pos], cmd);
+      put_uint32 (&out[pos + 2], relocs[i].offset);
+      pos += 6;
+    }
+    if (hasaddend) {
+      put_uint16 (&out[pos], relocs[i].addend);
+      pos += 2;
+    }
+    last = relocs[i].offset;
+  }
+
+  *size = pos;
+  return out;
+}
+
+static
+int write_prx (struct options *opts, uint32 modinfo)
+{
+  uint8 header[52 + 2 * 32];
+  uint8 *relocdata;
+  uint32 relocsize, relocoffset;
+  FILE *fp;
+
+  if (opts->typeb)
+    relocdata = encode_relocs_b (&relocsize);
+  else
+    relocdata = encode_relocs_a (&relocsize);
+
+  relocoffset = SEGMENT_OFFSET + ((imagesize + 15) & ~15);
+
+  memset (header, 0, sizeof (header));
+  header[0] = 0x7F; header[1] = 'E'; header[2] = 'L'; header[3] = 'F';
+  header[4] = 1; header[5] = 1; header[6] = 1;
+  put_uint16 (&header[16], 0xFFA0);
+  put_uint16 (&header[18], 8);
+  put_uint32 (&header[20], 1);
+  put_uint32 (&header[24], subaddrs[0]);
+  put_uint32 (&header[28], 52);
+  put_uint32 (&header[32], 0);
+  put_uint32 (&header[36], 0x10A23000);
+  put_uint16 (&header[40], 52);
+  put_uint16 (&header[42], 32);
+  put_uint16 (&header[44], 2);
+  put_uint16 (&header[46], 40);
+  put_uint16 (&header[48], 0);
+  put_uint16 (&header[50], 0);
+
+  put_uint32 (&header[52], 1);
+  put_uint32 (&header[56], SEGMENT_OFFSET);
+  put_uint32 (&header[60], 0);
+  put_uint32 (&header[64], SEGMENT_OFFSET + modinfo);
+  put_uint32 (&header[68], imagesize);
+  put_uint32 (&header[72], imagesize);
+  put_uint32 (&header[76], 7);
+  put_uint32 (&header[80], 16);
+
+  put_uint32 (&header[84], opts->typeb ? 0x700000A1 : 0x700000A0);
+  put_uint32 (&header[88], relocoffset);
+  put_uint32 (&header[92], 0);
+  put_uint32 (&header[96], 0);
+  put_uint32 (&header[100], relocsize);
+  put_uint32 (&header[104], 0);
+  put_uint32 (&header[108], 0);
+  put_uint32 (&header[112], 16);
+
+  fp = fopen (opts->outpath, "wb");
+  if (!fp) {
+    fprintf (stderr, "genprx: can't open file `%s'\n", opts->outpath);
+    free (relocdata);
+    return 0;
+  }
+
+  fwrite (header, 1, sizeof (header), fp);
+  while (ftell (fp) < SEGMENT_OFFSET) fputc (0, fp);
+  fwrite (image, 1, imagesize, fp);
+  while (ftell (fp) < relocoffset) fputc (0, fp);
+  fwrite (relocdata, 1, relocsize, fp);
+  fclose (fp);
+  free (relocdata);
+  return 1;
+}
+
+static
+int write_nids (struct options *opts)
+{
+  uint32 i, j;
+  FILE *fp;
+
+  fp = fopen (opts->nidspath, "w");
+  if (!fp) {
+    fprintf (stderr, "genprx: can't open file `%s'\n", opts->nidspath);
+    return 0;
+  }
+
+  fprintf (fp, "<?xml version=\"1.0\" ?>\n<PSPLIBDOC>\n <LIBRARIES>\n");
+  for (i = 0; i < opts->numimports; i++) {
+    fprintf (fp, "  <LIBRARY>\n   <NAME>GenImport%u</NAME>\n   <FUNCTIONS>\n", (unsigned int) i);
+    for (j = 0; j < opts->funcsperimport; j++) {
+      fprintf (fp, "    <FUNCTION><NID>0x%08X</NID><NAME>GenImport%u_func%u</NAME>"
+                   "<NUMARGS>%u</NUMARGS></FUNCTION>\n",
+               (unsigned int) make_nid (i, j), (unsigned int) i, (unsigned int) j,
+               (unsigned int) ((i + j) % 5));
+    }
+    fprintf (fp, "   </FUNCTIONS>\n  </LIBRARY>\n");
+  }
+  fprintf (fp, " </LIBRARIES>\n</PSPLIBDOC>\n");
+  fclose (fp);
+  return 1;
+}
+
+static
+void print_help (char *prgname)
+{
+  fprintf (stderr,
+    "Usage:\n"
+    "  %s [-s subs] [-b blocks] [-w pct] [-c cases] [-i libs] [-f funcs]\n"
+    "     [-e exports] [-d relocs] [-x pct] [-r seed] [-B] [-n nidsfile] prxfile\n"
+    "Where:\n"
+    "  -s    number of subroutines (default 100)\n"
+    "  -b    basic block patterns per subroutine (default 20)\n"
+    "  -w    percentage of subroutines with a switch (default 20)\n"
+    "  -c    number of cases in each switch (default 8)\n",
+    prgname);
+  fprintf (stderr,
+    "  -i    number of imported libraries (default 4)\n"
+    "  -f    number of functions per imported library (default 8)\n"
+    "  -e    number of exported functions (default 4)\n"
+    "  -d    number of extra data relocations (default 0)\n"
+    "  -x    percentage of irreducible loops among the blocks (default 0)\n"
+    "  -r    random seed (default 1)\n"
+    "  -B    use type B relocations\n"
+    "  -n    also write a nids xml file for the imports\n");
+}
+
+int main (int argc, char **argv)
+{
+  struct options opts;
+  uint32 modinfo, *value;
+  int i, ret = 0;
+
+  opts.numsubs = 100;
+  opts.numblocks = 20;
+  opts.switchpct = 20;
+  opts.numcases = 8;
+  opts.numimports = 4;
+  opts.funcsperimport = 8;
+  opts.numexports = 4;
+  opts.numdatarelocs = 0;
+  opts.irreduciblepct = 0;
+  opts.seed = 1;
+  opts.typeb = 0;
+  opts.nidspath = NULL;
+  opts.outpath = NULL;
+
+  for (i = 1; i < argc; i++) {
+    if (argv[i][0] == '-' && argv[i][1] && !argv[i][2]) {
+      value = NULL;
+      switch (argv[i][1]) {
+      case 's': value = &opts.numsubs; break;
+      case 'b': value = &opts.numblocks; break;
+      case 'w': value = &opts.switchpct; break;
+      case 'c': value = &opts.numcases; break;
+      case 'i': value = &opts.numimports; break;
+      case 'f': value = &opts.funcsperimport; break;
+      case 'e': value = &opts.numexports; break;
+      case 'd': value = &opts.numdatarelocs; break;
+      case 'x': value = &opts.irreduciblepct; break;
+      case 'r': value = &opts.seed; break;
+      case 'B': opts.typeb = 1; continue;
+      case 'n':
+        if (++i >= argc) {
+          print_help (argv[0]);
+          return 1;
+        }
+        opts.nidspath = argv[i];
+        continue;
+      default:
+        print_help (argv[0]);
+        return 1;
+      }
+      if (++i >= argc) {
+        print_help (argv[0]);
+        return 1;
+      }
+      *value = strtoul (argv[i], NULL, 0);
+    } else {
+      opts.outpath = argv[i];
+    }
+  }
+
+  if (!opts.outpath || !opts.numsubs || opts.numcases > 0x7FFF) {
+    print_help (argv[0]);
+    return 1;
+  }
+
+  randseed = opts.seed;
+  build_image (&opts, &modinfo);
+  if (!write_prx (&opts, modinfo)) ret = 1;
+  if (opts.nidspath)
+    if (!write_nids (&opts)) ret = 1;
+
+  if (!ret) {
+    fprintf (stderr, "genprx: %u instructions, %u relocations, %u switch tables\n",
+             (unsigned int) (codesize / 4),
+             (unsigned int) numrelocs, (unsigned int) numtables);
+  }
+
+  free (image);
+  free (fixups);
+  free (relocs);
+  free (subaddrs);
+  free (stubaddrs);
+  free (stringaddrs);
+  free (tableaddrs);
+  free (tablecases);
+  free (tablesizes);
+  return ret;
+}
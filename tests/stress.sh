@@ -0,0 +1,58 @@
+#!/bin/sh
+
+# Decompiles synthetic PRX files with a few subroutines of tens of
+# thousands of blocks each, under the default stack limit, to check
+# that no stage recurses along the length of a subroutine.
+# The shapes are given as "subroutines:blocks:irreducible%" triples.
+# A shape small enough for the old recursive structuring is compared
+# with its output (stress_small.c.expected).
+
+SHAPES=${*:-"2:40000:0 3:20000:10"}
+STRESSDIR=stress
+
+ulimit -s 8192
+mkdir -p $STRESSDIR
+cd $STRESSDIR
+
+for SHAPE in $SHAPES; do
+        SUBS=`echo $SHAPE | cut -d: -f1`;
+        BLOCKS=`echo $SHAPE | cut -d: -f2`;
+        IRRED=`echo $SHAPE | cut -d: -f3`;
+        NAME=stress_${SUBS}_${BLOCKS}_${IRRED};
+
+        echo "=== $SUBS subroutines, $BLOCKS blocks per subroutine ===";
+        ../genprx -s $SUBS -b $BLOCKS -x ${IRRED:-0} -w 100 -c 64 \
+                -n $NAME.xml $NAME.prx || exit 1;
+        ../../pspdecompiler -n $NAME.xml -c -g $NAME.prx > /dev/null 2>&1;
+        if [ $? -ne 0 ]; then
+                echo "FAILED: $NAME.prx";
+                exit 1;
+        fi
+        rm -f *.c *.h *.dot;
+        echo "ok";
+done
+
+echo "=== same structures as the recursive search ===";
+../genprx -s 3 -b 100 -x 10 -w 100 -c 16 -n small.xml small.prx || exit 1;
+../../pspdecompiler -n small.xml -c -e small.prx > /dev/null 2>&1;
+if ! cmp -s small.c ../stress_small.c.expected; then
+        diff -u ../stress_small.c.expected small.c | head -40;
+        echo "FAILED: small.prx";
+        exit 1;
+fi
+rm -f *.c *.h;
+echo "ok";
+
+echo "=== small analysis budgets ===";
+../genprx -n budget.xml budget.prx || exit 1;
+for BUDGET in "--budget 300" "--stage-budget 300" "--budget 3000"; do
+        ../../pspdecompiler -n budget.xml $BUDGET -c -g budget.prx > /dev/null 2>&1;
+        if [ $? -ne 0 ]; then
+                echo "FAILED: $BUDGET budget.prx";
+                exit 1;
+        fi
+        rm -f *.c *.h *.dot;
+done
+echo "ok";
+
+cd ..
@@ -0,0 +1,85 @@
+/**
+ * Author: Humberto Naves (hsnaves@gmail.com)
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "threads.h"
+#include "utils.h"
+
+#define MAX_THREADS 64
+
+int g_numthreads = 1;
+
+struct parallel {
+  pthread_mutex_t mutex;
+  uint32 next, count;
+  parallelfn fn;
+  void *arg;
+};
+
+int threads_count (void)
+{
+  long n = g_numthreads;
+  if (n <= 0) {
+    n = sysconf (_SC_NPROCESSORS_ONLN);
+    if (n <= 0) n = 1;
+  }
+  return (int) MIN (n, MAX_THREADS);
+}
+
+static
+void *parallel_worker (void *arg)
+{
+  struct parallel *par = arg;
+  uint32 index;
+
+  while (1) {
+    pthread_mutex_lock (&par->mutex);
+    index = par->next;
+    if (index < par->count) par->next++;
+    pthread_mutex_unlock (&par->mutex);
+
+    if (index >= par->count) break;
+    par->fn (par->arg, index);
+  }
+  return NULL;
+}
+
+void parallel_for (uint32 count, parallelfn fn, void *arg)
+{
+  pthread_t threads[MAX_THREADS];
+  struct parallel par;
+  int i, numthreads;
+
+  numthreads = threads_count ();
+  if ((uint32) numthreads > count) numthreads = count;
+
+  if (numthreads <= 1) {
+    uint32 index;
+    for (index = 0; index < count; index++)
+      fn (arg, index);
+    return;
+  }
+
+  pthread_mutex_init (&par.mutex, NULL);
+  par.next = 0;
+  par.count = count;
+  par.fn = fn;
+  par.arg = arg;
+
+  /* The calling thread works too */
+  for (i = 1; i < numthreads; i++) {
+    if (pthread_create (&threads[i], NULL, &parallel_worker, &par) != 0)
+      fatal (__FILE__ ": can't create thread");
+  }
+  parallel_worker (&par);
+  for (i = 1; i < numthreads; i++)
+    pthread_join (threads[i], NULL);
+
+  pthread_mutex_destroy (&par.mutex);
+}
@@ -0,0 +1,17 @@
+/**
+ * Author: Humberto Naves (hsnaves@gmail.com)
+ */
+
+#ifndef __THREADS_H
+#define __THREADS_H
+
+#include "types.h"
+
+extern int g_numthreads;
+
+typedef void (*parallelfn) (void *arg, uint32 index);
+
+int threads_count (void);
+void parallel_for (uint32 count, parallelfn fn, void *arg);
+
+#endif /* __THREADS_H */
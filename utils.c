@@ -10,14 +10,22 @@
 
 #include "utils.h"
 
+static FILE *reportfp = NULL;
+
 void report (const char *fmt, ...)
 {
   va_list ap;
   va_start (ap, fmt);
-  vfprintf (stdout, fmt, ap);
+  vfprintf (reportfp ? reportfp : stdout, fmt, ap);
   va_end (ap);
 }
 
+/* Sends the reports to fp instead of stdout (NULL restores stdout) */
+void report_redirect (FILE *fp)
+{
+  reportfp = fp;
+}
+
 void error (const char *fmt, ...)
 {
   va_list ap;
@@ -127,3 +135,11 @@ void *read_file (const char *path, size_t *size)
   if (size) *size = file_size;
   return buffer;
 }
+
+uint32 popcount (uint32 x)
+{
+  x = x - ((x >> 1) & 0x55555555);
+  x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+  x = (x + (x >> 4)) & 0x0F0F0F0F;
+  return (x * 0x01010101) >> 24;
+}
@@ -5,10 +5,14 @@
 #ifndef __UTILS_H
 #define __UTILS_H
 
+#include <stdio.h>
 #include <stddef.h>
 #include <stdarg.h>
 
+#include "types.h"
+
 void report (const char *fmt, ...);
+void report_redirect (FILE *fp);
 
 void error (const char *fmt, ...);
 void xerror (const char *fmt, ...);
@@ -21,4 +25,6 @@ void *xrealloc (void *ptr, size_t size);
 
 void *read_file (const char *path, size_t *size);
 
+uint32 popcount (uint32 x);
+
 #endif /* __UTILS_H */
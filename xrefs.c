@@ -0,0 +1,136 @@
+/**
+ * Author: Humberto Naves (hsnaves@gmail.com)
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "code.h"
+#include "utils.h"
+
+/* The cross references are found in a single sweep over the code
+ * segment, merged with the relocations sorted by address. The calls are
+ * the jumps and branches to the start of a subroutine (the imports
+ * included), the data references are the relocated immediates and words
+ * of the code, which are also the values of the constant variables that
+ * carry a relocation. As the sweep is in address order and the
+ * subroutines are contiguous, the arrays come out sorted by the
+ * referencing subroutine; the copies sorted by the referenced address are
+ * the only ones left to sort. */
+
+static
+int cmp_target (const void *p1, const void *p2)
+{
+  const struct xref *r1 = p1, *r2 = p2;
+  if (r1->to != r2->to) return (r1->to < r2->to) ? -1 : 1;
+  if (r1->site != r2->site) return (r1->site < r2->site) ? -1 : 1;
+  return 0;
+}
+
+static
+int is_xref_call (struct location *loc)
+{
+  if (loc->reachable != LOCATION_REACHABLE || !loc->insn) return FALSE;
+  if (!(loc->insn->flags & (INSN_BRANCH | INSN_JUMP))) return FALSE;
+  if (!loc->target || !loc->target->sub || loc->target->sub->begin != loc->target)
+    return FALSE;
+  /* A branch back to the start of the same subroutine is a loop */
+  return (loc->insn->flags & INSN_LINK) || loc->target->sub != loc->sub;
+}
+
+static
+int is_xref_data (struct prx_reloc *rel)
+{
+  /* The hi16 parts have the same target as their lo16 */
+  return (rel->type == R_MIPS_LO16 || rel->type == R_MIPS_16 || rel->type == R_MIPS_32);
+}
+
+static
+struct xref *sorted_copy (struct xref *refs, uint32 num)
+{
+  struct xref *copy = (struct xref *) xmalloc ((num + 1) * sizeof (struct xref));
+  memcpy (copy, refs, num * sizeof (struct xref));
+  qsort (copy, num, sizeof (struct xref), &cmp_target);
+  return copy;
+}
+
+void build_xrefs (struct code *c)
+{
+  struct xrefs *x = &c->xrefs;
+  struct prx *p = c->file;
+  struct location *loc;
+  uint32 i, pos = 0, numcalls = 0, numdata = 0;
+
+  free_xrefs (c);
+
+  while (pos < p->relocnum && p->relocsbyaddr[pos].vaddr < c->baddr) pos++;
+
+  /* Counts them first, so that the arrays take no more than needed */
+  for (i = 0; i < c->numopc; i++) {
+    loc = &c->base[i];
+    if (is_xref_call (loc)) numcalls++;
+    for (; pos < p->relocnum && p->relocsbyaddr[pos].vaddr <= loc->address; pos++)
+      if (loc->sub && p->relocsbyaddr[pos].vaddr == loc->address &&
+          is_xref_data (&p->relocsbyaddr[pos])) numdata++;
+  }
+
+  x->calls = (struct xref *) xmalloc ((numcalls + 1) * sizeof (struct xref));
+  x->datarefs = (struct xref *) xmalloc ((numdata + 1) * sizeof (struct xref));
+
+  pos = 0;
+  while (pos < p->relocnum && p->relocsbyaddr[pos].vaddr < c->baddr) pos++;
+
+  for (i = 0; i < c->numopc; i++) {
+    struct xref *ref;
+    loc = &c->base[i];
+
+    if (is_xref_call (loc)) {
+      ref = &x->calls[x->numcalls++];
+      ref->from = loc->sub->begin->address;
+      ref->to = loc->target->address;
+      ref->site = loc->address;
+    }
+
+    for (; pos < p->relocnum && p->relocsbyaddr[pos].vaddr <= loc->address; pos++) {
+      struct prx_reloc *rel = &p->relocsbyaddr[pos];
+      if (!loc->sub || rel->vaddr != loc->address || !is_xref_data (rel)) continue;
+      ref = &x->datarefs[x->numdatarefs++];
+      ref->from = loc->sub->begin->address;
+      ref->to = rel->target;
+      ref->site = loc->address;
+    }
+  }
+
+  x->callers = sorted_copy (x->calls, x->numcalls);
+  x->datausers = sorted_copy (x->datarefs, x->numdatarefs);
+}
+
+void free_xrefs (struct code *c)
+{
+  struct xrefs *x = &c->xrefs;
+
+  if (x->calls) free (x->calls);
+  if (x->callers) free (x->callers);
+  if (x->datarefs) free (x->datarefs);
+  if (x->datausers) free (x->datausers);
+  memset (x, 0, sizeof (struct xrefs));
+}
+
+struct xref *xrefs_find (struct xref *refs, uint32 num, uint32 key, int bytarget, uint32 *count)
+{
+  uint32 lo = 0, hi = num, mid, end;
+
+#define XREF_KEY(r) (bytarget ? (r).to : (r).from)
+
+  while (lo < hi) {
+    mid = lo + ((hi - lo) >> 1);
+    if (XREF_KEY (refs[mid]) < key) lo = mid + 1;
+    else hi = mid;
+  }
+  for (end = lo; end < num && XREF_KEY (refs[end]) == key; end++);
+
+#undef XREF_KEY
+
+  *count = end - lo;
+  return &refs[lo];
+}